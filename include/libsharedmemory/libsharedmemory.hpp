@@ -9,17 +9,39 @@
 #include <string>
 #include <string_view>
 #include <cstddef> // nullptr_t, ptrdiff_t, std::size_t
+#include <cstdint>
 #include <limits>
 #include <span>
 #include <thread>
 #include <stdexcept>
 #include <atomic> // added for atomic queue counters
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <compare>
+#include <type_traits>
+#include <utility>
 
 #if defined(__APPLE__) || defined(__linux__) || defined(__unix__) || defined(_POSIX_VERSION) || defined(__ANDROID__)
 #include <fcntl.h>    // O_* constants
 #include <sys/stat.h>
 #include <sys/mman.h> // mmap, munmap
 #include <unistd.h>   // shm functions, close
+#include <pthread.h>  // pthread_atfork
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LSM_COPY_X86 1
+#include <immintrin.h> // streaming stores and prefetch for large copies
+#if defined(_MSC_VER)
+#include <intrin.h> // __cpuidex
+#endif
 #endif
 
 #if defined(_WIN32)
@@ -37,6 +59,26 @@
 #include <utility>
 #endif
 
+// USDT static probes (provider "lsm"), compiled in only when LSM_USDT is
+// defined (CMake: -DLSM_ENABLE_USDT=ON). An enabled probe is a single nop
+// until a tracer such as bpftrace attaches; disabled ones expand to nothing
+// and do not evaluate their arguments.
+#if defined(LSM_USDT)
+#if !defined(__linux__) || !__has_include(<sys/sdt.h>)
+#error "LSM_USDT needs <sys/sdt.h> on Linux (systemtap-sdt-dev / systemtap-sdt-devel)"
+#endif
+#include <sys/sdt.h>
+#define LSM_PROBE1(name, a1) DTRACE_PROBE1(lsm, name, a1)
+#define LSM_PROBE2(name, a1, a2) DTRACE_PROBE2(lsm, name, a1, a2)
+#define LSM_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(lsm, name, a1, a2, a3)
+#define LSM_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(lsm, name, a1, a2, a3, a4)
+#else
+#define LSM_PROBE1(name, a1) ((void)0)
+#define LSM_PROBE2(name, a1, a2) ((void)0)
+#define LSM_PROBE3(name, a1, a2, a3) ((void)0)
+#define LSM_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#endif
+
 namespace lsm
 {
 
@@ -56,6 +98,70 @@ enum DataType : std::uint8_t
   kMemoryTypeDouble = 8,
 };
 
+// optional stream features, recorded by the writer in the featureFlagsOffset byte
+enum StreamFeature : std::uint8_t
+{
+  kStreamFeatureStatistics = 1,
+};
+
+// Every stream and queue segment starts with a self-describing header, so a
+// reader can attach knowing only the name:
+// |magic(4)|version(2)|type(1)|reserved(1)|size(8)|
+// The creator stores the magic last, after the segment is initialized.
+inline constexpr std::size_t segmentHeaderSize = 16;
+inline constexpr std::uint32_t kSegmentMagic = 0x314D534C; // "LSM1" as stored on little-endian hosts
+inline constexpr std::uint16_t kSegmentVersion = 1;
+inline constexpr std::size_t segmentVersionOffset = 4;
+inline constexpr std::size_t segmentTypeOffset = 6;
+inline constexpr std::size_t segmentSizeOffset = 8;
+
+enum class SegmentType : std::uint8_t
+{
+  Stream = 1,
+  Queue = 2,
+  Registry = 3,
+  Allocator = 4,
+  BufferPool = 5,
+  HashMap = 6,
+  ValueTable = 7,
+  PriorityQueue = 8,
+  ConflatingQueue = 9,
+};
+
+// what a segment header says about its segment, see probeSegment()
+struct SegmentDescriptor
+{
+    SegmentType type = SegmentType::Stream;
+    std::uint16_t version = 0;
+    std::size_t size = 0; // size the creator asked for; the mapping may be rounded up to pages
+};
+
+[[nodiscard]] constexpr const char* segmentTypeName(const SegmentType type) noexcept
+{
+    switch (type)
+    {
+    case SegmentType::Stream:
+        return "stream";
+    case SegmentType::Queue:
+        return "queue";
+    case SegmentType::Registry:
+        return "registry";
+    case SegmentType::Allocator:
+        return "allocator";
+    case SegmentType::BufferPool:
+        return "buffer pool";
+    case SegmentType::HashMap:
+        return "hash map";
+    case SegmentType::ValueTable:
+        return "value table";
+    case SegmentType::PriorityQueue:
+        return "priority queue";
+    case SegmentType::ConflatingQueue:
+        return "conflating queue";
+    }
+    return "unknown";
+}
+
 // byte sizes of memory layout
 inline constexpr std::size_t bufferSizeSize = 4; // store buffer length as 32-bit value
 inline constexpr std::size_t sizeOfOneFloat = 4; // float takes 4 bytes
@@ -63,10 +169,14 @@ inline constexpr std::size_t sizeOfOneChar = 1; // char takes 1 byte
 inline constexpr std::size_t sizeOfOneDouble = 8; // double takes 8 bytes
 inline constexpr std::size_t flagSize = 1; // char takes 1 byte
 inline constexpr std::size_t flagPaddingSize = 3; // align following u32 metadata
+inline constexpr std::size_t flagsOffset = segmentHeaderSize; // data type and change flag
+inline constexpr std::size_t dirtyShiftOffset = flagsOffset + flagSize; // first padding byte: log2 of dirty block size, 0 = off
+inline constexpr std::size_t featureFlagsOffset = dirtyShiftOffset + 1; // second padding byte: StreamFeature bits
+inline constexpr std::size_t dirtyStampSize = 4; // 32-bit revision stamp per dirty block
 inline constexpr std::size_t revisionSize = 4; // 32-bit write revision counter
 inline constexpr std::size_t ackSize = 4; // 32-bit reader acknowledged revision
-inline constexpr std::size_t lockSize = 4; // 32-bit writer lock (0 unlocked, 1 locked)
-inline constexpr std::size_t revisionOffset = flagSize + flagPaddingSize;
+inline constexpr std::size_t lockSize = 4; // 32-bit stream lock (0 unlocked, else the holder's process id)
+inline constexpr std::size_t revisionOffset = flagsOffset + flagSize + flagPaddingSize;
 inline constexpr std::size_t ackOffset = revisionOffset + revisionSize;
 inline constexpr std::size_t sizeOffset = ackOffset + ackSize;
 inline constexpr std::size_t lockOffset = sizeOffset + bufferSizeSize;
@@ -76,19 +186,49 @@ class Memory
 {
 public:
     // path should only contain alpha-numeric characters, and is normalized
-    // on linux/macOS.
+    // on linux/macOS. A size of 0 maps an existing segment whole on open(),
+    // after which size() reports the mapped length.
     explicit Memory(const std::string& path, std::size_t size, bool persist);
 
+    // [offset, offset + size) of an arena that is already mapped, see
+    // SharedMemoryRegistry. open() points into the arena and create() also
+    // zeroes the region; close() and destroy() leave the arena alone.
+    Memory(std::shared_ptr<Memory> arena, const std::string& name, std::size_t offset, std::size_t size);
+
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
     // create a shared memory area and open it for writing
     [[nodiscard]] Error create()
     {
-        return createOrOpen(true);
+        return _arena ? mapRegion(true, false) : createOrOpen(true);
     }
 
     // open an existing shared memory for reading
     [[nodiscard]] Error open()
     {
-        return createOrOpen(false);
+        return _arena ? mapRegion(false, false) : createOrOpen(false);
+    }
+
+    // open the shared memory if it exists, else create it, without ever replacing
+    // it as create() does; created tells whether this call made the segment, so
+    // concurrent first users agree on one segment and on who initializes it
+    [[nodiscard]] Error openOrCreate(bool& created)
+    {
+        created = false;
+        return _arena ? mapRegion(false, false) : openOrCreateShared(created);
+    }
+
+    // map an existing shared memory without write access, for inspection;
+    // the mapping must not be written through, including its lock words
+    [[nodiscard]] Error openReadOnly()
+    {
+        return _arena ? mapRegion(false, true) : createOrOpen(false, true);
+    }
+
+    [[nodiscard]] bool readOnly() const noexcept
+    {
+        return _readOnly;
     }
 
     [[nodiscard]] std::size_t size() const noexcept
@@ -101,6 +241,12 @@ public:
         return _path;
     }
 
+    // the name passed to the constructor, before any platform normalization
+    [[nodiscard]] const std::string &name() const noexcept
+    {
+        return _name;
+    }
+
     [[nodiscard]] void *data() const noexcept
     {
         return _data;
@@ -118,12 +264,18 @@ public:
     ~Memory();
 
 private:
-    [[nodiscard]] Error createOrOpen(bool create);
+    [[nodiscard]] Error createOrOpen(bool create, bool readOnly = false);
+    [[nodiscard]] Error openOrCreateShared(bool& created);
+    [[nodiscard]] Error mapRegion(bool create, bool readOnly);
 
+    std::string _name;
     std::string _path;
     void *_data = nullptr;
     std::size_t _size = 0;
     bool _persist = true;
+    bool _readOnly = false;
+    std::shared_ptr<Memory> _arena; // set for regions only
+    std::size_t _arenaOffset = 0;
 #if defined(_WIN32)
     HANDLE _handle = nullptr;
     HANDLE _fileHandle = INVALID_HANDLE_VALUE;
@@ -292,7 +444,7 @@ namespace lsm_windows_detail
     }
 }
 
-Memory::Memory(const std::string& path, std::size_t size, bool persist) : _path(path), _size(size), _persist(persist)
+Memory::Memory(const std::string& path, std::size_t size, bool persist) : _name(path), _path(path), _size(size), _persist(persist)
 {
     if (_persist)
     {
@@ -300,8 +452,10 @@ Memory::Memory(const std::string& path, std::size_t size, bool persist) : _path(
     }
 }
 
-Error Memory::createOrOpen(const bool create)
+Error Memory::createOrOpen(const bool create, const bool readOnly)
 {
+    _readOnly = readOnly;
+    const DWORD fileAccess = readOnly ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE);
     const DWORD size_high_order = static_cast<DWORD>((static_cast<unsigned long long>(_size) >> 32) & 0xFFFFFFFFull);
     const DWORD size_low_order = static_cast<DWORD>(static_cast<unsigned long long>(_size) & 0xFFFFFFFFull);
 
@@ -316,7 +470,7 @@ Error Memory::createOrOpen(const bool create)
         // CREATE_ALWAYS: Always creates new, truncating existing - forces fresh start
         const DWORD disposition = create ? CREATE_ALWAYS : OPEN_EXISTING;
         HANDLE fileHandle = CreateFileA(_persistFilePath.c_str(),
-                                        GENERIC_READ | GENERIC_WRITE,
+                                        fileAccess,
                                         FILE_SHARE_READ | FILE_SHARE_WRITE,
                                         NULL,
                                         disposition,
@@ -330,10 +484,13 @@ Error Memory::createOrOpen(const bool create)
 
         CloseHandle(fileHandle); // will be reopened, this is just to ensure the file exists and has correct permissions
 
-        lsm_windows_detail::AssignPermissionsToFilesystemPath(_persistFilePath, lsm_windows_detail::UTIL_PERM_READ | lsm_windows_detail::UTIL_PERM_WRITE);
+        if (!readOnly)
+        {
+            lsm_windows_detail::AssignPermissionsToFilesystemPath(_persistFilePath, lsm_windows_detail::UTIL_PERM_READ | lsm_windows_detail::UTIL_PERM_WRITE);
+        }
 
         fileHandle = CreateFileA(_persistFilePath.c_str(),
-                                        GENERIC_READ | GENERIC_WRITE,
+                                        fileAccess,
                                         FILE_SHARE_READ | FILE_SHARE_WRITE,
                                         NULL,
                                         disposition,
@@ -359,7 +516,7 @@ Error Memory::createOrOpen(const bool create)
             }
         }
 
-        if (resizeFile)
+        if (resizeFile && !readOnly)
         {
             if (!SetFilePointerEx(fileHandle, requiredSize, NULL, FILE_BEGIN) || !SetEndOfFile(fileHandle))
             {
@@ -372,7 +529,7 @@ Error Memory::createOrOpen(const bool create)
 
         _handle = CreateFileMappingA(_fileHandle,
                                      NULL,
-                                     PAGE_READWRITE,
+                                     readOnly ? PAGE_READONLY : PAGE_READWRITE,
                                      size_high_order,
                                      size_low_order,
                                      NULL);
@@ -408,7 +565,7 @@ Error Memory::createOrOpen(const bool create)
         }
         else
         {
-            _handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, // read/write access
+            _handle = OpenFileMappingA(readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS,
                                        FALSE,               // do not inherit the name
                                        _path.c_str());      // name of mapping object
 
@@ -421,9 +578,93 @@ Error Memory::createOrOpen(const bool create)
 
     // Change detection relies on explicit flags to keep the implementation lightweight
 
-    const DWORD access = FILE_MAP_ALL_ACCESS; // always request read/write view
+    const DWORD access = readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
     _data = MapViewOfFile(_handle, access, 0, 0, _size);
 
+    if (!_data)
+    {
+        close();
+        return Error::MappingFailed;
+    }
+
+    if (_size == 0)
+    {
+        // a zero-length view spans the whole section; learn its (page-rounded) size
+        MEMORY_BASIC_INFORMATION info;
+        if (VirtualQuery(_data, &info, sizeof(info)) == 0)
+        {
+            close();
+            return Error::MappingFailed;
+        }
+        _size = info.RegionSize;
+    }
+    return Error::OK;
+}
+
+Error Memory::openOrCreateShared(bool& created)
+{
+    _readOnly = false;
+    const DWORD size_high_order = static_cast<DWORD>((static_cast<unsigned long long>(_size) >> 32) & 0xFFFFFFFFull);
+    const DWORD size_low_order = static_cast<DWORD>(static_cast<unsigned long long>(_size) & 0xFFFFFFFFull);
+
+    if (_persist)
+    {
+        if (_persistFilePath.empty())
+        {
+            _persistFilePath = lsm_windows_detail::persistence_file_path(_path);
+        }
+
+        // OPEN_ALWAYS never truncates; ERROR_ALREADY_EXISTS tells an attacher from the creator
+        HANDLE fileHandle = CreateFileA(_persistFilePath.c_str(),
+                                        GENERIC_READ | GENERIC_WRITE,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                        NULL,
+                                        OPEN_ALWAYS,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+        {
+            return Error::CreationFailed;
+        }
+        created = GetLastError() != ERROR_ALREADY_EXISTS;
+        if (created)
+        {
+            lsm_windows_detail::AssignPermissionsToFilesystemPath(_persistFilePath, lsm_windows_detail::UTIL_PERM_READ | lsm_windows_detail::UTIL_PERM_WRITE);
+        }
+
+        // every user grows the file, an attacher may get in before the creator does
+        LARGE_INTEGER requiredSize;
+        requiredSize.QuadPart = static_cast<LONGLONG>(_size);
+        LARGE_INTEGER currentSize;
+        if (!GetFileSizeEx(fileHandle, &currentSize)
+            || (currentSize.QuadPart < requiredSize.QuadPart
+                && (!SetFilePointerEx(fileHandle, requiredSize, NULL, FILE_BEGIN) || !SetEndOfFile(fileHandle))))
+        {
+            CloseHandle(fileHandle);
+            return Error::CreationFailed;
+        }
+        _fileHandle = fileHandle;
+
+        _handle = CreateFileMappingA(_fileHandle, NULL, PAGE_READWRITE, size_high_order, size_low_order, NULL);
+        if (!_handle)
+        {
+            CloseHandle(_fileHandle);
+            _fileHandle = INVALID_HANDLE_VALUE;
+            return Error::MappingFailed;
+        }
+    }
+    else
+    {
+        _handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, size_high_order, size_low_order,
+                                     _path.c_str());
+        if (!_handle)
+        {
+            return Error::CreationFailed;
+        }
+        created = GetLastError() != ERROR_ALREADY_EXISTS;
+    }
+
+    _data = MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, _size);
     if (!_data)
     {
         close();
@@ -434,7 +675,7 @@ Error Memory::createOrOpen(const bool create)
 
 void Memory::destroy() const
 {
-    if (_persistFilePath.empty())
+    if (_arena || _persistFilePath.empty())
     {
         return;
     }
@@ -447,6 +688,11 @@ void Memory::destroy() const
 
 void Memory::close()
 {
+    if (_arena)
+    {
+        _data = nullptr;
+        return;
+    }
     if (_data)
     {
         UnmapViewOfFile(_data);
@@ -477,13 +723,14 @@ Memory::~Memory()
 // POSIX shared memory implementation
 #if defined(__APPLE__) || defined(__linux__) || defined(__unix__) || defined(_POSIX_VERSION) || defined(__ANDROID__)
 
-inline Memory::Memory(const std::string& path, const std::size_t size, const bool persist) : _size(size), _persist(persist)
+inline Memory::Memory(const std::string& path, const std::size_t size, const bool persist) : _name(path), _size(size), _persist(persist)
 {
     _path = "/" + path;
 }
 
-inline Error Memory::createOrOpen(const bool create)
+inline Error Memory::createOrOpen(const bool create, const bool readOnly)
 {
+    _readOnly = readOnly;
     if (create)
     {
         // shm segments persist across runs, and macOS will refuse
@@ -499,10 +746,13 @@ inline Error Memory::createOrOpen(const bool create)
         }
     }
 
-    const int flags = create ? (O_CREAT | O_RDWR) : O_RDWR;
+    const int flags = create ? (O_CREAT | O_RDWR) : (readOnly ? O_RDONLY : O_RDWR);
 
     _fd = shm_open(_path.c_str(), flags, 0777);
-    fchmod(_fd, 0777); //explicit
+    if (!readOnly)
+    {
+        fchmod(_fd, 0777); //explicit
+    }
 
     if (_fd < 0)
     {
@@ -526,8 +776,17 @@ inline Error Memory::createOrOpen(const bool create)
             return Error::CreationFailed;
         }
     }
+    else if (_size == 0)
+    {
+        struct stat info;
+        if (fstat(_fd, &info) != 0 || info.st_size <= 0)
+        {
+            return Error::OpeningFailed;
+        }
+        _size = static_cast<std::size_t>(info.st_size);
+    }
 
-    constexpr int prot = PROT_READ | PROT_WRITE;
+    const int prot = readOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
 
     _data = mmap(nullptr,    // addr
                  _size,      // length
@@ -549,13 +808,67 @@ inline Error Memory::createOrOpen(const bool create)
     return Error::OK;
 }
 
+inline Error Memory::openOrCreateShared(bool& created)
+{
+    _readOnly = false;
+
+    // O_EXCL picks out the process that made the object; nobody unlinks, so
+    // first users racing each other all end up in the same segment
+    _fd = shm_open(_path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0777);
+    created = _fd >= 0;
+    if (!created)
+    {
+        if (errno != EEXIST)
+        {
+            return Error::CreationFailed;
+        }
+        _fd = shm_open(_path.c_str(), O_RDWR, 0777);
+        if (_fd < 0)
+        {
+            return Error::OpeningFailed;
+        }
+    }
+    fchmod(_fd, 0777);
+
+    // every user sizes the object, since an attacher may map it between the
+    // creator's shm_open and ftruncate; a mapping past the end would SIGBUS.
+    // Growing is idempotent, and macOS refuses to resize a sized object anyway.
+    struct stat info;
+    if (fstat(_fd, &info) != 0)
+    {
+        return Error::OpeningFailed;
+    }
+    if (static_cast<std::size_t>(info.st_size) < _size && ftruncate(_fd, static_cast<off_t>(_size)) != 0
+        && (fstat(_fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < _size))
+    {
+        return Error::CreationFailed;
+    }
+
+    _data = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (_data == MAP_FAILED || !_data)
+    {
+        _data = nullptr;
+        return Error::MappingFailed;
+    }
+    return Error::OK;
+}
+
 inline void Memory::destroy() const
 {
+    if (_arena)
+    {
+        return;
+    }
     shm_unlink(_path.c_str());
 }
 
 inline void Memory::close()
 {
+    if (_arena)
+    {
+        _data = nullptr;
+        return;
+    }
     munmap(_data, _size);
     if (_fd >= 0)
     {
@@ -577,658 +890,5881 @@ inline Memory::~Memory()
 
 #endif // POSIX implementation
 
-class SharedMemoryReadStream
+inline Memory::Memory(std::shared_ptr<Memory> arena, const std::string& name, const std::size_t offset,
+                      const std::size_t size):
+    _name(name), _path(arena->path() + "/" + name), _size(size), _arena(std::move(arena)), _arenaOffset(offset)
 {
-public:
-    SharedMemoryReadStream(const std::string& name, const std::size_t bufferSize, const bool isPersistent):
-        _memory(name, bufferSize, isPersistent)
-    {
-        if (_memory.open() != Error::OK)
-        {
-            throw std::runtime_error("Shared memory segment could not be opened.");
-        }
+}
 
-        _lastSeenRevision = readRevision();
+inline Error Memory::mapRegion(const bool create, const bool readOnly)
+{
+    if (!_arena->data() || _arenaOffset + _size > _arena->size() || (create && _arena->readOnly()))
+    {
+        return create ? Error::CreationFailed : Error::OpeningFailed;
     }
-
-    [[nodiscard]] char readFlags() const noexcept
+    _readOnly = readOnly || _arena->readOnly();
+    _data = static_cast<char*>(_arena->data()) + _arenaOffset;
+    if (create)
     {
-        const auto memory = static_cast<const char*>(_memory.data());
-        return memory[0];
+        std::memset(_data, 0, _size);
     }
+    return Error::OK;
+}
 
-    [[nodiscard]] bool hasNewData() const noexcept
+// Segment header
+
+inline void writeSegmentHeader(Memory& memory, const SegmentType type)
+{
+    auto base = static_cast<char*>(memory.data());
+    const std::uint16_t version = kSegmentVersion;
+    const std::uint64_t size = memory.size();
+    std::memcpy(&base[segmentVersionOffset], &version, sizeof(version));
+    base[segmentTypeOffset] = static_cast<char>(type);
+    std::memcpy(&base[segmentSizeOffset], &size, sizeof(size));
+    reinterpret_cast<std::atomic<std::uint32_t>*>(base)->store(kSegmentMagic, std::memory_order_release);
+}
+
+// nothing if the mapping does not start with a header (yet)
+[[nodiscard]] inline std::optional<SegmentDescriptor> readSegmentHeader(const Memory& memory) noexcept
+{
+    const auto base = static_cast<const char*>(memory.data());
+    if (!base || memory.size() < segmentHeaderSize
+        || reinterpret_cast<const std::atomic<std::uint32_t>*>(base)->load(std::memory_order_acquire) != kSegmentMagic)
     {
-        return readRevision() != _lastSeenRevision;
+        return std::nullopt;
     }
 
-    void markAsRead() const noexcept
+    SegmentDescriptor descriptor;
+    std::uint64_t size = 0;
+    std::memcpy(&descriptor.version, &base[segmentVersionOffset], sizeof(descriptor.version));
+    descriptor.type = static_cast<SegmentType>(base[segmentTypeOffset]);
+    std::memcpy(&size, &base[segmentSizeOffset], sizeof(size));
+    descriptor.size = static_cast<std::size_t>(size);
+    return descriptor;
+}
+
+/**
+ * @brief Validates the header of an opened segment for a stream or queue
+ * @param expectedSize the size the caller mapped, or 0 to accept any size
+ * @return the segment size recorded by its creator
+ */
+[[nodiscard]] inline std::size_t checkSegmentHeader(const Memory& memory, const SegmentType type, const std::size_t expectedSize)
+{
+    const std::optional<SegmentDescriptor> descriptor = readSegmentHeader(memory);
+    if (!descriptor)
     {
-        const std::uint32_t revision = readRevision();
-        writeAck(revision);
-        _lastSeenRevision = revision;
+        throw std::runtime_error("Shared memory segment has no lsm header.");
     }
-
-    void close()
+    if (descriptor->version != kSegmentVersion)
     {
-        _memory.close();
+        throw std::runtime_error("Shared memory segment has an unsupported layout version.");
     }
-
-    [[nodiscard]] size_t readSize(const char /*dataType*/) const noexcept
+    if (descriptor->type != type)
     {
-        const auto memory = static_cast<const char*>(_memory.data());
-        std::uint32_t storedSize = 0;
-        std::memcpy(&storedSize, &memory[sizeOffset], bufferSizeSize);
-        return static_cast<std::size_t>(storedSize);
+        throw std::runtime_error(std::string("Shared memory segment is not a ") + segmentTypeName(type) + ".");
+    }
+    if (descriptor->size > memory.size() || (expectedSize != 0 && descriptor->size != expectedSize))
+    {
+        throw std::runtime_error("Shared memory segment size does not match.");
     }
+    return descriptor->size;
+}
 
-    [[nodiscard]] size_t readLength(const char dataType) const noexcept
+/**
+ * @brief Reads the header of a named segment without keeping it mapped
+ * @return nothing if there is no such segment or it carries no header
+ */
+[[nodiscard]] inline std::optional<SegmentDescriptor> probeSegment(const std::string& name, const bool isPersistent = true)
+{
+#if defined(_WIN32)
+    Memory memory{name, 0, isPersistent};
+#else
+    (void)isPersistent;
+    Memory memory{name, 0, true}; // on POSIX persistence only decides whether the destructor unlinks
+#endif
+    if (memory.openReadOnly() != Error::OK)
     {
-        const size_t size = readSize(dataType);
+        return std::nullopt;
+    }
+    return readSegmentHeader(memory);
+}
 
-        if (dataType & kMemoryTypeString)
+// Large-payload copy kernels
+//
+// Payloads well beyond the last-level cache are copied into the mapping with
+// non-temporal (streaming) stores, so publishing a frame neither evicts the
+// writer's working set nor pays read-for-ownership traffic, and out of it with
+// software prefetching. The kernel is picked once at runtime from the CPU
+// features; anything below the threshold, and every non-x86 target, uses
+// plain memcpy.
+
+inline constexpr std::size_t kDefaultLargeCopyThreshold = std::size_t{4} << 20;
+
+enum class CopyKernel
+{
+    Memcpy = 0,
+    AVX2 = 1,
+    AVX512 = 2,
+};
+
+namespace lsm_copy_detail
+{
+    inline std::atomic<std::size_t> largeCopyThreshold{kDefaultLargeCopyThreshold};
+
+    inline constexpr std::size_t prefetchDistance = 512;
+
+#if defined(LSM_COPY_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LSM_TARGET_AVX2 __attribute__((target("avx2")))
+#define LSM_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define LSM_TARGET_AVX2
+#define LSM_TARGET_AVX512
+#endif
+
+    inline CopyKernel detectCopyKernel() noexcept
+    {
+#if defined(LSM_COPY_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
         {
-            return size / sizeOfOneChar;
+            return CopyKernel::AVX512;
         }
-
-        if (dataType & kMemoryTypeFloat)
+        if (__builtin_cpu_supports("avx2"))
         {
-            return size / sizeOfOneFloat;
+            return CopyKernel::AVX2;
         }
-
-        if (dataType & kMemoryTypeDouble)
+#elif defined(LSM_COPY_X86) && defined(_MSC_VER)
+        int info[4] = {0, 0, 0, 0};
+        __cpuidex(info, 1, 0);
+        const bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+        if (osSavesYmm)
         {
-            return size / sizeOfOneDouble;
+            __cpuidex(info, 7, 0);
+            const bool osSavesZmm = (_xgetbv(0) & 0xE6) == 0xE6;
+            if (osSavesZmm && (info[1] & (1 << 16)) != 0)
+            {
+                return CopyKernel::AVX512;
+            }
+            if ((info[1] & (1 << 5)) != 0)
+            {
+                return CopyKernel::AVX2;
+            }
         }
-        return 0;
+#endif
+        return CopyKernel::Memcpy;
     }
 
-    /**
-     * @brief Returns a doible* read from shared memory
-     * Caller has the obligation to call delete [] on the returning float*.
-     *
-     * @return float*
-     */
-    [[nodiscard]] double* readDoubleArray() const
+#if defined(LSM_COPY_X86)
+    // copies the unaligned head with memcpy so every vector store is aligned
+    inline std::size_t alignHead(char*& dst, const char*& src, std::size_t& n, const std::size_t alignment) noexcept
     {
-        return readNumericArray<double>(kMemoryTypeDouble, sizeOfOneDouble);
+        std::size_t head = (alignment - (reinterpret_cast<std::uintptr_t>(dst) & (alignment - 1))) & (alignment - 1);
+        head = std::min(head, n);
+        std::memcpy(dst, src, head);
+        dst += head;
+        src += head;
+        n -= head;
+        return head;
     }
 
-    /**
-     * @brief Returns a float* read from shared memory
-     * Caller has the obligation to call delete [] on the returning float*.
-     *
-     * @return float*
-     */
-    [[nodiscard]] float* readFloatArray() const
+    LSM_TARGET_AVX2 inline void streamStoreAvx2(char* dst, const char* src, std::size_t n) noexcept
     {
-        return readNumericArray<float>(kMemoryTypeFloat, sizeOfOneFloat);
+        alignHead(dst, src, n, 32);
+        for (; n >= 128; n -= 128, src += 128, dst += 128)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+        }
+        for (; n >= 32; n -= 32, src += 32, dst += 32)
+        {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+        }
+        // streaming stores are weakly ordered; fence before the revision is published
+        _mm_sfence();
+        std::memcpy(dst, src, n);
     }
 
-    [[nodiscard]] std::string readString() const
+    LSM_TARGET_AVX512 inline void streamStoreAvx512(char* dst, const char* src, std::size_t n) noexcept
     {
-        const auto memory = static_cast<const char*>(_memory.data());
-        lockForRead();
-        const std::size_t size = readSize(kMemoryTypeString);
-        auto data = std::string(&memory[dataOffset], size);
-        unlockRead();
-        return data;
+        alignHead(dst, src, n, 64);
+        for (; n >= 256; n -= 256, src += 256, dst += 256)
+        {
+            const __m512i a = _mm512_loadu_si512(src);
+            const __m512i b = _mm512_loadu_si512(src + 64);
+            const __m512i c = _mm512_loadu_si512(src + 128);
+            const __m512i d = _mm512_loadu_si512(src + 192);
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), a);
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64), b);
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), c);
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), d);
+        }
+        for (; n >= 64; n -= 64, src += 64, dst += 64)
+        {
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), _mm512_loadu_si512(src));
+        }
+        _mm_sfence();
+        std::memcpy(dst, src, n);
     }
 
-private:
-    template <typename T>
-    [[nodiscard]] T* readNumericArray(const char typeFlag, const std::size_t elementSize) const
-    {
-        const auto memory = static_cast<const char*>(_memory.data());
-
-        lockForRead();
-        const std::size_t byteSize = readSize(typeFlag);
-        const std::size_t length = byteSize / elementSize;
-        auto data = new T[length]();
-        std::memcpy(data, &memory[dataOffset], byteSize);
-        unlockRead();
-        return data;
-    }
-
-    [[nodiscard]] bool isWriteLocked() const noexcept
-    {
-        return atomicUInt32(lockOffset).load(std::memory_order_acquire) != 0;
-    }
-
-    void lockForRead() const noexcept
+    LSM_TARGET_AVX2 inline void prefetchLoadAvx2(char* dst, const char* src, std::size_t n) noexcept
     {
-        std::uint32_t expected = 0;
-        while (!atomicUInt32(lockOffset).compare_exchange_weak(
-                   expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+        for (; n >= 128 + prefetchDistance; n -= 128, src += 128, dst += 128)
         {
-            expected = 0;
-            std::this_thread::yield();
+            _mm_prefetch(src + prefetchDistance, _MM_HINT_T0);
+            _mm_prefetch(src + prefetchDistance + 64, _MM_HINT_T0);
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 96), d);
         }
+        std::memcpy(dst, src, n);
     }
 
-    void unlockRead() const noexcept
+    LSM_TARGET_AVX512 inline void prefetchLoadAvx512(char* dst, const char* src, std::size_t n) noexcept
     {
-        atomicUInt32(lockOffset).store(0, std::memory_order_release);
+        for (; n >= 256 + prefetchDistance; n -= 256, src += 256, dst += 256)
+        {
+            _mm_prefetch(src + prefetchDistance, _MM_HINT_T0);
+            _mm_prefetch(src + prefetchDistance + 64, _MM_HINT_T0);
+            _mm_prefetch(src + prefetchDistance + 128, _MM_HINT_T0);
+            _mm_prefetch(src + prefetchDistance + 192, _MM_HINT_T0);
+            const __m512i a = _mm512_loadu_si512(src);
+            const __m512i b = _mm512_loadu_si512(src + 64);
+            const __m512i c = _mm512_loadu_si512(src + 128);
+            const __m512i d = _mm512_loadu_si512(src + 192);
+            _mm512_storeu_si512(dst, a);
+            _mm512_storeu_si512(dst + 64, b);
+            _mm512_storeu_si512(dst + 128, c);
+            _mm512_storeu_si512(dst + 192, d);
+        }
+        std::memcpy(dst, src, n);
     }
+#endif // LSM_COPY_X86
+} // namespace lsm_copy_detail
 
-    [[nodiscard]] std::uint32_t readRevision() const noexcept
-    {
-        return atomicUInt32(revisionOffset).load(std::memory_order_acquire);
-    }
+// kernel used for copies at or above largeCopyThreshold(), detected once per process
+[[nodiscard]] inline CopyKernel activeCopyKernel() noexcept
+{
+    static const CopyKernel kernel = lsm_copy_detail::detectCopyKernel();
+    return kernel;
+}
 
-    void writeAck(const std::uint32_t ack) const noexcept
-    {
-        atomicUInt32(ackOffset).store(ack, std::memory_order_release);
-    }
+[[nodiscard]] inline std::size_t largeCopyThreshold() noexcept
+{
+    return lsm_copy_detail::largeCopyThreshold.load(std::memory_order_relaxed);
+}
 
-    [[nodiscard]] std::atomic<std::uint32_t>& atomicUInt32(const std::size_t offset) const noexcept
-    {
-        auto memory = static_cast<char*>(_memory.data());
-        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[offset]);
-    }
+// process-wide; payloads of at least this many bytes use the large-copy kernels
+inline void setLargeCopyThreshold(const std::size_t bytes) noexcept
+{
+    lsm_copy_detail::largeCopyThreshold.store(bytes, std::memory_order_relaxed);
+}
 
-    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
+// copy into a shared mapping; the data is ordered before any later release store
+inline void copyToShared(void* dst, const void* src, const std::size_t n) noexcept
+{
+#if defined(LSM_COPY_X86)
+    if (n >= largeCopyThreshold())
     {
-        const auto memory = static_cast<const char*>(_memory.data());
-        std::uint32_t value = 0;
-        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
-        return value;
+        switch (activeCopyKernel())
+        {
+        case CopyKernel::AVX512:
+            lsm_copy_detail::streamStoreAvx512(static_cast<char*>(dst), static_cast<const char*>(src), n);
+            return;
+        case CopyKernel::AVX2:
+            lsm_copy_detail::streamStoreAvx2(static_cast<char*>(dst), static_cast<const char*>(src), n);
+            return;
+        case CopyKernel::Memcpy:
+            break;
+        }
     }
+#endif
+    std::memcpy(dst, src, n);
+}
 
-    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
+// copy out of a shared mapping into private memory
+inline void copyFromShared(void* dst, const void* src, const std::size_t n) noexcept
+{
+#if defined(LSM_COPY_X86)
+    if (n >= largeCopyThreshold())
     {
-        auto memory = static_cast<char*>(_memory.data());
-        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
-
+        switch (activeCopyKernel())
+        {
+        case CopyKernel::AVX512:
+            lsm_copy_detail::prefetchLoadAvx512(static_cast<char*>(dst), static_cast<const char*>(src), n);
+            return;
+        case CopyKernel::AVX2:
+            lsm_copy_detail::prefetchLoadAvx2(static_cast<char*>(dst), static_cast<const char*>(src), n);
+            return;
+        case CopyKernel::Memcpy:
+            break;
+        }
     }
+#endif
+    std::memcpy(dst, src, n);
+}
 
-    Memory _memory;
-    mutable std::uint32_t _lastSeenRevision = 0;
+enum class CopyDirection
+{
+    ToShared,
+    FromShared,
 };
 
-class SharedMemoryWriteStream
+/**
+ * @brief Fixed set of worker threads that split one large copy into chunks
+ * A single core saturates at roughly 10 GB/s of memcpy; spreading a
+ * multi-gigabyte frame over a few cores shortens the time the stream lock is
+ * held. The calling thread copies chunks as well and returns only once every
+ * chunk has landed, so the caller publishes the revision exactly once. One
+ * pool may be shared by several streams; concurrent copies through the same
+ * pool are serialized.
+ */
+class CopyThreadPool
 {
 public:
-    SharedMemoryWriteStream(const std::string& name, const std::size_t bufferSize, const bool isPersistent):
-        _memory(name, bufferSize, isPersistent)
+    /**
+     * @param workers Number of helper threads (the caller is an extra participant)
+     * @param minChunkSize Smallest chunk handed to a thread; smaller copies run inline
+     */
+    explicit CopyThreadPool(const unsigned workers, const std::size_t minChunkSize = std::size_t{1} << 20)
+        : _minChunkSize(std::max<std::size_t>(minChunkSize, 64))
     {
-        if (_memory.create() != Error::OK)
+        _threads.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i)
         {
-            throw std::runtime_error("Shared memory segment could not be created.");
+            _threads.emplace_back([this]() { workerLoop(); });
         }
+    }
 
-        auto memory = static_cast<char*>(_memory.data());
-        memory[0] = 0;
-        writeUInt32(revisionOffset, 0);
-        writeUInt32(ackOffset, 0);
-        writeUInt32(sizeOffset, 0);
-        new (&memory[lockOffset]) std::atomic<std::uint32_t>(0);
+    CopyThreadPool(const CopyThreadPool&) = delete;
+    CopyThreadPool& operator=(const CopyThreadPool&) = delete;
+
+    ~CopyThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& thread : _threads)
+        {
+            thread.join();
+        }
     }
 
-    void close()
+    [[nodiscard]] unsigned workers() const noexcept
     {
-        _memory.close();
+        return static_cast<unsigned>(_threads.size());
     }
 
-    [[nodiscard]] bool isMessageRead() const noexcept
+    [[nodiscard]] std::size_t minChunkSize() const noexcept
     {
-        return atomicUInt32(ackOffset).load(std::memory_order_acquire)
-            == atomicUInt32(revisionOffset).load(std::memory_order_acquire);
+        return _minChunkSize;
     }
 
-    void waitForRead() const noexcept
+    void copy(void* dst, const void* src, const std::size_t n, const CopyDirection direction)
     {
-        while (!isMessageRead())
+        const std::size_t participants = std::min<std::size_t>(_threads.size() + 1, n / _minChunkSize);
+        if (participants < 2)
         {
-            std::this_thread::yield();
+            copyChunk(static_cast<char*>(dst), static_cast<const char*>(src), n, direction);
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit(_submitMutex);
+
+        // cache-line aligned chunks keep threads from sharing destination lines
+        const std::size_t chunkSize = ((n + participants - 1) / participants + 63) & ~std::size_t{63};
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = {static_cast<char*>(dst), static_cast<const char*>(src), n, chunkSize, direction};
+            _nextChunk.store(0, std::memory_order_relaxed);
+            _busyWorkers = _threads.size();
+            ++_generation;
         }
+        _wake.notify_all();
+
+        runChunks();
+
+        // the workers' unlock of _mutex orders their stores before our return
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this]() { return _busyWorkers == 0; });
     }
 
-    // https://stackoverflow.com/questions/18591924/how-to-use-bitmask
-    [[nodiscard]] static constexpr char getWriteFlags(const char type, const char currentFlags) noexcept
+private:
+    struct Job
     {
-        char flags = type;
-
-        if ((currentFlags & (kMemoryChanged)) == kMemoryChanged)
+        char* dst = nullptr;
+        const char* src = nullptr;
+        std::size_t size = 0;
+        std::size_t chunkSize = 0;
+        CopyDirection direction = CopyDirection::ToShared;
+    };
+
+    static void copyChunk(char* dst, const char* src, const std::size_t n, const CopyDirection direction) noexcept
+    {
+        if (direction == CopyDirection::ToShared)
         {
-            // disable flag, leave rest untouched
-            flags &= ~kMemoryChanged;
+            copyToShared(dst, src, n);
         }
         else
         {
-            // enable flag, leave rest untouched
-            flags ^= kMemoryChanged;
+            copyFromShared(dst, src, n);
         }
-        return flags;
     }
 
-    void write(std::string_view string) const
+    void runChunks() noexcept
     {
-        const auto memory = static_cast<char*>(_memory.data());
-
-        if (string.size() > std::numeric_limits<std::uint32_t>::max())
+        const Job job = _job;
+        for (;;)
         {
-            throw std::runtime_error("String payload exceeds maximum shared memory size.");
+            const std::size_t begin = _nextChunk.fetch_add(1, std::memory_order_relaxed) * job.chunkSize;
+            if (begin >= job.size)
+            {
+                return;
+            }
+            copyChunk(job.dst + begin, job.src + begin, std::min(job.chunkSize, job.size - begin), job.direction);
         }
+    }
 
-        lockForWrite(memory);
-
-        // 1) copy change flag into buffer for change detection
-        const char flags = getWriteFlags(kMemoryTypeString, memory[0]);
-        std::memcpy(&memory[0], &flags, flagSize);
-
-        // 2) copy buffer size into buffer (meta data for deserializing)
-        const char *stringData = string.data();
-        const auto bufferSize = static_cast<std::uint32_t>(string.size());
-
-        // write data
-        std::memcpy(&memory[sizeOffset], &bufferSize, bufferSizeSize);
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // start from generation 0, not the current one, so a job submitted
+        // before this thread first took the lock is not missed
+        std::uint64_t seen = 0;
+        for (;;)
+        {
+            _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+            if (_stop)
+            {
+                return;
+            }
+            seen = _generation;
 
-        // 3) copy stringData into memory buffer
-        std::memcpy(&memory[dataOffset], stringData, bufferSize);
+            lock.unlock();
+            runChunks();
+            lock.lock();
 
-        incrementRevision(memory);
-        unlockForWrite(memory);
+            if (--_busyWorkers == 0)
+            {
+                _done.notify_one();
+            }
+        }
     }
 
-    void write(std::span<const float> data) const
-    {
-        writeNumericArray(data, kMemoryTypeFloat);
-    }
+    std::size_t _minChunkSize;
+    std::vector<std::thread> _threads;
+    std::mutex _submitMutex;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    Job _job;
+    std::atomic<std::size_t> _nextChunk{0};
+    std::size_t _busyWorkers = 0;
+    std::uint64_t _generation = 0;
+    bool _stop = false;
+};
 
-    void write(const float* data, const std::size_t length) const
+// copy through the pool when one is attached, otherwise on the calling thread
+inline void copyToShared(void* dst, const void* src, const std::size_t n, CopyThreadPool* pool)
+{
+    if (pool)
     {
-        write(std::span<const float>(data, length));
+        pool->copy(dst, src, n, CopyDirection::ToShared);
+        return;
     }
+    copyToShared(dst, src, n);
+}
 
-    void write(std::span<const double> data) const
+inline void copyFromShared(void* dst, const void* src, const std::size_t n, CopyThreadPool* pool)
+{
+    if (pool)
     {
-        writeNumericArray(data, kMemoryTypeDouble);
+        pool->copy(dst, src, n, CopyDirection::FromShared);
+        return;
     }
+    copyFromShared(dst, src, n);
+}
 
-    void write(const double* data, const std::size_t length) const
-    {
-        write(std::span<const double>(data, length));
-    }
+// replaces the contents of out with n bytes copied out of a shared mapping
+inline void assignFromShared(std::string& out, const char* src, const std::size_t n, CopyThreadPool* pool = nullptr)
+{
+#if defined(__cpp_lib_string_resize_and_overwrite)
+    out.resize_and_overwrite(n, [src, pool](char* buffer, const std::size_t length) {
+        copyFromShared(buffer, src, length, pool);
+        return length;
+    });
+#else
+    out.resize(n);
+    copyFromShared(out.data(), src, n, pool);
+#endif
+}
 
-    void destroy() const
-    {
-        _memory.destroy();
-    }
+// Spin locks and in-segment statistics
+//
+// Every lock in a segment is a 32-bit word that is 0 when free and holds the
+// owner's process id while taken. The helpers
+// below are shared by the stream and queue locks and report how many failed
+// attempts an acquisition took, which feeds the optional statistics block.
+//
+// A statistics block gives each side (writer/reader, producer/consumer) its
+// own cache line so the sides never contend on their counters. Counters are
+// only updated while that side's lock is held, so a relaxed load/store pair
+// is enough; no locked read-modify-write is added to the hot path.
+
+namespace lsm_sync_detail
+{
+    inline std::atomic<std::uint32_t> cachedProcessId{0};
 
-private:
-    template <typename T>
-    requires std::is_floating_point_v<T>
-    void writeNumericArray(std::span<const T> data, const char typeFlag) const
+    // id of the calling process, stored in a lock word while the process holds
+    // it so inspection tools can name the holder; cached because getpid() is a
+    // system call, and reset in forked children
+    inline std::uint32_t lockOwnerId() noexcept
     {
-        const std::size_t length = data.size();
-
-        if (length > 0 && length > (std::numeric_limits<std::uint32_t>::max() / sizeof(T)))
+        std::uint32_t id = cachedProcessId.load(std::memory_order_relaxed);
+        if (id != 0)
         {
-            throw std::runtime_error("Numeric payload exceeds maximum shared memory size.");
+            return id;
         }
-
-        const auto memory = static_cast<char*>(_memory.data());
-
-        lockForWrite(memory);
-
-        const char flags = getWriteFlags(typeFlag, memory[0]);
-        std::memcpy(&memory[0], &flags, flagSize);
-
-        const auto bufferSize = static_cast<std::uint32_t>(length * sizeof(T));
-        std::memcpy(&memory[sizeOffset], &bufferSize, bufferSizeSize);
-        std::memcpy(&memory[dataOffset], data.data(), bufferSize);
-
-        incrementRevision(memory);
-        unlockForWrite(memory);
+#if defined(_WIN32)
+        id = static_cast<std::uint32_t>(GetCurrentProcessId());
+#else
+        static const bool atforkRegistered = [] {
+            pthread_atfork(nullptr, nullptr, [] { cachedProcessId.store(0, std::memory_order_relaxed); });
+            return true;
+        }();
+        (void)atforkRegistered;
+        id = static_cast<std::uint32_t>(getpid());
+#endif
+        cachedProcessId.store(id, std::memory_order_relaxed);
+        return id;
     }
 
-    static void lockForWrite(char* memory) noexcept
+    // spins (yielding) until the lock flips from 0 to the caller's process id;
+    // returns the number of failed attempts
+    inline std::uint64_t acquireSpinLock(std::atomic<std::uint32_t>& lock) noexcept
     {
-        auto& lock = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[lockOffset]);
+        LSM_PROBE1(lock_wait, &lock);
+        const std::uint32_t owner = lockOwnerId();
+        std::uint64_t spins = 0;
         std::uint32_t expected = 0;
-        while (!lock.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+        while (!lock.compare_exchange_weak(expected, owner, std::memory_order_acquire, std::memory_order_relaxed))
         {
             expected = 0;
+            ++spins;
             std::this_thread::yield();
         }
+        LSM_PROBE2(lock_acquire, &lock, spins);
+        return spins;
     }
 
-    static void unlockForWrite(char* memory) noexcept
+    inline void releaseSpinLock(std::atomic<std::uint32_t>& lock) noexcept
     {
-        auto& lock = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[lockOffset]);
+        LSM_PROBE1(lock_release, &lock);
         lock.store(0, std::memory_order_release);
     }
 
-    static void incrementRevision(char* memory) noexcept
+    // single-writer counter update; callers hold the lock that owns the counter
+    inline void addRelaxed(std::atomic<std::uint64_t>& counter, const std::uint64_t amount) noexcept
     {
-        auto& revision = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[revisionOffset]);
-        revision.fetch_add(1, std::memory_order_release);
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
     }
+} // namespace lsm_sync_detail
 
-    [[nodiscard]] std::atomic<std::uint32_t>& atomicUInt32(const std::size_t offset) const noexcept
-    {
-        auto memory = static_cast<char*>(_memory.data());
-        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[offset]);
-    }
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "statistics need lock-free 64-bit atomics");
 
-    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
-    {
-        const auto memory = static_cast<const char*>(_memory.data());
-        std::uint32_t value = 0;
-        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
-        return value;
-    }
+inline constexpr std::size_t kStatsAlignment = 64;
 
-    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
-    {
-        auto memory = static_cast<char*>(_memory.data());
-        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
-    }
+struct alignas(kStatsAlignment) StreamStatsSide
+{
+    std::atomic<std::uint64_t> operations{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> lockAcquisitions{0};
+    std::atomic<std::uint64_t> lockSpins{0};
+};
 
-    Memory _memory;
+// in-segment layout of the stream statistics area
+struct StreamStatsBlock
+{
+    StreamStatsSide writer;
+    StreamStatsSide reader;
+};
+
+struct alignas(kStatsAlignment) QueueProducerStats
+{
+    std::atomic<std::uint64_t> enqueues{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> fullRejections{0};
+    std::atomic<std::uint64_t> highWaterMark{0};
+    std::atomic<std::uint64_t> lockAcquisitions{0};
+    std::atomic<std::uint64_t> lockSpins{0};
+};
+
+struct alignas(kStatsAlignment) QueueConsumerStats
+{
+    std::atomic<std::uint64_t> dequeues{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> emptyRejections{0};
+    std::atomic<std::uint64_t> lockAcquisitions{0};
+    std::atomic<std::uint64_t> lockSpins{0};
+};
+
+// in-segment layout of the queue statistics area
+struct QueueStatsBlock
+{
+    QueueProducerStats producer;
+    QueueConsumerStats consumer;
+};
+
+// positions of a QueueOptions::overwrite queue, in slots since it was created;
+// they stand in for readIndex and count, so a producer evicts with a CAS on
+// head instead of taking the consumer lock
+struct QueueOverwriteBlock
+{
+    std::atomic<std::uint64_t> dropped{0};                       // messages evicted unread
+    alignas(kStatsAlignment) std::atomic<std::uint64_t> head{0}; // oldest queued slot
+    alignas(kStatsAlignment) std::atomic<std::uint64_t> tail{0}; // slot after the newest published one
 };
 
 /**
- * @brief Queue structure for shared memory
- * Layout: [writeIndex(4)][readIndex(4)][capacity(4)][count(4)][maxMessageSize(4)][producerLock(4)][consumerLock(4)][messages...]
+ * @brief Snapshot of a stream's statistics block
+ * Reads (readString, readFloatArray, readDoubleArray, readChangedRanges)
+ * from every reader process are summed.
  */
-class SharedMemoryQueue
+struct StreamStatistics
 {
-private:
-    static constexpr std::size_t kWriteIndexOffset = 0;
-    static constexpr std::size_t kReadIndexOffset = 4;
-    static constexpr std::size_t kCapacityOffset = 8;
-    static constexpr std::size_t kCountOffset = 12;
-    static constexpr std::size_t kMaxMessageSizeOffset = 16;
-    static constexpr std::size_t kProducerLockOffset = 20;
-    static constexpr std::size_t kConsumerLockOffset = 24;
-    static constexpr std::size_t kHeaderSize = 28;
+    std::uint64_t writes = 0;
+    std::uint64_t bytesWritten = 0;
+    std::uint64_t writerLockAcquisitions = 0;
+    std::uint64_t writerLockSpins = 0;
+    std::uint64_t reads = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t readerLockAcquisitions = 0;
+    std::uint64_t readerLockSpins = 0;
+};
 
-    Memory _memory;
-    std::uint32_t _capacity;
-    std::uint32_t _maxMessageSize;
-    bool _isWriter;
+[[nodiscard]] inline StreamStatistics snapshotStatistics(const StreamStatsBlock& block) noexcept
+{
+    StreamStatistics stats;
+    stats.writes = block.writer.operations.load(std::memory_order_relaxed);
+    stats.bytesWritten = block.writer.bytes.load(std::memory_order_relaxed);
+    stats.writerLockAcquisitions = block.writer.lockAcquisitions.load(std::memory_order_relaxed);
+    stats.writerLockSpins = block.writer.lockSpins.load(std::memory_order_relaxed);
+    stats.reads = block.reader.operations.load(std::memory_order_relaxed);
+    stats.bytesRead = block.reader.bytes.load(std::memory_order_relaxed);
+    stats.readerLockAcquisitions = block.reader.lockAcquisitions.load(std::memory_order_relaxed);
+    stats.readerLockSpins = block.reader.lockSpins.load(std::memory_order_relaxed);
+    return stats;
+}
 
-    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
+/**
+ * @brief Snapshot of a queue's statistics block
+ * highWaterMark is the largest message count the queue has held.
+ */
+struct QueueStatistics
+{
+    std::uint64_t enqueues = 0;
+    std::uint64_t bytesEnqueued = 0;
+    std::uint64_t fullRejections = 0;
+    std::uint64_t highWaterMark = 0;
+    std::uint64_t producerLockAcquisitions = 0;
+    std::uint64_t producerLockSpins = 0;
+    std::uint64_t dequeues = 0;
+    std::uint64_t bytesDequeued = 0;
+    std::uint64_t emptyRejections = 0;
+    std::uint64_t consumerLockAcquisitions = 0;
+    std::uint64_t consumerLockSpins = 0;
+};
+
+[[nodiscard]] inline QueueStatistics snapshotStatistics(const QueueStatsBlock& block) noexcept
+{
+    QueueStatistics stats;
+    stats.enqueues = block.producer.enqueues.load(std::memory_order_relaxed);
+    stats.bytesEnqueued = block.producer.bytes.load(std::memory_order_relaxed);
+    stats.fullRejections = block.producer.fullRejections.load(std::memory_order_relaxed);
+    stats.highWaterMark = block.producer.highWaterMark.load(std::memory_order_relaxed);
+    stats.producerLockAcquisitions = block.producer.lockAcquisitions.load(std::memory_order_relaxed);
+    stats.producerLockSpins = block.producer.lockSpins.load(std::memory_order_relaxed);
+    stats.dequeues = block.consumer.dequeues.load(std::memory_order_relaxed);
+    stats.bytesDequeued = block.consumer.bytes.load(std::memory_order_relaxed);
+    stats.emptyRejections = block.consumer.emptyRejections.load(std::memory_order_relaxed);
+    stats.consumerLockAcquisitions = block.consumer.lockAcquisitions.load(std::memory_order_relaxed);
+    stats.consumerLockSpins = block.consumer.lockSpins.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Latency histograms
+//
+// Durations measured in one process and recorded into a histogram that lives
+// in shared memory, so every participant adds to, and can read, the same
+// distribution. Timestamps come from std::chrono::steady_clock, which is
+// system-wide (CLOCK_MONOTONIC, QueryPerformanceCounter) and therefore
+// comparable across processes. Buckets are powers of two of nanoseconds.
+
+// bucket 0 counts 0 ns, bucket i counts [2^(i-1), 2^i) ns; the last bucket is open-ended
+inline constexpr std::size_t kLatencyHistogramBuckets = 40;
+
+struct alignas(kStatsAlignment) LatencyHistogramBlock
+{
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> totalNs{0};
+    std::atomic<std::uint64_t> maxNs{0};
+    std::array<std::atomic<std::uint64_t>, kLatencyHistogramBuckets> buckets{};
+};
+
+/**
+ * @brief Process-local copy of a LatencyHistogramBlock
+ */
+struct LatencyDistribution
+{
+    std::uint64_t count = 0;
+    std::uint64_t totalNs = 0;
+    std::uint64_t maxNs = 0;
+    std::array<std::uint64_t, kLatencyHistogramBuckets> buckets{};
+
+    [[nodiscard]] double meanNs() const noexcept
     {
-        const auto memory = static_cast<const char*>(_memory.data());
-        std::uint32_t value = 0;
-        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
-        return value;
+        return count ? static_cast<double>(totalNs) / static_cast<double>(count) : 0.0;
     }
 
-    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
+    // upper bound of the bucket holding the q-quantile (0 <= q <= 1), capped at maxNs
+    [[nodiscard]] std::uint64_t percentileNs(const double q) const noexcept
+    {
+        std::uint64_t total = 0;
+        for (const std::uint64_t bucket : buckets)
+        {
+            total += bucket;
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kLatencyHistogramBuckets; ++i)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+                const std::uint64_t upper = i == 0 ? 0 : (std::uint64_t{1} << i) - 1;
+                return std::min(upper, maxNs);
+            }
+        }
+        return maxNs;
+    }
+};
+
+namespace lsm_sync_detail
+{
+    [[nodiscard]] inline std::uint64_t steadyNanoseconds() noexcept
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // atomic read-modify-writes, so a concurrent clearHistogram() is never undone
+    inline void recordLatency(LatencyHistogramBlock& histogram, const std::uint64_t ns) noexcept
+    {
+        const std::size_t bucket = std::min<std::size_t>(std::bit_width(ns), kLatencyHistogramBuckets - 1);
+        histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        histogram.count.fetch_add(1, std::memory_order_relaxed);
+        histogram.totalNs.fetch_add(ns, std::memory_order_relaxed);
+        std::uint64_t max = histogram.maxNs.load(std::memory_order_relaxed);
+        while (ns > max && !histogram.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    inline void clearHistogram(LatencyHistogramBlock& histogram) noexcept
+    {
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.totalNs.store(0, std::memory_order_relaxed);
+        histogram.maxNs.store(0, std::memory_order_relaxed);
+        for (std::atomic<std::uint64_t>& bucket : histogram.buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+} // namespace lsm_sync_detail
+
+[[nodiscard]] inline LatencyDistribution snapshotHistogram(const LatencyHistogramBlock& histogram) noexcept
+{
+    LatencyDistribution result;
+    result.count = histogram.count.load(std::memory_order_relaxed);
+    result.totalNs = histogram.totalNs.load(std::memory_order_relaxed);
+    result.maxNs = histogram.maxNs.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < kLatencyHistogramBuckets; ++i)
+    {
+        result.buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+// Lock profiling
+//
+// An opt-in side segment, "<name>_lockprof", holding wait-time and hold-time
+// histograms for each lock of a stream (one lock) or queue (producer and
+// consumer). Every process that calls enableLockProfiling() on the same
+// segment records into the same histograms.
+
+inline constexpr std::size_t kMaxProfiledLocks = 2;
+
+// in-segment layout of a lock profile side segment
+struct LockProfileBlock
+{
+    struct Lock
+    {
+        LatencyHistogramBlock wait;
+        LatencyHistogramBlock hold;
+    };
+    std::array<Lock, kMaxProfiledLocks> locks;
+};
+
+struct LockProfile
+{
+    LatencyDistribution wait; // from the first acquisition attempt until the lock was taken
+    LatencyDistribution hold; // from taking the lock until releasing it
+};
+
+struct QueueLockProfile
+{
+    LockProfile producer;
+    LockProfile consumer;
+};
+
+/**
+ * @brief Records into, reads and resets a "<name>_lockprof" side segment
+ * Streams and queues own one after enableLockProfiling(); tools can also
+ * construct one directly to read or reset a running pipeline's profile.
+ * The side segment is persistent; destroy() on the stream writer or queue
+ * removes it along with the main segment.
+ */
+class LockProfiler
+{
+public:
+    explicit LockProfiler(const std::string& name):
+        _memory(segmentName(name), sizeof(LockProfileBlock), true)
+    {
+        // create() would replace a profile others are recording into. A new
+        // segment is zero-filled, which already is an empty profile; other
+        // attachers may record into it before this constructor returns, so
+        // the block is never constructed over it.
+        [[maybe_unused]] bool created = false;
+        if (_memory.openOrCreate(created) != Error::OK)
+        {
+            throw std::runtime_error("Lock profile segment could not be created.");
+        }
+        _block = static_cast<LockProfileBlock*>(_memory.data());
+    }
+
+    [[nodiscard]] static std::string segmentName(const std::string& name)
+    {
+        return name + "_lockprof";
+    }
+
+    [[nodiscard]] static std::uint64_t now() noexcept
+    {
+        return lsm_sync_detail::steadyNanoseconds();
+    }
+
+    // call right after taking lock; waitStart is now() from before the first attempt
+    void acquired(const std::size_t lock, const std::uint64_t waitStart) noexcept
+    {
+        const std::uint64_t time = now();
+        lsm_sync_detail::recordLatency(_block->locks[lock].wait, time - waitStart);
+        _heldSince[lock] = time;
+    }
+
+    // call right before releasing lock
+    void releasing(const std::size_t lock) noexcept
+    {
+        lsm_sync_detail::recordLatency(_block->locks[lock].hold, now() - _heldSince[lock]);
+    }
+
+    [[nodiscard]] LockProfile snapshot(const std::size_t lock) const noexcept
+    {
+        return {snapshotHistogram(_block->locks[lock].wait), snapshotHistogram(_block->locks[lock].hold)};
+    }
+
+    // zeroes every histogram; acquisitions in flight may still land afterwards
+    void reset() noexcept
+    {
+        for (LockProfileBlock::Lock& lock : _block->locks)
+        {
+            lsm_sync_detail::clearHistogram(lock.wait);
+            lsm_sync_detail::clearHistogram(lock.hold);
+        }
+    }
+
+    // removes the side segment of stream or queue name, if there is one
+    static void destroy(const std::string& name)
+    {
+        const Memory memory{segmentName(name), sizeof(LockProfileBlock), true};
+        memory.destroy();
+    }
+
+private:
+    Memory _memory;
+    LockProfileBlock* _block = nullptr;
+    // written and read only by the current holder of the matching lock
+    std::array<std::uint64_t, kMaxProfiledLocks> _heldSince{};
+};
+
+// Channel registry
+//
+// Thousands of small channels each costing a descriptor and a mapping per
+// process add up; a registry carves streams and queues out of one arena
+// segment instead. Its directory maps channel names to regions by FNV-1a hash
+// with linear probing, so attaching to a channel is a lookup in memory that is
+// already mapped:
+// |segment header(16)|lock(4)|directoryCapacity(4)|count(4)|pad(4)|next(8)|pad(24)|directory|channels...|
+// Regions are bump-allocated on 64-byte boundaries and never freed; channels
+// are found lock-free, while registration serializes on the registry lock.
+
+/**
+ * @brief Arena segment holding many named stream and queue channels
+ * Pass it to the registry constructors of SharedMemoryWriteStream,
+ * SharedMemoryReadStream and SharedMemoryQueue. Channels keep the arena
+ * mapped, so they may outlive the registry object they were attached through.
+ */
+class SharedMemoryRegistry
+{
+public:
+    static constexpr std::size_t kMaxChannelNameLength = 100;
+
+    /**
+     * @brief Creates the arena, replacing any registry of the same name
+     * @param size bytes for the header, directory and all channels
+     * @param directoryCapacity most channels the registry will hold, rounded
+     *        up to a power of two; lookups stay short below about half full
+     */
+    SharedMemoryRegistry(const std::string& name, const std::size_t size, const std::uint32_t directoryCapacity,
+                         const bool isPersistent):
+        _name(name),
+        _memory(std::make_shared<Memory>(name, size, isPersistent))
+    {
+        if (directoryCapacity == 0 || directoryCapacity > kMaxDirectoryCapacity)
+        {
+            throw std::runtime_error("Registry directory capacity must be between 1 and 2^24.");
+        }
+        _directoryCapacity = std::bit_ceil(directoryCapacity);
+        if (size < channelsOffset(_directoryCapacity))
+        {
+            throw std::runtime_error("Registry is too small for its directory.");
+        }
+        if (_memory->create() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory registry could not be created.");
+        }
+
+        // a new segment is zero-filled, so the directory starts out empty
+        auto memory = static_cast<char*>(_memory->data());
+        new (&memory[kLockOffset]) std::atomic<std::uint32_t>(0);
+        std::memcpy(&memory[kDirectoryCapacityOffset], &_directoryCapacity, sizeof(_directoryCapacity));
+        new (&memory[kCountOffset]) std::atomic<std::uint32_t>(0);
+        new (&memory[kNextOffset]) std::atomic<std::uint64_t>(channelsOffset(_directoryCapacity));
+        _size = size;
+        writeSegmentHeader(*_memory, SegmentType::Registry);
+    }
+
+    /**
+     * @brief Opens an existing registry
+     */
+    SharedMemoryRegistry(const std::string& name, const bool isPersistent):
+        _name(name),
+        _memory(std::make_shared<Memory>(name, 0, isPersistent))
+    {
+        if (_memory->open() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory registry could not be opened.");
+        }
+        _size = checkSegmentHeader(*_memory, SegmentType::Registry, 0);
+        std::memcpy(&_directoryCapacity, &static_cast<const char*>(_memory->data())[kDirectoryCapacityOffset],
+                    sizeof(_directoryCapacity));
+        if (!std::has_single_bit(_directoryCapacity) || _size < channelsOffset(_directoryCapacity))
+        {
+            throw std::runtime_error("Shared memory registry has a corrupt header.");
+        }
+    }
+
+    /**
+     * @brief Region of channel, registering it first if it is new
+     * Used by the writing side of a channel. Throws if channel exists with a
+     * different size, or if the directory or the arena is full.
+     */
+    [[nodiscard]] Memory allocate(const std::string& channel, const std::size_t size)
+    {
+        checkName(channel);
+        if (size == 0)
+        {
+            throw std::runtime_error("Channel size must not be zero.");
+        }
+
+        const char* error = nullptr;
+        std::uint64_t offset = 0;
+        std::atomic<std::uint32_t>& lock = atomicAt<std::uint32_t>(kLockOffset);
+        lsm_sync_detail::acquireSpinLock(lock);
+        if (const Entry* existing = find(channel))
+        {
+            offset = existing->offset.load(std::memory_order_relaxed);
+            if (existing->size != size)
+            {
+                error = "Channel is already registered with a different size.";
+            }
+        }
+        else
+        {
+            std::atomic<std::uint64_t>& next = atomicAt<std::uint64_t>(kNextOffset);
+            offset = next.load(std::memory_order_relaxed);
+            Entry* entry = freeEntry(hashName(channel));
+            if (!entry)
+            {
+                error = "Registry directory is full.";
+            }
+            else if (size > _size || offset > _size - size)
+            {
+                error = "Registry has no room left for the channel.";
+            }
+            else
+            {
+                entry->size = size;
+                entry->hash = hashName(channel);
+                entry->nameLength = static_cast<std::uint32_t>(channel.size());
+                std::memcpy(entry->name, channel.data(), channel.size());
+                entry->offset.store(offset, std::memory_order_release); // publishes the entry
+                next.store((offset + size + kChannelAlignment - 1) & ~(kChannelAlignment - 1), std::memory_order_relaxed);
+                atomicAt<std::uint32_t>(kCountOffset).fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        lsm_sync_detail::releaseSpinLock(lock);
+
+        if (error)
+        {
+            throw std::runtime_error(error);
+        }
+        return Memory{_memory, channel, static_cast<std::size_t>(offset), size};
+    }
+
+    /**
+     * @brief Region of a registered channel, used by the reading side
+     */
+    [[nodiscard]] Memory attach(const std::string& channel) const
+    {
+        const Entry* entry = find(channel);
+        if (!entry)
+        {
+            throw std::runtime_error("Channel is not registered.");
+        }
+        return Memory{_memory, channel, static_cast<std::size_t>(entry->offset.load(std::memory_order_relaxed)),
+                      static_cast<std::size_t>(entry->size)};
+    }
+
+    [[nodiscard]] bool contains(const std::string& channel) const noexcept
+    {
+        return find(channel) != nullptr;
+    }
+
+    // names of all registered channels, in directory order
+    [[nodiscard]] std::vector<std::string> channels() const
+    {
+        std::vector<std::string> names;
+        for (std::uint32_t i = 0; i < _directoryCapacity; ++i)
+        {
+            const Entry& entry = directory()[i];
+            if (entry.offset.load(std::memory_order_acquire) != 0)
+            {
+                names.emplace_back(entry.name, entry.nameLength);
+            }
+        }
+        return names;
+    }
+
+    [[nodiscard]] std::uint32_t channelCount() const noexcept
+    {
+        return atomicAt<std::uint32_t>(kCountOffset).load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::uint32_t directoryCapacity() const noexcept
+    {
+        return _directoryCapacity;
+    }
+
+    // arena bytes taken by the header, directory and channels so far
+    [[nodiscard]] std::size_t bytesUsed() const noexcept
+    {
+        return static_cast<std::size_t>(
+            std::min<std::uint64_t>(atomicAt<std::uint64_t>(kNextOffset).load(std::memory_order_relaxed), _size));
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] const std::string& name() const noexcept
+    {
+        return _name;
+    }
+
+    // drops this handle's reference; the arena stays mapped while channels use it
+    void close()
+    {
+        _memory.reset();
+    }
+
+    void destroy() const
+    {
+        const Memory memory{_name, 0, true};
+        memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kLockOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kDirectoryCapacityOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kCountOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kNextOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kHeaderSize = 64;
+    static constexpr std::size_t kChannelAlignment = 64;
+    static constexpr std::uint32_t kMaxDirectoryCapacity = 1u << 24;
+
+    // one directory slot; free while offset is 0, which no channel can have
+    struct Entry
+    {
+        std::atomic<std::uint64_t> offset; // stored last, with release, when the entry is filled in
+        std::uint64_t size;
+        std::uint64_t hash;
+        std::uint32_t nameLength;
+        char name[kMaxChannelNameLength];
+    };
+    static_assert(sizeof(Entry) == 128, "registry entries are two cache lines");
+
+    [[nodiscard]] static std::size_t channelsOffset(const std::uint32_t directoryCapacity) noexcept
+    {
+        return kHeaderSize + directoryCapacity * sizeof(Entry);
+    }
+
+    // 64-bit FNV-1a
+    [[nodiscard]] static std::uint64_t hashName(const std::string_view name) noexcept
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (const char c : name)
+        {
+            hash ^= static_cast<std::uint8_t>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static void checkName(const std::string& channel)
+    {
+        if (channel.empty() || channel.size() > kMaxChannelNameLength)
+        {
+            throw std::runtime_error("Channel names must be 1 to 100 bytes long.");
+        }
+    }
+
+    template <typename T>
+    [[nodiscard]] std::atomic<T>& atomicAt(const std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<T>*>(&static_cast<char*>(_memory->data())[offset]);
+    }
+
+    [[nodiscard]] Entry* directory() const noexcept
+    {
+        return reinterpret_cast<Entry*>(&static_cast<char*>(_memory->data())[kHeaderSize]);
+    }
+
+    // entries are never removed, so probing stops at the first free slot
+    [[nodiscard]] const Entry* find(const std::string_view channel) const noexcept
+    {
+        const std::uint64_t hash = hashName(channel);
+        const std::uint32_t mask = _directoryCapacity - 1;
+        for (std::uint32_t i = 0; i < _directoryCapacity; ++i)
+        {
+            const Entry& entry = directory()[(hash + i) & mask];
+            if (entry.offset.load(std::memory_order_acquire) == 0)
+            {
+                return nullptr;
+            }
+            if (entry.hash == hash && entry.nameLength == channel.size()
+                && std::memcmp(entry.name, channel.data(), channel.size()) == 0)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // caller holds the registry lock
+    [[nodiscard]] Entry* freeEntry(const std::uint64_t hash) const noexcept
+    {
+        const std::uint32_t mask = _directoryCapacity - 1;
+        for (std::uint32_t i = 0; i < _directoryCapacity; ++i)
+        {
+            Entry& entry = directory()[(hash + i) & mask];
+            if (entry.offset.load(std::memory_order_relaxed) == 0)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string _name;
+    std::shared_ptr<Memory> _memory;
+    std::uint32_t _directoryCapacity = 0;
+    std::size_t _size = 0; // as recorded in the segment header
+};
+
+// Shared allocator
+//
+// Hands out blocks of a segment by offset, so an object built in place by
+// one process can be passed to another as (offset, size) and used there
+// through its own mapping. Requests are rounded up to power-of-two size
+// classes from 64 bytes; each class keeps a lock-free free list (a Treiber
+// stack whose head carries an ABA tag next to the block index) that is
+// refilled 64 KiB slab at a time from a shared bump pointer. Blocks of a slab
+// or larger are carved individually. Freed blocks return to their class list
+// and are never coalesced.
+// |segment header(16)|heapStart(8)|next(8)|root(8)|pad(24)|free list heads, one per cache line|heap...|
+
+/**
+ * @brief A block of a SharedAllocator: offset from the segment start and usable size
+ * Offset 0 is never handed out, so a default block means "no block".
+ */
+struct SharedBlock
+{
+    std::uint64_t offset = 0;
+    std::size_t size = 0;
+
+    explicit operator bool() const noexcept
+    {
+        return offset != 0;
+    }
+};
+
+class SharedAllocator
+{
+public:
+    static constexpr std::size_t kMinBlockSize = 64;
+    static constexpr std::size_t kSlabSize = std::size_t{64} << 10;
+
+    /**
+     * @brief Creates an allocator segment of size bytes, replacing any of the same name
+     */
+    SharedAllocator(const std::string& name, const std::size_t size, const bool isPersistent):
+        _memory(name, size, isPersistent)
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens an existing allocator segment
+     */
+    SharedAllocator(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent)
+    {
+        attach();
+    }
+
+    /**
+     * @brief Creates an allocator channel in a registry, or takes over the existing one
+     */
+    SharedAllocator(SharedMemoryRegistry& registry, const std::string& channel, const std::size_t size):
+        _memory(registry.allocate(channel, size))
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens an allocator channel of a registry
+     */
+    SharedAllocator(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel))
+    {
+        attach();
+    }
+
+    /**
+     * @brief Allocates at least bytes, aligned to 64 bytes
+     * @return the block, or an empty block if bytes is 0 or the segment is exhausted
+     */
+    [[nodiscard]] SharedBlock allocate(const std::size_t bytes) noexcept
+    {
+        if (bytes == 0 || bytes > maxAllocation())
+        {
+            return {};
+        }
+        const std::size_t sizeClass = classOf(bytes);
+        const std::size_t blockSize = kMinBlockSize << sizeClass;
+        std::uint64_t offset = pop(sizeClass);
+        if (offset == 0)
+        {
+            offset = refill(sizeClass);
+        }
+        if (offset == 0)
+        {
+            return {};
+        }
+        return {offset, blockSize};
+    }
+
+    // block must come from allocate() on this segment and not be used afterwards
+    void deallocate(const SharedBlock& block) noexcept
+    {
+        if (block)
+        {
+            push(classOf(block.size), block.offset, block.offset);
+        }
+    }
+
+    /**
+     * @brief Allocates and constructs a T in the segment
+     * Throws when the segment is exhausted.
+     */
+    template <typename T, typename... Args>
+    [[nodiscard]] T* construct(Args&&... args)
+    {
+        static_assert(alignof(T) <= kMinBlockSize, "shared allocator blocks are 64-byte aligned");
+        const SharedBlock block = allocate(sizeof(T));
+        if (!block)
+        {
+            throw std::runtime_error("Shared allocator is out of memory.");
+        }
+        return new (data(block)) T(std::forward<Args>(args)...);
+    }
+
+    // destroys and frees an object from construct(), releasing what a shared container owns first
+    template <typename T>
+    void dispose(T* object)
+    {
+        if (object)
+        {
+            if constexpr (requires { object->release(*this); })
+            {
+                object->release(*this);
+            }
+            object->~T();
+            deallocate({offsetOf(object), sizeof(T)});
+        }
+    }
+
+    // publishes the offset of an object for other processes to find, see root()
+    void setRoot(const std::uint64_t offset) noexcept
+    {
+        rootOffset().store(offset, std::memory_order_release);
+    }
+
+    // the last offset passed to setRoot(), 0 if none
+    [[nodiscard]] std::uint64_t root() const noexcept
+    {
+        return rootOffset().load(std::memory_order_acquire);
+    }
+
+    template <typename T>
+    [[nodiscard]] T* root() const noexcept
+    {
+        const std::uint64_t offset = root();
+        return offset ? pointer<T>(offset) : nullptr;
+    }
+
+    // the block's memory in this process
+    [[nodiscard]] void* data(const std::uint64_t offset) const noexcept
+    {
+        return &static_cast<char*>(_memory.data())[offset];
+    }
+
+    [[nodiscard]] void* data(const SharedBlock& block) const noexcept
+    {
+        return data(block.offset);
+    }
+
+    template <typename T>
+    [[nodiscard]] T* pointer(const std::uint64_t offset) const noexcept
+    {
+        return static_cast<T*>(data(offset));
+    }
+
+    // offset of a pointer into this process's mapping of the segment
+    [[nodiscard]] std::uint64_t offsetOf(const void* pointer) const noexcept
+    {
+        return static_cast<std::uint64_t>(static_cast<const char*>(pointer) - static_cast<const char*>(_memory.data()));
+    }
+
+    // largest request allocate() can serve, even on an empty segment
+    [[nodiscard]] std::size_t maxAllocation() const noexcept
+    {
+        return std::min(std::bit_floor(_size - _heapStart), kMinBlockSize << (kClassCount - 1));
+    }
+
+    // heap bytes carved into slabs or large blocks so far, whether or not they are in use
+    [[nodiscard]] std::size_t bytesReserved() const noexcept
+    {
+        return static_cast<std::size_t>(next().load(std::memory_order_relaxed) - _heapStart);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    void close()
+    {
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kClassCount = 26; // 64 B up to 2 GiB
+    static constexpr std::size_t kHeapStartOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kNextOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kRootOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kFreeListOffset = 64;
+    static constexpr std::size_t kFreeListStride = 64; // one head per cache line
+    static constexpr std::size_t kHeaderSize = kFreeListOffset + kClassCount * kFreeListStride;
+    // free list heads hold the block index (offset / kMinBlockSize) in the
+    // low 32 bits, so a segment may span up to 256 GiB
+    static constexpr std::uint64_t kMaxSegmentSize = std::uint64_t{kMinBlockSize} << 32;
+
+    void initialize()
+    {
+        _size = _memory.size();
+        if (_size < kHeaderSize + kSlabSize || _size > kMaxSegmentSize)
+        {
+            throw std::runtime_error("Shared allocator size must be between one slab past the header and 256 GiB.");
+        }
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared allocator segment could not be created.");
+        }
+        _heapStart = kHeaderSize;
+        auto memory = static_cast<char*>(_memory.data());
+        const std::uint64_t heapStart = _heapStart;
+        std::memcpy(&memory[kHeapStartOffset], &heapStart, sizeof(heapStart));
+        new (&memory[kNextOffset]) std::atomic<std::uint64_t>(heapStart);
+        new (&memory[kRootOffset]) std::atomic<std::uint64_t>(0);
+        for (std::size_t i = 0; i < kClassCount; ++i)
+        {
+            new (&memory[kFreeListOffset + i * kFreeListStride]) std::atomic<std::uint64_t>(0);
+        }
+        writeSegmentHeader(_memory, SegmentType::Allocator);
+    }
+
+    void attach()
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared allocator segment could not be opened.");
+        }
+        _size = checkSegmentHeader(_memory, SegmentType::Allocator, 0);
+        std::uint64_t heapStart = 0;
+        std::memcpy(&heapStart, &static_cast<const char*>(_memory.data())[kHeapStartOffset], sizeof(heapStart));
+        if (heapStart != kHeaderSize || _size < heapStart)
+        {
+            throw std::runtime_error("Shared allocator segment has a corrupt header.");
+        }
+        _heapStart = static_cast<std::size_t>(heapStart);
+    }
+
+    [[nodiscard]] static std::size_t classOf(const std::size_t bytes) noexcept
+    {
+        return static_cast<std::size_t>(std::bit_width((std::max(bytes, kMinBlockSize) - 1) / kMinBlockSize));
+    }
+
+    [[nodiscard]] std::atomic<std::uint64_t>& next() const noexcept
+    {
+        return *reinterpret_cast<std::atomic<std::uint64_t>*>(&static_cast<char*>(_memory.data())[kNextOffset]);
+    }
+
+    [[nodiscard]] std::atomic<std::uint64_t>& rootOffset() const noexcept
+    {
+        return *reinterpret_cast<std::atomic<std::uint64_t>*>(&static_cast<char*>(_memory.data())[kRootOffset]);
+    }
+
+    [[nodiscard]] std::atomic<std::uint64_t>& head(const std::size_t sizeClass) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<std::uint64_t>*>(
+            &static_cast<char*>(_memory.data())[kFreeListOffset + sizeClass * kFreeListStride]);
+    }
+
+    // link word in the first bytes of a free block: index of the next free block, 0 at the end
+    [[nodiscard]] std::atomic<std::uint64_t>& link(const std::uint64_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<std::uint64_t>*>(&static_cast<char*>(_memory.data())[offset]);
+    }
+
+    // pushes the chain first..last, already linked through link(), onto a class list
+    void push(const std::size_t sizeClass, const std::uint64_t first, const std::uint64_t last) noexcept
+    {
+        std::atomic<std::uint64_t>& top = head(sizeClass);
+        std::uint64_t old = top.load(std::memory_order_relaxed);
+        std::uint64_t desired = 0;
+        do
+        {
+            link(last).store(old & 0xFFFFFFFFu, std::memory_order_relaxed);
+            desired = (((old >> 32) + 1) << 32) | (first / kMinBlockSize);
+        } while (!top.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    [[nodiscard]] std::uint64_t pop(const std::size_t sizeClass) noexcept
+    {
+        std::atomic<std::uint64_t>& top = head(sizeClass);
+        std::uint64_t old = top.load(std::memory_order_acquire);
+        while ((old & 0xFFFFFFFFu) != 0)
+        {
+            const std::uint64_t offset = (old & 0xFFFFFFFFu) * kMinBlockSize;
+            // may read a block another process just popped and reused; the tag makes the CAS fail then
+            const std::uint64_t following = link(offset).load(std::memory_order_relaxed);
+            const std::uint64_t desired = (((old >> 32) + 1) << 32) | (following & 0xFFFFFFFFu);
+            if (top.compare_exchange_weak(old, desired, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return offset;
+            }
+        }
+        return 0;
+    }
+
+    // bytes from the bump pointer, or 0 if they do not fit
+    [[nodiscard]] std::uint64_t carve(const std::size_t bytes) noexcept
+    {
+        std::uint64_t current = next().load(std::memory_order_relaxed);
+        do
+        {
+            if (bytes > _size - current)
+            {
+                return 0;
+            }
+        } while (!next().compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+        return current;
+    }
+
+    // takes a new slab for the class, returns its first block and frees the rest
+    [[nodiscard]] std::uint64_t refill(const std::size_t sizeClass) noexcept
+    {
+        const std::size_t blockSize = kMinBlockSize << sizeClass;
+        const std::uint64_t slab = blockSize < kSlabSize ? carve(kSlabSize) : 0;
+        if (slab == 0)
+        {
+            // large blocks, and whatever is left once no whole slab fits
+            return carve(blockSize);
+        }
+
+        const std::uint64_t last = slab + kSlabSize - blockSize;
+        for (std::uint64_t block = slab + blockSize; block < last; block += blockSize)
+        {
+            link(block).store((block + blockSize) / kMinBlockSize, std::memory_order_relaxed);
+        }
+        push(sizeClass, slab + blockSize, last);
+        return slab;
+    }
+
+    Memory _memory;
+    std::size_t _size = 0; // as recorded in the segment header
+    std::size_t _heapStart = 0;
+};
+
+// Shared containers
+//
+// Each process maps a segment at its own address, so data structures in a
+// segment link their parts with OffsetPtr, which stores the distance from
+// itself to its target instead of an address. SharedVector, SharedString
+// and SharedFlatMap built on it live in a SharedAllocator's segment (create
+// them with SharedAllocator::construct) and take the allocator on every call
+// that allocates or frees, since the container itself is shared and cannot
+// hold a process-local pointer. Reading needs no allocator, so other
+// processes traverse them in place. They are not synchronized: publish a
+// finished structure (for example with SharedAllocator::setRoot) or guard
+// mutation with the application's own protocol.
+
+/**
+ * @brief Self-relative pointer, valid in every mapping of the segment it lives in
+ * The target must be in the same segment. 0 encodes null, so an OffsetPtr
+ * cannot point at itself.
+ */
+template <typename T>
+class OffsetPtr
+{
+public:
+    OffsetPtr() noexcept = default;
+
+    OffsetPtr(std::nullptr_t) noexcept
+    {
+    }
+
+    OffsetPtr(T* pointer) noexcept
+    {
+        set(pointer);
+    }
+
+    // copies retarget: the distance depends on where the copy lives
+    OffsetPtr(const OffsetPtr& other) noexcept
+    {
+        set(other.get());
+    }
+
+    OffsetPtr& operator=(const OffsetPtr& other) noexcept
+    {
+        set(other.get());
+        return *this;
+    }
+
+    OffsetPtr& operator=(T* pointer) noexcept
+    {
+        set(pointer);
+        return *this;
+    }
+
+    [[nodiscard]] T* get() const noexcept
+    {
+        return _offset == 0 ? nullptr
+                            : reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(_offset));
+    }
+
+    T& operator*() const noexcept
+    {
+        return *get();
+    }
+
+    T* operator->() const noexcept
+    {
+        return get();
+    }
+
+    T& operator[](const std::size_t index) const noexcept
+    {
+        return get()[index];
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _offset != 0;
+    }
+
+    friend bool operator==(const OffsetPtr& a, const OffsetPtr& b) noexcept
+    {
+        return a.get() == b.get();
+    }
+
+private:
+    void set(T* pointer) noexcept
+    {
+        _offset = pointer ? static_cast<std::intptr_t>(reinterpret_cast<std::uintptr_t>(pointer)
+                                                       - reinterpret_cast<std::uintptr_t>(this))
+                          : 0;
+    }
+
+    std::intptr_t _offset = 0;
+};
+
+namespace lsm_container_detail
+{
+    // gives back what a shared container element owns, then destroys it
+    template <typename T>
+    void release(T& element, SharedAllocator& allocator)
+    {
+        if constexpr (requires { element.release(allocator); })
+        {
+            element.release(allocator);
+        }
+        element.~T();
+    }
+
+    // target = source, for plain values and for shared containers that allocate
+    template <typename T, typename Source>
+    void assign(T& target, const Source& source, SharedAllocator& allocator)
+    {
+        if constexpr (requires { target.assign(allocator, source); })
+        {
+            target.assign(allocator, source);
+        }
+        else
+        {
+            target = source;
+        }
+    }
+} // namespace lsm_container_detail
+
+/**
+ * @brief Growable array in a SharedAllocator segment
+ * Elements are relocated by move construction, so they may hold OffsetPtrs
+ * or other shared containers.
+ */
+template <typename T>
+class SharedVector
+{
+public:
+    static_assert(alignof(T) <= SharedAllocator::kMinBlockSize, "shared allocator blocks are 64-byte aligned");
+
+    SharedVector() noexcept = default;
+    SharedVector(const SharedVector&) = delete;
+    SharedVector& operator=(const SharedVector&) = delete;
+
+    // takes over other's storage; both must live in the same segment
+    SharedVector(SharedVector&& other) noexcept:
+        _data(other._data), _size(other._size), _capacity(other._capacity)
+    {
+        other._data = nullptr;
+        other._size = 0;
+        other._capacity = 0;
+    }
+
+    // exchanges storage, so nothing is lost without an allocator at hand;
+    // other ends up owning what this held and must still be released
+    SharedVector& operator=(SharedVector&& other) noexcept
+    {
+        OffsetPtr<T> data = _data;
+        _data = other._data;
+        other._data = data;
+        std::swap(_size, other._size);
+        std::swap(_capacity, other._capacity);
+        return *this;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    [[nodiscard]] std::size_t capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    [[nodiscard]] T* data() const noexcept
+    {
+        return _data.get();
+    }
+
+    [[nodiscard]] T* begin() const noexcept
+    {
+        return data();
+    }
+
+    [[nodiscard]] T* end() const noexcept
+    {
+        return data() + _size;
+    }
+
+    T& operator[](const std::size_t index) const noexcept
+    {
+        return data()[index];
+    }
+
+    [[nodiscard]] T& at(const std::size_t index) const
+    {
+        if (index >= _size)
+        {
+            throw std::out_of_range("SharedVector index out of range.");
+        }
+        return data()[index];
+    }
+
+    [[nodiscard]] T& back() const noexcept
+    {
+        return data()[_size - 1];
+    }
+
+    void reserve(SharedAllocator& allocator, const std::size_t capacity)
+    {
+        if (capacity <= _capacity)
+        {
+            return;
+        }
+        const SharedBlock block = allocator.allocate(capacity * sizeof(T));
+        if (!block)
+        {
+            throw std::runtime_error("Shared allocator is out of memory.");
+        }
+        T* storage = static_cast<T*>(allocator.data(block));
+        for (std::size_t i = 0; i < _size; ++i)
+        {
+            new (&storage[i]) T(std::move(data()[i]));
+            data()[i].~T();
+        }
+        freeStorage(allocator);
+        _data = storage;
+        _capacity = block.size / sizeof(T); // the size class may leave room for more
+    }
+
+    template <typename... Args>
+    T& emplaceBack(SharedAllocator& allocator, Args&&... args)
+    {
+        grow(allocator);
+        T* element = new (&data()[_size]) T(std::forward<Args>(args)...);
+        ++_size;
+        return *element;
+    }
+
+    void pushBack(SharedAllocator& allocator, const T& value)
+    {
+        emplaceBack(allocator, value);
+    }
+
+    // inserts before index, shifting the tail up by one
+    template <typename... Args>
+    T& emplace(SharedAllocator& allocator, const std::size_t index, Args&&... args)
+    {
+        if (index > _size)
+        {
+            throw std::out_of_range("SharedVector index out of range.");
+        }
+        grow(allocator);
+        T* elements = data();
+        if (index == _size)
+        {
+            new (&elements[_size]) T(std::forward<Args>(args)...);
+        }
+        else
+        {
+            new (&elements[_size]) T(std::move(elements[_size - 1]));
+            std::move_backward(&elements[index], &elements[_size - 1], &elements[_size]);
+            elements[index].~T();
+            new (&elements[index]) T(std::forward<Args>(args)...);
+        }
+        ++_size;
+        return elements[index];
+    }
+
+    void erase(SharedAllocator& allocator, const std::size_t index)
+    {
+        if (index >= _size)
+        {
+            throw std::out_of_range("SharedVector index out of range.");
+        }
+        T* elements = data();
+        lsm_container_detail::release(elements[index], allocator);
+        if (index + 1 < _size)
+        {
+            new (&elements[index]) T(std::move(elements[index + 1]));
+            std::move(&elements[index + 2], &elements[_size], &elements[index + 1]);
+            elements[_size - 1].~T();
+        }
+        --_size;
+    }
+
+    void popBack(SharedAllocator& allocator)
+    {
+        lsm_container_detail::release(back(), allocator);
+        --_size;
+    }
+
+    void clear(SharedAllocator& allocator)
+    {
+        while (_size > 0)
+        {
+            popBack(allocator);
+        }
+    }
+
+    // clears and frees the storage; call before disposing of the vector
+    void release(SharedAllocator& allocator)
+    {
+        clear(allocator);
+        freeStorage(allocator);
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+private:
+    void grow(SharedAllocator& allocator)
+    {
+        if (_size == _capacity)
+        {
+            reserve(allocator, std::max<std::size_t>(_capacity * 2, 4));
+        }
+    }
+
+    void freeStorage(SharedAllocator& allocator) noexcept
+    {
+        if (_data)
+        {
+            allocator.deallocate({allocator.offsetOf(data()), _capacity * sizeof(T)});
+        }
+    }
+
+    OffsetPtr<T> _data;
+    std::size_t _size = 0;
+    std::size_t _capacity = 0;
+};
+
+/**
+ * @brief Byte string in a SharedAllocator segment, kept NUL-terminated
+ */
+class SharedString
+{
+public:
+    SharedString() noexcept = default;
+    SharedString(SharedString&&) noexcept = default;
+    SharedString& operator=(SharedString&&) noexcept = default;
+
+    [[nodiscard]] std::string_view view() const noexcept
+    {
+        return _chars.empty() ? std::string_view{} : std::string_view{_chars.data(), _chars.size() - 1};
+    }
+
+    [[nodiscard]] std::string str() const
+    {
+        return std::string{view()};
+    }
+
+    [[nodiscard]] const char* cStr() const noexcept
+    {
+        return _chars.empty() ? "" : _chars.data();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return view().size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return view().empty();
+    }
+
+    void assign(SharedAllocator& allocator, const std::string_view text)
+    {
+        _chars.clear(allocator);
+        append(allocator, text);
+    }
+
+    void append(SharedAllocator& allocator, const std::string_view text)
+    {
+        if (!_chars.empty())
+        {
+            _chars.popBack(allocator); // the terminator
+        }
+        _chars.reserve(allocator, _chars.size() + text.size() + 1);
+        for (const char c : text)
+        {
+            _chars.pushBack(allocator, c);
+        }
+        _chars.pushBack(allocator, '\0');
+    }
+
+    void clear(SharedAllocator& allocator)
+    {
+        _chars.clear(allocator);
+    }
+
+    void release(SharedAllocator& allocator)
+    {
+        _chars.release(allocator);
+    }
+
+    friend bool operator==(const SharedString& a, const std::string_view b) noexcept
+    {
+        return a.view() == b;
+    }
+
+    friend auto operator<=>(const SharedString& a, const std::string_view b) noexcept
+    {
+        return a.view() <=> b;
+    }
+
+    friend bool operator==(const SharedString& a, const SharedString& b) noexcept
+    {
+        return a.view() == b.view();
+    }
+
+    friend auto operator<=>(const SharedString& a, const SharedString& b) noexcept
+    {
+        return a.view() <=> b.view();
+    }
+
+private:
+    SharedVector<char> _chars;
+};
+
+/**
+ * @brief Sorted array map in a SharedAllocator segment
+ * Lookups are binary searches over contiguous entries; keys and values may
+ * be SharedStrings, set from a std::string_view.
+ */
+template <typename Key, typename Value>
+class SharedFlatMap
+{
+public:
+    struct Entry
+    {
+        Key key;
+        Value value;
+    };
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return _entries.size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _entries.empty();
+    }
+
+    [[nodiscard]] Entry* begin() const noexcept
+    {
+        return _entries.begin();
+    }
+
+    [[nodiscard]] Entry* end() const noexcept
+    {
+        return _entries.end();
+    }
+
+    // the value stored under key, or nullptr
+    template <typename K>
+    [[nodiscard]] Value* find(const K& key) const noexcept
+    {
+        Entry* entry = lowerBound(key);
+        return entry != end() && !(key < entry->key) ? &entry->value : nullptr;
+    }
+
+    template <typename K>
+    [[nodiscard]] bool contains(const K& key) const noexcept
+    {
+        return find(key) != nullptr;
+    }
+
+    // sets the value of key, inserting the entry in order if it is new
+    template <typename K, typename V>
+    Value& insertOrAssign(SharedAllocator& allocator, const K& key, const V& value)
+    {
+        Entry* entry = lowerBound(key);
+        if (entry == end() || key < entry->key)
+        {
+            const auto index = static_cast<std::size_t>(entry - begin());
+            entry = &_entries.emplace(allocator, index);
+            lsm_container_detail::assign(entry->key, key, allocator);
+        }
+        lsm_container_detail::assign(entry->value, value, allocator);
+        return entry->value;
+    }
+
+    template <typename K>
+    bool erase(SharedAllocator& allocator, const K& key)
+    {
+        Entry* entry = lowerBound(key);
+        if (entry == end() || key < entry->key)
+        {
+            return false;
+        }
+        _entries.erase(allocator, static_cast<std::size_t>(entry - begin()));
+        return true;
+    }
+
+    void clear(SharedAllocator& allocator)
+    {
+        _entries.clear(allocator);
+    }
+
+    void release(SharedAllocator& allocator)
+    {
+        _entries.release(allocator);
+    }
+
+private:
+    template <typename K>
+    [[nodiscard]] Entry* lowerBound(const K& key) const noexcept
+    {
+        return std::lower_bound(begin(), end(), key, [](const Entry& entry, const K& k) { return entry.key < k; });
+    }
+
+    SharedVector<Entry> _entries;
+};
+
+// Buffer pool
+//
+// Fixed-size buffers in one segment, each with an atomic reference count,
+// for payloads too large to copy through queue slots. A producer fills a
+// buffer in place and sends a BufferDescriptor through a SharedMemoryQueue
+// created with sizeof(BufferDescriptor) messages. Every consumer that holds a
+// reference releases it when done, and the last release returns the buffer
+// to the pool's lock-free free list (a tagged Treiber stack of buffer ids).
+// |segment header(16)|bufferCount(4)|available(4)|bufferSize(8)|freeHead(8)|pad(24)|slots, one per cache line|buffers...|
+
+/**
+ * @brief Names a byte range of a SharedBufferPool buffer; what a descriptor queue carries
+ */
+struct BufferDescriptor
+{
+    std::uint32_t buffer = 0;
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+};
+
+static_assert(sizeof(BufferDescriptor) == 12, "descriptors are sent as raw queue messages");
+
+class SharedBufferPool
+{
+public:
+    /**
+     * @brief Creates a pool of bufferCount buffers of bufferSize bytes, replacing any of the same name
+     */
+    SharedBufferPool(const std::string& name, const std::uint32_t bufferCount, const std::uint32_t bufferSize,
+                     const bool isPersistent):
+        _memory(name, segmentSize(bufferCount, bufferSize), isPersistent),
+        _bufferCount(bufferCount),
+        _bufferSize(bufferSize)
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens an existing pool
+     */
+    SharedBufferPool(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent)
+    {
+        attach();
+    }
+
+    /**
+     * @brief Creates a pool channel in a registry, or takes over the existing one
+     */
+    SharedBufferPool(SharedMemoryRegistry& registry, const std::string& channel, const std::uint32_t bufferCount,
+                     const std::uint32_t bufferSize):
+        _memory(registry.allocate(channel, segmentSize(bufferCount, bufferSize))),
+        _bufferCount(bufferCount),
+        _bufferSize(bufferSize)
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens a pool channel of a registry
+     */
+    SharedBufferPool(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel))
+    {
+        attach();
+    }
+
+    /**
+     * @brief Takes a free buffer, holding one reference to it
+     * @return its id, or nothing if every buffer is in use
+     */
+    [[nodiscard]] std::optional<std::uint32_t> acquire() noexcept
+    {
+        std::atomic<std::uint64_t>& head = atomicAt<std::uint64_t>(kFreeHeadOffset);
+        std::uint64_t old = head.load(std::memory_order_acquire);
+        while ((old & 0xFFFFFFFFu) != 0)
+        {
+            const auto id = static_cast<std::uint32_t>((old & 0xFFFFFFFFu) - 1);
+            // the slot may already be taken again by another process; the tag makes the CAS fail then
+            const std::uint64_t following = slot(id).next.load(std::memory_order_relaxed);
+            const std::uint64_t desired = (((old >> 32) + 1) << 32) | following;
+            if (head.compare_exchange_weak(old, desired, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                slot(id).references.store(1, std::memory_order_relaxed);
+                atomicAt<std::uint32_t>(kAvailableOffset).fetch_sub(1, std::memory_order_relaxed);
+                return id;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Adds count references to a buffer in use, typically one per consumer it is sent to
+     */
+    void retain(const std::uint32_t id, const std::uint32_t count = 1)
+    {
+        std::atomic<std::uint32_t>& references = slot(checkId(id)).references;
+        std::uint32_t current = references.load(std::memory_order_relaxed);
+        do
+        {
+            if (current == 0)
+            {
+                throw std::runtime_error("Cannot retain a buffer that is not in use.");
+            }
+        } while (!references.compare_exchange_weak(current, current + count, std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Drops one reference; the last one returns the buffer to the pool
+     * @return true if the buffer was returned
+     */
+    bool release(const std::uint32_t id)
+    {
+        std::atomic<std::uint32_t>& references = slot(checkId(id)).references;
+        std::uint32_t current = references.load(std::memory_order_relaxed);
+        do
+        {
+            if (current == 0)
+            {
+                throw std::runtime_error("Buffer released more often than it was referenced.");
+            }
+        } while (!references.compare_exchange_weak(current, current - 1, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed));
+        if (current != 1)
+        {
+            return false;
+        }
+
+        std::atomic<std::uint64_t>& head = atomicAt<std::uint64_t>(kFreeHeadOffset);
+        std::uint64_t old = head.load(std::memory_order_relaxed);
+        std::uint64_t desired = 0;
+        do
+        {
+            slot(id).next.store(old & 0xFFFFFFFFu, std::memory_order_relaxed);
+            desired = (((old >> 32) + 1) << 32) | (id + 1);
+        } while (!head.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_relaxed));
+        atomicAt<std::uint32_t>(kAvailableOffset).fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    [[nodiscard]] std::uint32_t referenceCount(const std::uint32_t id) const
+    {
+        return slot(checkId(id)).references.load(std::memory_order_relaxed);
+    }
+
+    // the whole buffer in this process
+    [[nodiscard]] std::span<std::byte> buffer(const std::uint32_t id) const
+    {
+        return {&static_cast<std::byte*>(_memory.data())[bufferOffset(checkId(id))], _bufferSize};
+    }
+
+    // the range a descriptor names
+    [[nodiscard]] std::span<std::byte> payload(const BufferDescriptor& descriptor) const
+    {
+        if (descriptor.offset > _bufferSize || descriptor.length > _bufferSize - descriptor.offset)
+        {
+            throw std::runtime_error("Buffer descriptor exceeds its buffer.");
+        }
+        return buffer(descriptor.buffer).subspan(descriptor.offset, descriptor.length);
+    }
+
+    [[nodiscard]] std::uint32_t bufferCount() const noexcept
+    {
+        return _bufferCount;
+    }
+
+    [[nodiscard]] std::uint32_t bufferSize() const noexcept
+    {
+        return _bufferSize;
+    }
+
+    // buffers not in use right now
+    [[nodiscard]] std::uint32_t available() const noexcept
+    {
+        return atomicAt<std::uint32_t>(kAvailableOffset).load(std::memory_order_relaxed);
+    }
+
+    void close()
+    {
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kBufferCountOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kAvailableOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kBufferSizeOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kFreeHeadOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    // per-buffer state, on its own cache line so reference counting of
+    // neighbouring buffers does not contend
+    struct alignas(kStatsAlignment) Slot
+    {
+        std::atomic<std::uint32_t> references{0};
+        std::atomic<std::uint64_t> next{0}; // free list link: id + 1 of the next free buffer, 0 at the end
+    };
+
+    [[nodiscard]] static std::size_t stride(const std::uint32_t bufferSize) noexcept
+    {
+        return (static_cast<std::size_t>(bufferSize) + kStatsAlignment - 1) & ~(kStatsAlignment - 1);
+    }
+
+    [[nodiscard]] static std::size_t segmentSize(const std::uint32_t bufferCount, const std::uint32_t bufferSize)
+    {
+        if (bufferCount == 0 || bufferSize == 0)
+        {
+            throw std::runtime_error("Buffer pools need at least one buffer of at least one byte.");
+        }
+        return kHeaderSize + bufferCount * (sizeof(Slot) + stride(bufferSize));
+    }
+
+    [[nodiscard]] std::size_t bufferOffset(const std::uint32_t id) const noexcept
+    {
+        return kHeaderSize + _bufferCount * sizeof(Slot) + id * stride(_bufferSize);
+    }
+
+    [[nodiscard]] std::uint32_t checkId(const std::uint32_t id) const
+    {
+        if (id >= _bufferCount)
+        {
+            throw std::runtime_error("Buffer id is out of range.");
+        }
+        return id;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::atomic<T>& atomicAt(const std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<T>*>(&static_cast<char*>(_memory.data())[offset]);
+    }
+
+    [[nodiscard]] Slot& slot(const std::uint32_t id) const noexcept
+    {
+        return reinterpret_cast<Slot*>(&static_cast<char*>(_memory.data())[kHeaderSize])[id];
+    }
+
+    void initialize()
+    {
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared buffer pool could not be created.");
+        }
+        auto memory = static_cast<char*>(_memory.data());
+        const std::uint64_t bufferSize = _bufferSize;
+        std::memcpy(&memory[kBufferCountOffset], &_bufferCount, sizeof(_bufferCount));
+        std::memcpy(&memory[kBufferSizeOffset], &bufferSize, sizeof(bufferSize));
+        new (&memory[kAvailableOffset]) std::atomic<std::uint32_t>(_bufferCount);
+        // every buffer starts out free, linked in id order
+        for (std::uint32_t id = 0; id < _bufferCount; ++id)
+        {
+            new (&slot(id)) Slot();
+            slot(id).next.store(id + 1 < _bufferCount ? id + 2 : 0, std::memory_order_relaxed);
+        }
+        new (&memory[kFreeHeadOffset]) std::atomic<std::uint64_t>(1);
+        writeSegmentHeader(_memory, SegmentType::BufferPool);
+    }
+
+    void attach()
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared buffer pool could not be opened.");
+        }
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::BufferPool, 0);
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint64_t bufferSize = 0;
+        std::memcpy(&_bufferCount, &memory[kBufferCountOffset], sizeof(_bufferCount));
+        std::memcpy(&bufferSize, &memory[kBufferSizeOffset], sizeof(bufferSize));
+        if (bufferSize > std::numeric_limits<std::uint32_t>::max()
+            || size != segmentSize(_bufferCount, static_cast<std::uint32_t>(bufferSize)))
+        {
+            throw std::runtime_error("Shared buffer pool has a corrupt header.");
+        }
+        _bufferSize = static_cast<std::uint32_t>(bufferSize);
+    }
+
+    Memory _memory;
+    std::uint32_t _bufferCount = 0;
+    std::uint32_t _bufferSize = 0;
+};
+
+// Shared hash map
+//
+// A fixed-capacity, open-addressing (linear probing) table of trivially
+// copyable keys and values, for state that many processes look up and
+// update entry by entry instead of republishing as a whole. Each bucket is
+// its own seqlock: the sequence is 0 while the bucket is empty, 1 while a
+// writer claims it for a new key, and odd while its value is rewritten.
+// Keys never change once published, so a lookup only waits on a claim in
+// progress; values are read optimistically and re-read if the sequence moved.
+// Writers to different buckets never contend. Entries cannot be removed.
+// Keys are compared as bytes, like SharedHash hashes them: 0.0 and -0.0 are
+// different keys, a NaN key finds itself, and padding in a struct key must be
+// zeroed so equal keys have equal bytes.
+// |segment header(16)|capacity(8)|count(8)|keySize(4)|valueSize(4)|pad(24)|buckets...|
+
+/**
+ * @brief Process-independent hash of a SharedHashMap key
+ * std::hash may differ between builds linked into the processes sharing a
+ * map, so keys are hashed by value: integers through a 64-bit mixer, other
+ * keys as bytes with FNV-1a.
+ */
+template <typename Key>
+struct SharedHash
+{
+    [[nodiscard]] std::uint64_t operator()(const Key& key) const noexcept
+    {
+        if constexpr (std::is_integral_v<Key> || std::is_enum_v<Key>)
+        {
+            auto x = static_cast<std::uint64_t>(key);
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31);
+        }
+        else
+        {
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            const auto bytes = reinterpret_cast<const unsigned char*>(&key);
+            for (std::size_t i = 0; i < sizeof(Key); ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+    }
+};
+
+template <typename Key, typename Value, typename Hash = SharedHash<Key>>
+class SharedHashMap
+{
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "shared hash map entries are copied as bytes");
+
+public:
+    /**
+     * @brief Creates a map with room for capacity entries, replacing any of the same name
+     * The bucket count is capacity rounded up to a power of two.
+     */
+    SharedHashMap(const std::string& name, const std::size_t capacity, const bool isPersistent):
+        _memory(name, segmentSize(bucketCount(capacity)), isPersistent),
+        _mask(bucketCount(capacity) - 1)
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens an existing map
+     */
+    SharedHashMap(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent)
+    {
+        attach();
+    }
+
+    /**
+     * @brief Creates a map channel in a registry, or takes over the existing one
+     */
+    SharedHashMap(SharedMemoryRegistry& registry, const std::string& channel, const std::size_t capacity):
+        _memory(registry.allocate(channel, segmentSize(bucketCount(capacity)))),
+        _mask(bucketCount(capacity) - 1)
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens a map channel of a registry
+     */
+    SharedHashMap(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel))
+    {
+        attach();
+    }
+
+    /**
+     * @brief Inserts key or overwrites its value
+     * @return false if key is new and the map is full
+     */
+    bool store(const Key& key, const Value& value) noexcept
+    {
+        return update(key, [&value](Value& current) { current = value; });
+    }
+
+    /**
+     * @brief Applies fn(Value&) to the value of key under the bucket's seqlock
+     * A new key starts out with a value-initialized Value. Concurrent updates
+     * of the same key are serialized, so fn may read-modify-write. If fn
+     * throws, the bucket is released with whatever fn changed so far.
+     * @return false if key is new and the map is full
+     */
+    template <typename Fn>
+    bool update(const Key& key, Fn&& fn)
+    {
+        Bucket* bucket = claim(key);
+        if (bucket == nullptr)
+        {
+            return false;
+        }
+        std::uint64_t sequence = bucket->sequence.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if ((sequence & 1) == 0
+                && bucket->sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+                                                          std::memory_order_relaxed))
+            {
+                break;
+            }
+            std::this_thread::yield();
+            sequence = bucket->sequence.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release); // the odd sequence is visible before the value changes
+        try
+        {
+            fn(bucket->value);
+        }
+        catch (...)
+        {
+            // an odd sequence left behind would stall every reader and writer of the key
+            bucket->sequence.store(sequence + 2, std::memory_order_release);
+            throw;
+        }
+        bucket->sequence.store(sequence + 2, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Copies the value of key without blocking its writers
+     */
+    [[nodiscard]] std::optional<Value> find(const Key& key) const noexcept
+    {
+        const Bucket* bucket = lookup(key);
+        if (bucket == nullptr)
+        {
+            return std::nullopt;
+        }
+        Value value;
+        while (true)
+        {
+            const std::uint64_t before = bucket->sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                std::memcpy(&value, &bucket->value, sizeof(Value));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (bucket->sequence.load(std::memory_order_relaxed) == before)
+                {
+                    return value;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    [[nodiscard]] bool contains(const Key& key) const noexcept
+    {
+        return lookup(key) != nullptr;
+    }
+
+    // number of keys stored
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return atomicAt<std::uint64_t>(kCountOffset).load(std::memory_order_relaxed);
+    }
+
+    // number of buckets, the most keys the map can hold
+    [[nodiscard]] std::size_t capacity() const noexcept
+    {
+        return _mask + 1;
+    }
+
+    void close()
+    {
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kCapacityOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kCountOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kKeySizeOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kValueSizeOffset = segmentHeaderSize + 20;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    // sequence values with a meaning of their own; any other odd value is an update in progress
+    static constexpr std::uint64_t kEmpty = 0;
+    static constexpr std::uint64_t kClaimed = 1;
+
+    struct Bucket
+    {
+        std::atomic<std::uint64_t> sequence{kEmpty};
+        Key key;
+        Value value;
+    };
+
+    [[nodiscard]] static std::size_t bucketCount(const std::size_t capacity)
+    {
+        if (capacity == 0 || capacity > (std::size_t{1} << 40))
+        {
+            throw std::runtime_error("Shared hash map capacity must be between 1 and 2^40.");
+        }
+        return std::bit_ceil(capacity);
+    }
+
+    [[nodiscard]] static std::size_t segmentSize(const std::size_t buckets) noexcept
+    {
+        return kHeaderSize + buckets * sizeof(Bucket);
+    }
+
+    // by bytes, so keys that compare equal always hash alike
+    [[nodiscard]] static bool equal(const Key& a, const Key& b) noexcept
+    {
+        return std::memcmp(&a, &b, sizeof(Key)) == 0;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::atomic<T>& atomicAt(const std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<T>*>(&static_cast<char*>(_memory.data())[offset]);
+    }
+
+    [[nodiscard]] Bucket& bucket(const std::size_t index) const noexcept
+    {
+        return reinterpret_cast<Bucket*>(&static_cast<char*>(_memory.data())[kHeaderSize])[index];
+    }
+
+    // sequence of a bucket once its key is readable: waits out a claim in progress
+    [[nodiscard]] static std::uint64_t settledSequence(const Bucket& bucket) noexcept
+    {
+        std::uint64_t sequence = bucket.sequence.load(std::memory_order_acquire);
+        while (sequence == kClaimed)
+        {
+            std::this_thread::yield();
+            sequence = bucket.sequence.load(std::memory_order_acquire);
+        }
+        return sequence;
+    }
+
+    [[nodiscard]] Bucket* lookup(const Key& key) const noexcept
+    {
+        std::size_t index = Hash{}(key) & _mask;
+        for (std::size_t probes = 0; probes <= _mask; ++probes, index = (index + 1) & _mask)
+        {
+            Bucket& candidate = bucket(index);
+            const std::uint64_t sequence = settledSequence(candidate);
+            if (sequence == kEmpty)
+            {
+                return nullptr; // keys are never removed, so the probe sequence ends here
+            }
+            if (equal(candidate.key, key))
+            {
+                return &candidate;
+            }
+        }
+        return nullptr;
+    }
+
+    // the bucket holding key, taking the first empty one on its probe sequence if it is new
+    [[nodiscard]] Bucket* claim(const Key& key) noexcept
+    {
+        std::size_t index = Hash{}(key) & _mask;
+        for (std::size_t probes = 0; probes <= _mask; ++probes, index = (index + 1) & _mask)
+        {
+            Bucket& candidate = bucket(index);
+            std::uint64_t sequence = candidate.sequence.load(std::memory_order_acquire);
+            if (sequence == kEmpty
+                && candidate.sequence.compare_exchange_strong(sequence, kClaimed, std::memory_order_acquire,
+                                                              std::memory_order_acquire))
+            {
+                std::memcpy(&candidate.key, &key, sizeof(Key));
+                new (&candidate.value) Value();
+                atomicAt<std::uint64_t>(kCountOffset).fetch_add(1, std::memory_order_relaxed);
+                candidate.sequence.store(2, std::memory_order_release);
+                return &candidate;
+            }
+            // lost the race for the empty bucket, or it was taken already: its key decides
+            while (sequence == kClaimed)
+            {
+                std::this_thread::yield();
+                sequence = candidate.sequence.load(std::memory_order_acquire);
+            }
+            if (equal(candidate.key, key))
+            {
+                return &candidate;
+            }
+        }
+        return nullptr;
+    }
+
+    void initialize()
+    {
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared hash map could not be created.");
+        }
+        auto memory = static_cast<char*>(_memory.data());
+        const std::uint64_t capacity = _mask + 1;
+        const std::uint32_t keySize = sizeof(Key);
+        const std::uint32_t valueSize = sizeof(Value);
+        std::memcpy(&memory[kCapacityOffset], &capacity, sizeof(capacity));
+        std::memcpy(&memory[kKeySizeOffset], &keySize, sizeof(keySize));
+        std::memcpy(&memory[kValueSizeOffset], &valueSize, sizeof(valueSize));
+        new (&memory[kCountOffset]) std::atomic<std::uint64_t>(0);
+        // the mapping is zero-filled, which is what an empty bucket's sequence is
+        writeSegmentHeader(_memory, SegmentType::HashMap);
+    }
+
+    void attach()
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared hash map could not be opened.");
+        }
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::HashMap, 0);
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint64_t capacity = 0;
+        std::uint32_t keySize = 0;
+        std::uint32_t valueSize = 0;
+        std::memcpy(&capacity, &memory[kCapacityOffset], sizeof(capacity));
+        std::memcpy(&keySize, &memory[kKeySizeOffset], sizeof(keySize));
+        std::memcpy(&valueSize, &memory[kValueSizeOffset], sizeof(valueSize));
+        if (keySize != sizeof(Key) || valueSize != sizeof(Value))
+        {
+            throw std::runtime_error("Shared hash map holds keys or values of another size.");
+        }
+        if (!std::has_single_bit(capacity) || size != segmentSize(capacity))
+        {
+            throw std::runtime_error("Shared hash map has a corrupt header.");
+        }
+        _mask = capacity - 1;
+    }
+
+    Memory _memory;
+    std::size_t _mask = 0;
+};
+
+// Value table
+//
+// N fixed-size value slots indexed by an integer key, each holding the
+// latest value written for its key (the last price per instrument, say).
+// Every slot is its own seqlock on its own cache line, so writers of
+// different keys never contend and readers copy single slots or ranges
+// without taking anything. Each write also appends its key to a change ring:
+// a reader keeps a TableCursor and collects the keys written since its last
+// poll instead of comparing all N slots. A reader that falls more than the
+// ring's capacity behind is told so and rescans.
+// |segment header(16)|slotCount(4)|valueSize(4)|ringCapacity(4)|pad(4)|ringHead(8)|pad(24)|ring|slots...|
+// Ring entries are ((position + 1) << 32 | key), so a reader can tell an entry
+// of its lap from an older or a newer one, and a zeroed entry from either.
+
+/**
+ * @brief A reader's position in a SharedValueTable's change ring; process-local
+ */
+struct TableCursor
+{
+    std::uint64_t position = 0;
+};
+
+class SharedValueTable
+{
+public:
+    /**
+     * @brief Creates a table of slotCount slots of valueSize bytes, replacing any of the same name
+     * @param ringCapacity changes a reader may fall behind by before it has to rescan; rounded up to a power of two
+     */
+    SharedValueTable(const std::string& name, const std::uint32_t slotCount, const std::uint32_t valueSize,
+                     const std::uint32_t ringCapacity, const bool isPersistent):
+        _memory(name, segmentSize(slotCount, valueSize, ringSize(ringCapacity)), isPersistent),
+        _slotCount(slotCount),
+        _valueSize(valueSize),
+        _ringCapacity(ringSize(ringCapacity))
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens an existing table
+     */
+    SharedValueTable(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent)
+    {
+        attach();
+    }
+
+    /**
+     * @brief Creates a table channel in a registry, or takes over the existing one
+     */
+    SharedValueTable(SharedMemoryRegistry& registry, const std::string& channel, const std::uint32_t slotCount,
+                     const std::uint32_t valueSize, const std::uint32_t ringCapacity):
+        _memory(registry.allocate(channel, segmentSize(slotCount, valueSize, ringSize(ringCapacity)))),
+        _slotCount(slotCount),
+        _valueSize(valueSize),
+        _ringCapacity(ringSize(ringCapacity))
+    {
+        initialize();
+    }
+
+    /**
+     * @brief Opens a table channel of a registry
+     */
+    SharedValueTable(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel))
+    {
+        attach();
+    }
+
+    /**
+     * @brief Replaces the value of key and records the change; value must be valueSize() bytes
+     * Writers of the same key are serialized by its sequence counter.
+     */
+    void write(const std::uint32_t key, const std::span<const std::byte> value)
+    {
+        if (value.size() != _valueSize)
+        {
+            throw std::runtime_error("Value table values must be exactly valueSize() bytes.");
+        }
+        std::atomic<std::uint64_t>& sequence = slotSequence(checkKey(key));
+        std::uint64_t current = sequence.load(std::memory_order_relaxed);
+        while ((current & 1) != 0
+               || !sequence.compare_exchange_weak(current, current + 1, std::memory_order_acquire,
+                                                  std::memory_order_relaxed))
+        {
+            std::this_thread::yield();
+            current = sequence.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(slotValue(key), value.data(), _valueSize);
+        sequence.store(current + 2, std::memory_order_release);
+
+        // announce the key after the value is in place, so whoever sees the entry reads the new value
+        const std::uint64_t position = atomicAt<std::uint64_t>(kRingHeadOffset).fetch_add(1, std::memory_order_relaxed);
+        ringEntry(position).store((((position + 1) & 0xFFFFFFFFu) << 32) | key, std::memory_order_release);
+    }
+
+    template <typename T>
+    void write(const std::uint32_t key, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "table values are copied as bytes");
+        write(key, std::span<const std::byte>(reinterpret_cast<const std::byte*>(&value), sizeof(T)));
+    }
+
+    /**
+     * @brief Copies the value of key into out, which must be valueSize() bytes
+     * @return how many times key has been written; 0 means never, and out holds zeros
+     */
+    std::uint64_t read(const std::uint32_t key, const std::span<std::byte> out) const
+    {
+        if (out.size() != _valueSize)
+        {
+            throw std::runtime_error("Value table values must be exactly valueSize() bytes.");
+        }
+        const std::atomic<std::uint64_t>& sequence = slotSequence(checkKey(key));
+        while (true)
+        {
+            const std::uint64_t before = sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                std::memcpy(out.data(), slotValue(key), _valueSize);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence.load(std::memory_order_relaxed) == before)
+                {
+                    return before / 2;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    template <typename T>
+    [[nodiscard]] T read(const std::uint32_t key) const
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "table values are copied as bytes");
+        T value;
+        read(key, std::span<std::byte>(reinterpret_cast<std::byte*>(&value), sizeof(T)));
+        return value;
+    }
+
+    /**
+     * @brief Copies count consecutive values starting at key first into out
+     * Each value is consistent on its own; the range is not one snapshot.
+     */
+    void readRange(const std::uint32_t first, const std::uint32_t count, const std::span<std::byte> out) const
+    {
+        if (first > _slotCount || count > _slotCount - first)
+        {
+            throw std::runtime_error("Value table range is out of bounds.");
+        }
+        if (out.size() != static_cast<std::size_t>(count) * _valueSize)
+        {
+            throw std::runtime_error("Value table range needs count * valueSize() bytes.");
+        }
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            read(first + i, out.subspan(static_cast<std::size_t>(i) * _valueSize, _valueSize));
+        }
+    }
+
+    // how many times key has been written
+    [[nodiscard]] std::uint64_t version(const std::uint32_t key) const
+    {
+        return slotSequence(checkKey(key)).load(std::memory_order_acquire) / 2;
+    }
+
+    // a cursor that sees changes from now on
+    [[nodiscard]] TableCursor cursor() const noexcept
+    {
+        return {atomicAt<std::uint64_t>(kRingHeadOffset).load(std::memory_order_acquire)};
+    }
+
+    /**
+     * @brief Appends the keys written since the cursor's last poll to keys and advances the cursor
+     * A key written several times appears once per write. Writes still being
+     * announced are left for the next poll.
+     * @return false if the ring was overrun since the last poll; the cursor
+     * then moves to the present and the caller should reread every slot
+     */
+    bool changes(TableCursor& cursor, std::vector<std::uint32_t>& keys) const
+    {
+        const std::uint64_t head = atomicAt<std::uint64_t>(kRingHeadOffset).load(std::memory_order_acquire);
+        if (head - cursor.position > _ringCapacity)
+        {
+            cursor.position = head;
+            return false;
+        }
+        for (; cursor.position != head; ++cursor.position)
+        {
+            const std::uint64_t entry = ringEntry(cursor.position).load(std::memory_order_acquire);
+            const auto lap = static_cast<std::int32_t>(static_cast<std::uint32_t>(entry >> 32)
+                                                       - static_cast<std::uint32_t>(cursor.position + 1));
+            if (lap < 0)
+            {
+                break; // claimed but not announced yet
+            }
+            if (lap > 0)
+            {
+                cursor.position = atomicAt<std::uint64_t>(kRingHeadOffset).load(std::memory_order_acquire);
+                return false; // overwritten by a later lap while we were reading
+            }
+            keys.push_back(static_cast<std::uint32_t>(entry & 0xFFFFFFFFu));
+        }
+        return true;
+    }
+
+    [[nodiscard]] std::uint32_t slotCount() const noexcept
+    {
+        return _slotCount;
+    }
+
+    [[nodiscard]] std::uint32_t valueSize() const noexcept
+    {
+        return _valueSize;
+    }
+
+    [[nodiscard]] std::uint32_t ringCapacity() const noexcept
+    {
+        return _ringCapacity;
+    }
+
+    void close()
+    {
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kSlotCountOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kValueSizeOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kRingCapacityOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kRingHeadOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    [[nodiscard]] static std::uint32_t ringSize(const std::uint32_t ringCapacity)
+    {
+        if (ringCapacity == 0 || ringCapacity > (1u << 30))
+        {
+            throw std::runtime_error("Value table change rings hold 1 to 2^30 entries.");
+        }
+        return std::bit_ceil(ringCapacity);
+    }
+
+    // sequence(8) then the value, padded to whole cache lines
+    [[nodiscard]] static std::size_t stride(const std::uint32_t valueSize) noexcept
+    {
+        return (sizeof(std::uint64_t) + valueSize + kStatsAlignment - 1) & ~(kStatsAlignment - 1);
+    }
+
+    [[nodiscard]] static std::size_t slotsOffset(const std::uint32_t ringCapacity) noexcept
+    {
+        return kHeaderSize
+               + ((ringCapacity * sizeof(std::uint64_t) + kStatsAlignment - 1) & ~(kStatsAlignment - 1));
+    }
+
+    [[nodiscard]] static std::size_t segmentSize(const std::uint32_t slotCount, const std::uint32_t valueSize,
+                                                 const std::uint32_t ringCapacity)
+    {
+        if (slotCount == 0 || valueSize == 0)
+        {
+            throw std::runtime_error("Value tables need at least one slot of at least one byte.");
+        }
+        return slotsOffset(ringCapacity) + slotCount * stride(valueSize);
+    }
+
+    [[nodiscard]] std::uint32_t checkKey(const std::uint32_t key) const
+    {
+        if (key >= _slotCount)
+        {
+            throw std::runtime_error("Value table key is out of range.");
+        }
+        return key;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::atomic<T>& atomicAt(const std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<T>*>(&static_cast<char*>(_memory.data())[offset]);
+    }
+
+    [[nodiscard]] std::atomic<std::uint64_t>& ringEntry(const std::uint64_t position) const noexcept
+    {
+        return atomicAt<std::uint64_t>(kHeaderSize + (position & (_ringCapacity - 1)) * sizeof(std::uint64_t));
+    }
+
+    [[nodiscard]] std::size_t slotOffset(const std::uint32_t key) const noexcept
+    {
+        return slotsOffset(_ringCapacity) + key * stride(_valueSize);
+    }
+
+    [[nodiscard]] std::atomic<std::uint64_t>& slotSequence(const std::uint32_t key) const noexcept
+    {
+        return atomicAt<std::uint64_t>(slotOffset(key));
+    }
+
+    [[nodiscard]] char* slotValue(const std::uint32_t key) const noexcept
+    {
+        return &static_cast<char*>(_memory.data())[slotOffset(key) + sizeof(std::uint64_t)];
+    }
+
+    void initialize()
+    {
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared value table could not be created.");
+        }
+        auto memory = static_cast<char*>(_memory.data());
+        std::memcpy(&memory[kSlotCountOffset], &_slotCount, sizeof(_slotCount));
+        std::memcpy(&memory[kValueSizeOffset], &_valueSize, sizeof(_valueSize));
+        std::memcpy(&memory[kRingCapacityOffset], &_ringCapacity, sizeof(_ringCapacity));
+        new (&memory[kRingHeadOffset]) std::atomic<std::uint64_t>(0);
+        for (std::uint32_t i = 0; i < _ringCapacity; ++i)
+        {
+            new (&ringEntry(i)) std::atomic<std::uint64_t>(0);
+        }
+        for (std::uint32_t key = 0; key < _slotCount; ++key)
+        {
+            new (&slotSequence(key)) std::atomic<std::uint64_t>(0);
+        }
+        writeSegmentHeader(_memory, SegmentType::ValueTable);
+    }
+
+    void attach()
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared value table could not be opened.");
+        }
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::ValueTable, 0);
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::memcpy(&_slotCount, &memory[kSlotCountOffset], sizeof(_slotCount));
+        std::memcpy(&_valueSize, &memory[kValueSizeOffset], sizeof(_valueSize));
+        std::memcpy(&_ringCapacity, &memory[kRingCapacityOffset], sizeof(_ringCapacity));
+        if (!std::has_single_bit(_ringCapacity) || size != segmentSize(_slotCount, _valueSize, _ringCapacity))
+        {
+            throw std::runtime_error("Shared value table has a corrupt header.");
+        }
+    }
+
+    Memory _memory;
+    std::uint32_t _slotCount = 0;
+    std::uint32_t _valueSize = 0;
+    std::uint32_t _ringCapacity = 0;
+};
+
+/**
+ * @brief Creation-time options of a SharedMemoryWriteStream
+ * Readers pick these up from the segment metadata, so they only need to be
+ * passed on the writing side.
+ */
+struct StreamOptions
+{
+    // Granularity of dirty-block tracking in bytes (power of two, >= 64).
+    // When set, every write stamps the blocks it touched with its revision so
+    // readers can copy only what changed via readChangedRanges(). 0 disables.
+    std::size_t dirtyBlockSize = 0;
+
+    // Reserve a StreamStatsBlock at the end of the segment and count writes,
+    // reads, bytes and lock activity in it; see statistics().
+    bool statistics = false;
+};
+
+/**
+ * @brief Byte range of the payload that changed since a reader last synced
+ */
+struct ChangedRange
+{
+    std::size_t offset = 0;
+    std::size_t size = 0;
+};
+
+/**
+ * @brief Derived placement of the stream payload and its optional trailer
+ * Layout: [metadata(dataOffset)][data(dataCapacity)][dirty stamps(4 * dirtyBlockCount)][stats]
+ * The dirty stamp table and the statistics block are carved out of the end
+ * of the segment so the metadata header keeps its size.
+ */
+struct StreamLayout
+{
+    std::size_t dataCapacity = 0;
+    std::uint8_t dirtyShift = 0;
+    std::size_t dirtyTableOffset = 0;
+    std::size_t dirtyBlockCount = 0;
+    std::size_t statsOffset = 0; // 0 when the segment has no statistics block
+};
+
+[[nodiscard]] inline StreamLayout computeStreamLayout(const std::size_t segmentSize, const std::uint8_t dirtyShift,
+                                                      const std::uint8_t features = 0) noexcept
+{
+    StreamLayout layout;
+    std::size_t end = segmentSize;
+    if (features & kStreamFeatureStatistics)
+    {
+        if (segmentSize < dataOffset + sizeof(StreamStatsBlock) + kStatsAlignment)
+        {
+            return layout;
+        }
+        end = (segmentSize - sizeof(StreamStatsBlock)) & ~(kStatsAlignment - 1);
+        layout.statsOffset = end;
+    }
+
+    if (end <= dataOffset)
+    {
+        return layout;
+    }
+
+    const std::size_t available = end - dataOffset;
+    if (dirtyShift == 0)
+    {
+        layout.dataCapacity = available;
+        return layout;
+    }
+
+    // every block costs its own size plus one stamp; round up so the last
+    // (partial) block is covered as well
+    const std::size_t blockSize = std::size_t{1} << dirtyShift;
+    const std::size_t blockCount = (available + blockSize + dirtyStampSize - 1) / (blockSize + dirtyStampSize);
+    const std::size_t tableOffset = (end - blockCount * dirtyStampSize) & ~(dirtyStampSize - 1);
+
+    layout.dirtyShift = dirtyShift;
+    layout.dirtyBlockCount = blockCount;
+    layout.dirtyTableOffset = tableOffset;
+    layout.dataCapacity = tableOffset > dataOffset ? tableOffset - dataOffset : 0;
+    return layout;
+}
+
+class SharedMemoryReadStream
+{
+public:
+    /**
+     * @brief Opens a stream, checking that it was created with bufferSize
+     */
+    SharedMemoryReadStream(const std::string& name, const std::size_t bufferSize, const bool isPersistent):
+        _memory(name, bufferSize, isPersistent)
+    {
+        attach(bufferSize);
+    }
+
+    /**
+     * @brief Opens a stream of whatever size its writer created
+     */
+    SharedMemoryReadStream(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent)
+    {
+        attach(0);
+    }
+
+    /**
+     * @brief Opens a stream channel of a registry
+     */
+    SharedMemoryReadStream(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel))
+    {
+        attach(0);
+    }
+
+    // size of the segment as created by the writer
+    [[nodiscard]] std::size_t bufferSize() const noexcept
+    {
+        return _segmentSize;
+    }
+
+    [[nodiscard]] char readFlags() const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        return memory[flagsOffset];
+    }
+
+    [[nodiscard]] bool hasNewData() const noexcept
+    {
+        return readRevision() != _lastSeenRevision;
+    }
+
+    void markAsRead() const noexcept
+    {
+        const std::uint32_t revision = readRevision();
+        writeAck(revision);
+        _lastSeenRevision = revision;
+    }
+
+    void close()
+    {
+        _memory.close();
+        _stats = nullptr;
+        _lockProfiler.reset();
+    }
+
+    /**
+     * @brief Splits payload copies of at least pool->minChunkSize() * 2 bytes across a thread pool
+     * Pass the same pool to several streams to share it, or nullptr to copy
+     * on the calling thread again.
+     */
+    void setCopyThreadPool(std::shared_ptr<CopyThreadPool> pool) noexcept
+    {
+        _copyPool = std::move(pool);
+    }
+
+    // convenience for a pool owned by this stream alone
+    void enableParallelCopy(const unsigned workers, const std::size_t minChunkSize = std::size_t{1} << 20)
+    {
+        _copyPool = std::make_shared<CopyThreadPool>(workers, minChunkSize);
+    }
+
+    /**
+     * @brief Records lock wait and hold times in the "<name>_lockprof" side segment
+     * Costs two steady_clock reads per acquisition; see LockProfiler.
+     */
+    void enableLockProfiling()
+    {
+        if (!_lockProfiler)
+        {
+            _lockProfiler = std::make_unique<LockProfiler>(_memory.name());
+        }
+    }
+
+    // wait/hold histograms of the stream lock, or nothing if profiling is off
+    [[nodiscard]] std::optional<LockProfile> lockProfile() const noexcept
+    {
+        if (!_lockProfiler)
+        {
+            return std::nullopt;
+        }
+        return _lockProfiler->snapshot(0);
+    }
+
+    void resetLockProfile() noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->reset();
+        }
+    }
+
+    // counters of the segment, or nothing if the writer did not enable StreamOptions::statistics
+    [[nodiscard]] std::optional<StreamStatistics> statistics() const noexcept
+    {
+        if (!_stats)
+        {
+            return std::nullopt;
+        }
+        return snapshotStatistics(*_stats);
+    }
+
+    [[nodiscard]] size_t readSize(const char /*dataType*/) const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint32_t storedSize = 0;
+        std::memcpy(&storedSize, &memory[sizeOffset], bufferSizeSize);
+        return static_cast<std::size_t>(storedSize);
+    }
+
+    [[nodiscard]] size_t readLength(const char dataType) const noexcept
+    {
+        const size_t size = readSize(dataType);
+
+        if (dataType & kMemoryTypeString)
+        {
+            return size / sizeOfOneChar;
+        }
+
+        if (dataType & kMemoryTypeFloat)
+        {
+            return size / sizeOfOneFloat;
+        }
+
+        if (dataType & kMemoryTypeDouble)
+        {
+            return size / sizeOfOneDouble;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Returns a doible* read from shared memory
+     * Caller has the obligation to call delete [] on the returning float*.
+     *
+     * @return float*
+     */
+    [[nodiscard]] double* readDoubleArray() const
+    {
+        return readNumericArray<double>(kMemoryTypeDouble, sizeOfOneDouble);
+    }
+
+    /**
+     * @brief Returns a float* read from shared memory
+     * Caller has the obligation to call delete [] on the returning float*.
+     *
+     * @return float*
+     */
+    [[nodiscard]] float* readFloatArray() const
+    {
+        return readNumericArray<float>(kMemoryTypeFloat, sizeOfOneFloat);
+    }
+
+    [[nodiscard]] std::string readString() const
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        lockForRead();
+        const std::size_t size = readSize(kMemoryTypeString);
+        std::string data;
+        assignFromShared(data, &memory[dataOffset], size, _copyPool.get());
+        countRead(size);
+        LSM_PROBE3(stream_read, _memory.path().c_str(), readRevision(), size);
+        unlockRead();
+        return data;
+    }
+
+    /**
+     * @brief Brings a caller-owned copy of the payload up to date
+     * Copies only the blocks stamped with a revision newer than the one this
+     * reader last synced to. The first call, and every call on a segment
+     * without dirty tracking, copies the whole payload.
+     *
+     * @param mirror Local copy of the payload; must be the same object on every call
+     * @return the byte ranges that were copied into mirror
+     */
+    std::vector<ChangedRange> readChangedRanges(std::string& mirror) const
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::vector<ChangedRange> ranges;
+
+        lockForRead();
+
+        const std::uint32_t revision = readRevision();
+        const std::size_t size = readSize(kMemoryTypeString);
+
+        // a revision behind the synced one means the writer was recreated
+        const bool fullCopy = !_hasSynced || _layout.dirtyShift == 0
+            || static_cast<std::int32_t>(revision - _syncedRevision) < 0;
+
+        if (fullCopy)
+        {
+            if (!_hasSynced || revision != _syncedRevision)
+            {
+                assignFromShared(mirror, &memory[dataOffset], size, _copyPool.get());
+                if (size > 0)
+                {
+                    ranges.push_back({0, size});
+                }
+            }
+        }
+        else if (revision != _syncedRevision)
+        {
+            mirror.resize(size);
+
+            const std::size_t blockSize = std::size_t{1} << _layout.dirtyShift;
+            const std::size_t blocks = (size + blockSize - 1) >> _layout.dirtyShift;
+
+            for (std::size_t block = 0; block < blocks; ++block)
+            {
+                const std::uint32_t stamp = readUInt32(_layout.dirtyTableOffset + block * dirtyStampSize);
+                if (static_cast<std::int32_t>(stamp - _syncedRevision) <= 0)
+                {
+                    continue;
+                }
+
+                const std::size_t begin = block << _layout.dirtyShift;
+                const std::size_t length = std::min(blockSize, size - begin);
+
+                // coalesce adjacent dirty blocks into one range
+                if (!ranges.empty() && ranges.back().offset + ranges.back().size == begin)
+                {
+                    ranges.back().size += length;
+                }
+                else
+                {
+                    ranges.push_back({begin, length});
+                }
+            }
+
+            for (const ChangedRange& range : ranges)
+            {
+                copyFromShared(&mirror[range.offset], &memory[dataOffset + range.offset], range.size, _copyPool.get());
+            }
+        }
+
+        _syncedRevision = revision;
+        _hasSynced = true;
+
+        if (_stats)
+        {
+            std::size_t copied = 0;
+            for (const ChangedRange& range : ranges)
+            {
+                copied += range.size;
+            }
+            countRead(copied);
+        }
+
+        unlockRead();
+        return ranges;
+    }
+
+private:
+    void attach(const std::size_t expectedSize)
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory segment could not be opened.");
+        }
+
+        _segmentSize = checkSegmentHeader(_memory, SegmentType::Stream, expectedSize);
+
+        const auto memory = static_cast<char*>(_memory.data());
+        _layout = computeStreamLayout(_segmentSize, static_cast<std::uint8_t>(memory[dirtyShiftOffset]),
+                                      static_cast<std::uint8_t>(memory[featureFlagsOffset]));
+        if (_layout.statsOffset != 0)
+        {
+            _stats = reinterpret_cast<StreamStatsBlock*>(&memory[_layout.statsOffset]);
+        }
+        _lastSeenRevision = readRevision();
+    }
+
+    template <typename T>
+    [[nodiscard]] T* readNumericArray(const char typeFlag, const std::size_t elementSize) const
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+
+        lockForRead();
+        const std::size_t byteSize = readSize(typeFlag);
+        const std::size_t length = byteSize / elementSize;
+        auto data = new T[length];
+        copyFromShared(data, &memory[dataOffset], length * elementSize, _copyPool.get());
+        countRead(length * elementSize);
+        LSM_PROBE3(stream_read, _memory.path().c_str(), readRevision(), length * elementSize);
+        unlockRead();
+        return data;
+    }
+
+    [[nodiscard]] bool isWriteLocked() const noexcept
+    {
+        return atomicUInt32(lockOffset).load(std::memory_order_acquire) != 0;
+    }
+
+    void lockForRead() const noexcept
+    {
+        const std::uint64_t waitStart = _lockProfiler ? LockProfiler::now() : 0;
+        const std::uint64_t spins = lsm_sync_detail::acquireSpinLock(atomicUInt32(lockOffset));
+        if (_lockProfiler)
+        {
+            _lockProfiler->acquired(0, waitStart);
+        }
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->reader.lockAcquisitions, 1);
+            lsm_sync_detail::addRelaxed(_stats->reader.lockSpins, spins);
+        }
+    }
+
+    void unlockRead() const noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->releasing(0);
+        }
+        lsm_sync_detail::releaseSpinLock(atomicUInt32(lockOffset));
+    }
+
+    // called with the stream lock held
+    void countRead(const std::size_t bytes) const noexcept
+    {
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->reader.operations, 1);
+            lsm_sync_detail::addRelaxed(_stats->reader.bytes, bytes);
+        }
+    }
+
+    [[nodiscard]] std::uint32_t readRevision() const noexcept
+    {
+        return atomicUInt32(revisionOffset).load(std::memory_order_acquire);
+    }
+
+    void writeAck(const std::uint32_t ack) const noexcept
+    {
+        atomicUInt32(ackOffset).store(ack, std::memory_order_release);
+    }
+
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicUInt32(const std::size_t offset) const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[offset]);
+    }
+
+    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint32_t value = 0;
+        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
+        return value;
+    }
+
+    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
+
+    }
+
+    Memory _memory;
+    std::size_t _segmentSize = 0;
+    StreamLayout _layout;
+    StreamStatsBlock* _stats = nullptr;
+    std::shared_ptr<CopyThreadPool> _copyPool;
+    std::unique_ptr<LockProfiler> _lockProfiler;
+    mutable std::uint32_t _lastSeenRevision = 0;
+    mutable std::uint32_t _syncedRevision = 0;
+    mutable bool _hasSynced = false;
+};
+
+class SharedMemoryWriteStream
+{
+public:
+    SharedMemoryWriteStream(const std::string& name, const std::size_t bufferSize, const bool isPersistent,
+                            const StreamOptions& options = {}):
+        _memory(name, bufferSize, isPersistent)
+    {
+        initialize(options);
+    }
+
+    /**
+     * @brief Creates a stream channel in a registry, or takes over the existing one
+     */
+    SharedMemoryWriteStream(SharedMemoryRegistry& registry, const std::string& channel, const std::size_t bufferSize,
+                            const StreamOptions& options = {}):
+        _memory(registry.allocate(channel, bufferSize))
+    {
+        initialize(options);
+    }
+
+    void close()
+    {
+        _memory.close();
+        _stats = nullptr;
+        _lockProfiler.reset();
+    }
+
+    // counters of the segment, or nothing if StreamOptions::statistics was off
+    [[nodiscard]] std::optional<StreamStatistics> statistics() const noexcept
+    {
+        if (!_stats)
+        {
+            return std::nullopt;
+        }
+        return snapshotStatistics(*_stats);
+    }
+
+    /**
+     * @brief Splits payload copies of at least pool->minChunkSize() * 2 bytes across a thread pool
+     * Pass the same pool to several streams to share it, or nullptr to copy
+     * on the calling thread again.
+     */
+    void setCopyThreadPool(std::shared_ptr<CopyThreadPool> pool) noexcept
+    {
+        _copyPool = std::move(pool);
+    }
+
+    // convenience for a pool owned by this stream alone
+    void enableParallelCopy(const unsigned workers, const std::size_t minChunkSize = std::size_t{1} << 20)
+    {
+        _copyPool = std::make_shared<CopyThreadPool>(workers, minChunkSize);
+    }
+
+    /**
+     * @brief Records lock wait and hold times in the "<name>_lockprof" side segment
+     * Costs two steady_clock reads per acquisition; see LockProfiler.
+     */
+    void enableLockProfiling()
+    {
+        if (!_lockProfiler)
+        {
+            _lockProfiler = std::make_unique<LockProfiler>(_memory.name());
+        }
+    }
+
+    // wait/hold histograms of the stream lock, or nothing if profiling is off
+    [[nodiscard]] std::optional<LockProfile> lockProfile() const noexcept
+    {
+        if (!_lockProfiler)
+        {
+            return std::nullopt;
+        }
+        return _lockProfiler->snapshot(0);
+    }
+
+    void resetLockProfile() noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->reset();
+        }
+    }
+
+    [[nodiscard]] bool isMessageRead() const noexcept
+    {
+        return atomicUInt32(ackOffset).load(std::memory_order_acquire)
+            == atomicUInt32(revisionOffset).load(std::memory_order_acquire);
+    }
+
+    void waitForRead() const noexcept
+    {
+        while (!isMessageRead())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // https://stackoverflow.com/questions/18591924/how-to-use-bitmask
+    [[nodiscard]] static constexpr char getWriteFlags(const char type, const char currentFlags) noexcept
+    {
+        char flags = type;
+
+        if ((currentFlags & (kMemoryChanged)) == kMemoryChanged)
+        {
+            // disable flag, leave rest untouched
+            flags &= ~kMemoryChanged;
+        }
+        else
+        {
+            // enable flag, leave rest untouched
+            flags ^= kMemoryChanged;
+        }
+        return flags;
+    }
+
+    void write(std::string_view string) const
+    {
+        const auto memory = static_cast<char*>(_memory.data());
+
+        if (string.size() > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("String payload exceeds maximum shared memory size.");
+        }
+
+        if (string.size() > _layout.dataCapacity)
+        {
+            throw std::runtime_error("String payload exceeds shared memory buffer size.");
+        }
+
+        lockForWrite(memory);
+
+        // 1) copy change flag into buffer for change detection
+        const char flags = getWriteFlags(kMemoryTypeString, memory[flagsOffset]);
+        std::memcpy(&memory[flagsOffset], &flags, flagSize);
+
+        // 2) copy buffer size into buffer (meta data for deserializing)
+        const char *stringData = string.data();
+        const auto bufferSize = static_cast<std::uint32_t>(string.size());
+
+        // write data
+        std::memcpy(&memory[sizeOffset], &bufferSize, bufferSizeSize);
+
+        // 3) copy stringData into memory buffer
+        copyToShared(&memory[dataOffset], stringData, bufferSize, _copyPool.get());
+
+        markDirty(memory, 0, bufferSize);
+        countWrite(bufferSize);
+        [[maybe_unused]] const std::uint32_t revision = incrementRevision(memory);
+        LSM_PROBE3(stream_write, _memory.path().c_str(), revision, bufferSize);
+        unlockForWrite(memory);
+    }
+
+    /**
+     * @brief Updates a subrange of the payload in place
+     * Keeps the data type, bumps the revision and, with dirty tracking on,
+     * stamps only the touched blocks. The range may extend the payload but
+     * must start within it, so the payload never contains unwritten gaps.
+     *
+     * @param offset Byte offset into the payload
+     * @param bytes Replacement bytes
+     */
+    void writeRange(const std::size_t offset, std::span<const std::byte> bytes) const
+    {
+        if (offset > _layout.dataCapacity || bytes.size() > _layout.dataCapacity - offset)
+        {
+            throw std::runtime_error("Range exceeds shared memory buffer size.");
+        }
+
+        const auto memory = static_cast<char*>(_memory.data());
+
+        lockForWrite(memory);
+
+        std::uint32_t currentSize = 0;
+        std::memcpy(&currentSize, &memory[sizeOffset], bufferSizeSize);
+
+        if (offset > currentSize)
+        {
+            unlockForWrite(memory);
+            throw std::runtime_error("Range starts beyond the end of the current payload.");
+        }
+
+        const char flags = getWriteFlags(static_cast<char>(memory[flagsOffset] & ~kMemoryChanged), memory[flagsOffset]);
+        std::memcpy(&memory[flagsOffset], &flags, flagSize);
+
+        copyToShared(&memory[dataOffset + offset], bytes.data(), bytes.size(), _copyPool.get());
+
+        const std::size_t end = offset + bytes.size();
+        if (end > currentSize)
+        {
+            const auto bufferSize = static_cast<std::uint32_t>(end);
+            std::memcpy(&memory[sizeOffset], &bufferSize, bufferSizeSize);
+        }
+
+        markDirty(memory, offset, bytes.size());
+        countWrite(bytes.size());
+        [[maybe_unused]] const std::uint32_t revision = incrementRevision(memory);
+        LSM_PROBE3(stream_write, _memory.path().c_str(), revision, bytes.size());
+        unlockForWrite(memory);
+    }
+
+    void writeRange(const std::size_t offset, std::string_view bytes) const
+    {
+        writeRange(offset, std::as_bytes(std::span<const char>(bytes.data(), bytes.size())));
+    }
+
+    void write(std::span<const float> data) const
+    {
+        writeNumericArray(data, kMemoryTypeFloat);
+    }
+
+    void write(const float* data, const std::size_t length) const
+    {
+        write(std::span<const float>(data, length));
+    }
+
+    void write(std::span<const double> data) const
+    {
+        writeNumericArray(data, kMemoryTypeDouble);
+    }
+
+    void write(const double* data, const std::size_t length) const
+    {
+        write(std::span<const double>(data, length));
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+        LockProfiler::destroy(_memory.name());
+    }
+
+private:
+    void initialize(const StreamOptions& options)
+    {
+        std::uint8_t dirtyShift = 0;
+        if (options.dirtyBlockSize != 0)
+        {
+            if (options.dirtyBlockSize < 64 || (options.dirtyBlockSize & (options.dirtyBlockSize - 1)) != 0)
+            {
+                throw std::runtime_error("Dirty block size must be a power of two of at least 64 bytes.");
+            }
+            while ((std::size_t{1} << dirtyShift) < options.dirtyBlockSize)
+            {
+                ++dirtyShift;
+            }
+        }
+
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory segment could not be created.");
+        }
+
+        const std::uint8_t features = options.statistics ? kStreamFeatureStatistics : 0;
+        _layout = computeStreamLayout(_memory.size(), dirtyShift, features);
+        if (options.statistics && _layout.statsOffset == 0)
+        {
+            throw std::runtime_error("Shared memory buffer is too small for the statistics block.");
+        }
+
+        auto memory = static_cast<char*>(_memory.data());
+        memory[flagsOffset] = 0;
+        memory[dirtyShiftOffset] = static_cast<char>(dirtyShift);
+        memory[featureFlagsOffset] = static_cast<char>(features);
+        writeUInt32(revisionOffset, 0);
+        writeUInt32(ackOffset, 0);
+        writeUInt32(sizeOffset, 0);
+        new (&memory[lockOffset]) std::atomic<std::uint32_t>(0);
+        if (_layout.dirtyBlockCount > 0)
+        {
+            std::memset(&memory[_layout.dirtyTableOffset], 0, _layout.dirtyBlockCount * dirtyStampSize);
+        }
+        if (_layout.statsOffset != 0)
+        {
+            _stats = new (&memory[_layout.statsOffset]) StreamStatsBlock();
+        }
+        writeSegmentHeader(_memory, SegmentType::Stream);
+    }
+
+    template <typename T>
+    requires std::is_floating_point_v<T>
+    void writeNumericArray(std::span<const T> data, const char typeFlag) const
+    {
+        const std::size_t length = data.size();
+
+        if (length > 0 && length > (std::numeric_limits<std::uint32_t>::max() / sizeof(T)))
+        {
+            throw std::runtime_error("Numeric payload exceeds maximum shared memory size.");
+        }
+
+        if (length * sizeof(T) > _layout.dataCapacity)
+        {
+            throw std::runtime_error("Numeric payload exceeds shared memory buffer size.");
+        }
+
+        const auto memory = static_cast<char*>(_memory.data());
+
+        lockForWrite(memory);
+
+        const char flags = getWriteFlags(typeFlag, memory[flagsOffset]);
+        std::memcpy(&memory[flagsOffset], &flags, flagSize);
+
+        const auto bufferSize = static_cast<std::uint32_t>(length * sizeof(T));
+        std::memcpy(&memory[sizeOffset], &bufferSize, bufferSizeSize);
+        copyToShared(&memory[dataOffset], data.data(), bufferSize, _copyPool.get());
+
+        markDirty(memory, 0, bufferSize);
+        countWrite(bufferSize);
+        [[maybe_unused]] const std::uint32_t revision = incrementRevision(memory);
+        LSM_PROBE3(stream_write, _memory.path().c_str(), revision, bufferSize);
+        unlockForWrite(memory);
+    }
+
+    // stamps the blocks covering [offset, offset + size) with the revision
+    // about to be published; called with the stream lock held
+    void markDirty(char* memory, const std::size_t offset, const std::size_t size) const noexcept
+    {
+        if (_layout.dirtyShift == 0 || size == 0)
+        {
+            return;
+        }
+
+        const std::uint32_t nextRevision = readUInt32(revisionOffset) + 1;
+        const std::size_t first = offset >> _layout.dirtyShift;
+        const std::size_t last = (offset + size - 1) >> _layout.dirtyShift;
+
+        for (std::size_t block = first; block <= last; ++block)
+        {
+            std::memcpy(&memory[_layout.dirtyTableOffset + block * dirtyStampSize], &nextRevision, dirtyStampSize);
+        }
+    }
+
+    void lockForWrite(char* memory) const noexcept
+    {
+        auto& lock = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[lockOffset]);
+        const std::uint64_t waitStart = _lockProfiler ? LockProfiler::now() : 0;
+        const std::uint64_t spins = lsm_sync_detail::acquireSpinLock(lock);
+        if (_lockProfiler)
+        {
+            _lockProfiler->acquired(0, waitStart);
+        }
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->writer.lockAcquisitions, 1);
+            lsm_sync_detail::addRelaxed(_stats->writer.lockSpins, spins);
+        }
+    }
+
+    void unlockForWrite(char* memory) const noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->releasing(0);
+        }
+        auto& lock = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[lockOffset]);
+        lsm_sync_detail::releaseSpinLock(lock);
+    }
+
+    // called with the stream lock held
+    void countWrite(const std::size_t bytes) const noexcept
+    {
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->writer.operations, 1);
+            lsm_sync_detail::addRelaxed(_stats->writer.bytes, bytes);
+        }
+    }
+
+    // publishes the write; returns the new revision
+    static std::uint32_t incrementRevision(char* memory) noexcept
+    {
+        auto& revision = *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[revisionOffset]);
+        return revision.fetch_add(1, std::memory_order_release) + 1;
+    }
+
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicUInt32(const std::size_t offset) const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[offset]);
+    }
+
+    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint32_t value = 0;
+        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
+        return value;
+    }
+
+    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
+    }
+
+    Memory _memory;
+    StreamLayout _layout;
+    StreamStatsBlock* _stats = nullptr;
+    std::shared_ptr<CopyThreadPool> _copyPool;
+    std::unique_ptr<LockProfiler> _lockProfiler;
+};
+
+/**
+ * @brief Creation options of a SharedMemoryQueue
+ * Unlike stream options these change the segment size, so writers and
+ * readers must pass the same values; a reader whose options do not match
+ * the segment fails to open it.
+ */
+struct QueueOptions
+{
+    // Append a QueueStatsBlock after the message slots and count enqueues,
+    // dequeues, bytes, full/empty rejections, the count high-water mark and
+    // lock activity in it; see statistics().
+    bool statistics = false;
+
+    // Stamp every message with a steady-clock time when it is published and
+    // record its queue residence time (publish to dequeue) in a latency
+    // histogram inside the segment; see latency(). Adds 8 bytes per slot.
+    bool timestamps = false;
+
+    // When the queue is full, enqueue() evicts the oldest message instead of
+    // failing, so producers never wait for a stalled consumer. Evictions are
+    // counted in the segment; see dropped().
+    bool overwrite = false;
+
+    // Split messages longer than maxMessageSize across consecutive slots,
+    // marking all but the last with a continuation bit in the slot length,
+    // and reassemble them on dequeue. A message is published and consumed as
+    // a whole, so slots can be sized for the common case and the rare large
+    // message borrows several. Without it, oversized messages throw.
+    bool fragmentation = false;
+};
+
+// bytes before the first message slot of a queue segment: the segment header plus the queue header
+inline constexpr std::size_t queueHeaderSize = segmentHeaderSize + 32;
+
+/**
+ * @brief Lock-free view of a queue segment's header, see inspectQueue()
+ */
+struct QueueSnapshot
+{
+    std::uint32_t capacity = 0;
+    std::uint32_t maxMessageSize = 0;
+    std::uint32_t count = 0;
+    std::uint32_t writeIndex = 0;
+    std::uint32_t readIndex = 0;
+    std::uint32_t producerLockHolder = 0; // process id, 0 when free
+    std::uint32_t consumerLockHolder = 0; // process id, 0 when free
+    std::uint32_t features = 0;
+    std::size_t segmentSize = 0; // size of the whole segment as described by its header
+    std::optional<QueueStatistics> statistics;
+    std::optional<LatencyDistribution> latency; // queue residence times, with QueueOptions::timestamps
+    std::optional<std::uint64_t> dropped; // messages evicted unread, with QueueOptions::overwrite
+
+    [[nodiscard]] double fillRatio() const noexcept
+    {
+        return capacity ? static_cast<double>(count) / capacity : 0.0;
+    }
+};
+
+[[nodiscard]] QueueSnapshot inspectQueue(const Memory& memory);
+
+/**
+ * @brief Queue structure for shared memory
+ * Layout: [segment header(16)][writeIndex(4)][readIndex(4)][capacity(4)][count(4)][maxMessageSize(4)][producerLock(4)][consumerLock(4)][features(4)][messages...][stats][latency][dropped]
+ */
+class SharedMemoryQueue
+{
+private:
+    static constexpr std::size_t kWriteIndexOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kReadIndexOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kCapacityOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kCountOffset = segmentHeaderSize + 12;
+    static constexpr std::size_t kMaxMessageSizeOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kProducerLockOffset = segmentHeaderSize + 20;
+    static constexpr std::size_t kConsumerLockOffset = segmentHeaderSize + 24;
+    static constexpr std::size_t kFeaturesOffset = segmentHeaderSize + 28;
+    static constexpr std::size_t kHeaderSize = queueHeaderSize;
+
+    // bits of the features word
+    static constexpr std::uint32_t kFeatureStatistics = 1u << 0;
+    static constexpr std::uint32_t kFeatureTimestamps = 1u << 1;
+    static constexpr std::uint32_t kFeatureOverwrite = 1u << 2;
+    static constexpr std::uint32_t kFeatureFragmentation = 1u << 3;
+
+    // set in the length of every fragment but the last of a fragmented message
+    static constexpr std::uint32_t kContinuation = 1u << 31;
+
+    static constexpr std::size_t kTimestampSize = sizeof(std::uint64_t);
+
+    // lock indices in the lock profile side segment
+    static constexpr std::size_t kProducerLock = 0;
+    static constexpr std::size_t kConsumerLock = 1;
+
+    // messages staged behind the write index since beginTransaction()
+    struct Transaction
+    {
+        std::uint32_t slots = 0;
+        std::uint32_t messages = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    Memory _memory;
+    std::uint32_t _capacity;
+    std::uint32_t _maxMessageSize;
+    bool _isWriter;
+    std::size_t _slotHeaderSize = sizeof(std::uint32_t);
+    QueueStatsBlock* _stats = nullptr;
+    LatencyHistogramBlock* _latency = nullptr;
+    QueueOverwriteBlock* _overwrite = nullptr;
+    bool _fragmentation = false;
+    std::unique_ptr<LockProfiler> _lockProfiler;
+    // fragments of the message being consumed; only touched under the consumer lock
+    mutable std::vector<std::span<const std::byte>> _fragments;
+    // open transaction; the producer lock is held while it is set
+    std::optional<Transaction> _transaction;
+
+    friend QueueSnapshot inspectQueue(const Memory& memory);
+
+    [[nodiscard]] static std::uint32_t featuresOf(const QueueOptions& options) noexcept
+    {
+        return (options.statistics ? kFeatureStatistics : 0) | (options.timestamps ? kFeatureTimestamps : 0)
+               | (options.overwrite ? kFeatureOverwrite : 0) | (options.fragmentation ? kFeatureFragmentation : 0);
+    }
+
+    // bytes in front of each message: [length(4)] or [length(4)][timestamp(8)]
+    [[nodiscard]] static std::size_t slotHeaderSize(const std::uint32_t features) noexcept
+    {
+        return sizeof(std::uint32_t) + ((features & kFeatureTimestamps) ? kTimestampSize : 0);
+    }
+
+    [[nodiscard]] static std::size_t alignToStats(const std::size_t offset) noexcept
+    {
+        return (offset + kStatsAlignment - 1) & ~(kStatsAlignment - 1);
+    }
+
+    [[nodiscard]] static std::size_t slotsEnd(const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                              const std::uint32_t features) noexcept
+    {
+        return kHeaderSize + static_cast<std::size_t>(capacity) * (maxMessageSize + slotHeaderSize(features));
+    }
+
+    [[nodiscard]] static std::size_t statsOffset(const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                                 const std::uint32_t features) noexcept
+    {
+        return alignToStats(slotsEnd(capacity, maxMessageSize, features));
+    }
+
+    [[nodiscard]] static std::size_t latencyOffset(const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                                   const std::uint32_t features) noexcept
+    {
+        const std::size_t offset = statsOffset(capacity, maxMessageSize, features);
+        return (features & kFeatureStatistics) ? alignToStats(offset + sizeof(QueueStatsBlock)) : offset;
+    }
+
+    [[nodiscard]] static std::size_t overwriteOffset(const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                                   const std::uint32_t features) noexcept
+    {
+        const std::size_t offset = latencyOffset(capacity, maxMessageSize, features);
+        return (features & kFeatureTimestamps) ? alignToStats(offset + sizeof(LatencyHistogramBlock)) : offset;
+    }
+
+    [[nodiscard]] static std::size_t segmentSize(const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                                 const std::uint32_t features) noexcept
+    {
+        if (features & kFeatureOverwrite)
+        {
+            return overwriteOffset(capacity, maxMessageSize, features) + sizeof(QueueOverwriteBlock);
+        }
+        if (features & kFeatureTimestamps)
+        {
+            return latencyOffset(capacity, maxMessageSize, features) + sizeof(LatencyHistogramBlock);
+        }
+        if (features & kFeatureStatistics)
+        {
+            return statsOffset(capacity, maxMessageSize, features) + sizeof(QueueStatsBlock);
+        }
+        return slotsEnd(capacity, maxMessageSize, features);
+    }
+
+    [[nodiscard]] std::uint32_t readUInt32(std::size_t offset) const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint32_t value = 0;
+        std::memcpy(&value, &memory[offset], sizeof(std::uint32_t));
+        return value;
+    }
+
+    void writeUInt32(std::size_t offset, std::uint32_t value) const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
+    }
+
+    [[nodiscard]] std::size_t getMessageOffset(std::uint32_t index) const noexcept
+    {
+        // Each slot contains: [length(4)][timestamp(8), optional][data(maxMessageSize)]
+        return kHeaderSize + index * (_maxMessageSize + _slotHeaderSize);
+    }
+
+    // Helper to access atomic count field in shared memory
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicCount() const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kCountOffset]);
+    }
+
+    // slots holding published messages; overwrite queues keep no count
+    [[nodiscard]] std::uint32_t queuedSlots() const noexcept
+    {
+        if (_overwrite)
+        {
+            // head first: it never passes tail, so the difference cannot wrap
+            const std::uint64_t head = _overwrite->head.load(std::memory_order_acquire);
+            const std::uint64_t tail = _overwrite->tail.load(std::memory_order_acquire);
+            return static_cast<std::uint32_t>(std::min<std::uint64_t>(tail - head, _capacity));
+        }
+        return atomicCount().load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicProducerLock() const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kProducerLockOffset]);
+    }
+
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicConsumerLock() const noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kConsumerLockOffset]);
+    }
+
+    void lockProducer() const noexcept
+    {
+        const std::uint64_t waitStart = _lockProfiler ? LockProfiler::now() : 0;
+        const std::uint64_t spins = lsm_sync_detail::acquireSpinLock(atomicProducerLock());
+        if (_lockProfiler)
+        {
+            _lockProfiler->acquired(kProducerLock, waitStart);
+        }
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->producer.lockAcquisitions, 1);
+            lsm_sync_detail::addRelaxed(_stats->producer.lockSpins, spins);
+        }
+    }
+
+    void unlockProducer() const noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->releasing(kProducerLock);
+        }
+        lsm_sync_detail::releaseSpinLock(atomicProducerLock());
+    }
+
+    void lockConsumer() const noexcept
+    {
+        const std::uint64_t waitStart = _lockProfiler ? LockProfiler::now() : 0;
+        const std::uint64_t spins = lsm_sync_detail::acquireSpinLock(atomicConsumerLock());
+        if (_lockProfiler)
+        {
+            _lockProfiler->acquired(kConsumerLock, waitStart);
+        }
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->consumer.lockAcquisitions, 1);
+            lsm_sync_detail::addRelaxed(_stats->consumer.lockSpins, spins);
+        }
+    }
+
+    void unlockConsumer() const noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->releasing(kConsumerLock);
+        }
+        lsm_sync_detail::releaseSpinLock(atomicConsumerLock());
+    }
+
+    void initialize(const QueueOptions& options)
+    {
+        if (options.fragmentation && _maxMessageSize >= kContinuation)
+        {
+            throw std::runtime_error("Fragmented queues need a maxMessageSize below 2^31.");
+        }
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory queue could not be created.");
+        }
+
+        // Initialize queue metadata
+        writeUInt32(kWriteIndexOffset, 0);
+        writeUInt32(kReadIndexOffset, 0);
+        writeUInt32(kCapacityOffset, _capacity);
+        // construct atomic count with placement new to ensure proper atomic object initialization
+        auto memory = static_cast<char*>(_memory.data());
+        new (&memory[kCountOffset]) std::atomic<std::uint32_t>(0);
+        writeUInt32(kMaxMessageSizeOffset, _maxMessageSize);
+        new (&memory[kProducerLockOffset]) std::atomic<std::uint32_t>(0);
+        new (&memory[kConsumerLockOffset]) std::atomic<std::uint32_t>(0);
+        const std::uint32_t features = featuresOf(options);
+        writeUInt32(kFeaturesOffset, features);
+        _slotHeaderSize = slotHeaderSize(features);
+        _fragmentation = options.fragmentation;
+        if (options.statistics)
+        {
+            _stats = new (&memory[statsOffset(_capacity, _maxMessageSize, features)]) QueueStatsBlock();
+        }
+        if (options.timestamps)
+        {
+            _latency = new (&memory[latencyOffset(_capacity, _maxMessageSize, features)]) LatencyHistogramBlock();
+        }
+        if (options.overwrite)
+        {
+            _overwrite = new (&memory[overwriteOffset(_capacity, _maxMessageSize, features)]) QueueOverwriteBlock();
+        }
+        writeSegmentHeader(_memory, SegmentType::Queue);
+    }
+
+    // opens the segment as a reader; expectedFeatures and expectedSize come
+    // from the caller's parameters, or are absent/0 to adopt the segment's
+    void attach(const std::optional<std::uint32_t> expectedFeatures, const std::size_t expectedSize)
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory queue could not be opened.");
+        }
+
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::Queue, 0);
+
+        // Read queue metadata
+        _capacity = readUInt32(kCapacityOffset);
+        _maxMessageSize = readUInt32(kMaxMessageSizeOffset);
+        const std::uint32_t features = readUInt32(kFeaturesOffset);
+
+        if (expectedFeatures && features != *expectedFeatures)
+        {
+            throw std::runtime_error("Queue options do not match the shared memory queue.");
+        }
+        if (size != segmentSize(_capacity, _maxMessageSize, features) || (expectedSize != 0 && size != expectedSize))
+        {
+            throw std::runtime_error("Queue capacity or message size does not match the shared memory queue.");
+        }
+
+        _slotHeaderSize = slotHeaderSize(features);
+        _fragmentation = (features & kFeatureFragmentation) != 0;
+        auto memory = static_cast<char*>(_memory.data());
+        if (features & kFeatureStatistics)
+        {
+            _stats = reinterpret_cast<QueueStatsBlock*>(&memory[statsOffset(_capacity, _maxMessageSize, features)]);
+        }
+        if (features & kFeatureTimestamps)
+        {
+            _latency = reinterpret_cast<LatencyHistogramBlock*>(&memory[latencyOffset(_capacity, _maxMessageSize, features)]);
+        }
+        if (features & kFeatureOverwrite)
+        {
+            _overwrite = reinterpret_cast<QueueOverwriteBlock*>(&memory[overwriteOffset(_capacity, _maxMessageSize, features)]);
+        }
+    }
+
+    // overwrite mode: evicts whole messages, oldest first, until slots more fit behind tail; the
+    // caller holds the producer lock. Consumers are never waited for: each eviction moves head with a
+    // CAS, which also tells a consumer still copying that message to discard its copy, see dequeueWith().
+    void evictOldest(const std::uint32_t slots) noexcept
+    {
+        const std::uint64_t tail = _overwrite->tail.load(std::memory_order_relaxed);
+        std::uint64_t head = _overwrite->head.load(std::memory_order_acquire);
+        while (tail + slots - head > _capacity)
+        {
+            const std::uint32_t used = messageSlots(static_cast<std::uint32_t>(head % _capacity));
+            if (_overwrite->head.compare_exchange_weak(head, head + used, std::memory_order_acq_rel,
+                                                       std::memory_order_acquire))
+            {
+                _overwrite->dropped.fetch_add(1, std::memory_order_relaxed);
+                head += used;
+            }
+        }
+        // the evictions are visible before the freed slots are rewritten
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // slots taken by the message starting at slot index; the caller holds the producer lock,
+    // so the slot headers cannot change meanwhile
+    [[nodiscard]] std::uint32_t messageSlots(std::uint32_t index) const noexcept
+    {
+        const auto memory = static_cast<const char*>(_memory.data());
+        std::uint32_t slots = 0;
+        std::uint32_t header = 0;
+        do
+        {
+            std::memcpy(&header, &memory[getMessageOffset(index)], sizeof(std::uint32_t));
+            index = (index + 1) % _capacity;
+            ++slots;
+        } while ((header & kContinuation) && slots < _capacity);
+        return slots;
+    }
+
+    // slots a message of size bytes takes
+    [[nodiscard]] std::uint32_t slotsFor(const std::size_t size) const
+    {
+        if (size <= _maxMessageSize)
+        {
+            return 1;
+        }
+        if (!_fragmentation)
+        {
+            throw std::runtime_error("Message exceeds maximum message size.");
+        }
+        if (_maxMessageSize == 0 || (size - 1) / _maxMessageSize + 1 > _capacity)
+        {
+            throw std::runtime_error("Message exceeds the capacity of the queue.");
+        }
+        return static_cast<std::uint32_t>((size - 1) / _maxMessageSize + 1);
+    }
+
+    // whether slots more slots fit behind the ones already staged, evicting in overwrite mode;
+    // the caller holds the producer lock
+    bool reserveSlots(const std::uint32_t slots)
+    {
+        const std::uint32_t needed = (_transaction ? _transaction->slots : 0) + slots;
+        if (_overwrite && needed <= _capacity)
+        {
+            evictOldest(needed);
+        }
+
+        if (queuedSlots() + needed > _capacity)
+        {
+            if (_stats)
+            {
+                lsm_sync_detail::addRelaxed(_stats->producer.fullRejections, 1);
+            }
+            LSM_PROBE1(queue_full, _memory.path().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // writes message into the slots from index on, every fragment but the last filling its slot
+    // and carrying the continuation bit; returns the slot after the last fragment
+    std::uint32_t writeFragments(const std::string_view message, const std::uint32_t slots, std::uint32_t index) noexcept
+    {
+        auto memory = static_cast<char*>(_memory.data());
+        std::size_t written = 0;
+        for (std::uint32_t fragment = 0; fragment < slots; ++fragment)
+        {
+            const std::size_t offset = getMessageOffset(index);
+            const auto length = static_cast<std::uint32_t>(std::min<std::size_t>(message.size() - written, _maxMessageSize));
+            const std::uint32_t header = fragment + 1 < slots ? length | kContinuation : length;
+            std::memcpy(&memory[offset], &header, sizeof(std::uint32_t));
+            copyToShared(&memory[offset + _slotHeaderSize], message.data() + written, length);
+            written += length;
+            index = (index + 1) % _capacity;
+        }
+        return index;
+    }
+
+    // makes the messages written from the write index on visible with one release of count;
+    // the caller holds the producer lock
+    void publish(const Transaction& staged)
+    {
+        const std::uint32_t writeIndex = readUInt32(kWriteIndexOffset);
+        auto memory = static_cast<char*>(_memory.data());
+
+        // stamped last, so residence time starts when the messages become visible
+        if (_latency)
+        {
+            const std::uint64_t now = lsm_sync_detail::steadyNanoseconds();
+            std::uint32_t index = writeIndex;
+            for (std::uint32_t message = 0; message < staged.messages; ++message)
+            {
+                std::memcpy(&memory[getMessageOffset(index) + sizeof(std::uint32_t)], &now, kTimestampSize);
+                std::uint32_t header = 0;
+                do
+                {
+                    std::memcpy(&header, &memory[getMessageOffset(index)], sizeof(std::uint32_t));
+                    index = (index + 1) % _capacity;
+                } while (header & kContinuation);
+            }
+        }
+
+        writeUInt32(kWriteIndexOffset, (writeIndex + staged.slots) % _capacity);
+
+        // one release for all slots: consumers see every message or none of them
+        std::uint32_t count = 0;
+        if (_overwrite)
+        {
+            const std::uint64_t tail = _overwrite->tail.load(std::memory_order_relaxed) + staged.slots;
+            _overwrite->tail.store(tail, std::memory_order_release);
+            count = static_cast<std::uint32_t>(tail - _overwrite->head.load(std::memory_order_acquire));
+        }
+        else
+        {
+            count = atomicCount().fetch_add(staged.slots, std::memory_order_release) + staged.slots;
+        }
+
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->producer.enqueues, staged.messages);
+            lsm_sync_detail::addRelaxed(_stats->producer.bytes, staged.bytes);
+            if (count > _stats->producer.highWaterMark.load(std::memory_order_relaxed))
+            {
+                _stats->producer.highWaterMark.store(count, std::memory_order_relaxed);
+            }
+        }
+
+        LSM_PROBE4(queue_enqueue, _memory.path().c_str(), writeIndex, staged.bytes, count);
+    }
+
+    // gathers the fragments of the message starting at slot index into _fragments;
+    // returns the number of slots it takes. The caller holds the consumer lock.
+    std::uint32_t collectFragments(std::uint32_t index) const
+    {
+        const auto memory = static_cast<const std::byte*>(_memory.data());
+        _fragments.clear();
+        std::uint32_t header = 0;
+        do
+        {
+            const std::size_t offset = getMessageOffset(index);
+            std::memcpy(&header, &memory[offset], sizeof(std::uint32_t));
+            // clamped: in overwrite mode the producer may be rewriting the header being read
+            _fragments.emplace_back(&memory[offset + _slotHeaderSize], std::min(header & ~kContinuation, _maxMessageSize));
+            index = (index + 1) % _capacity;
+        } while ((header & kContinuation) && _fragments.size() < _capacity);
+        return static_cast<std::uint32_t>(_fragments.size());
+    }
+
+    // replaces message with the concatenated fragments
+    static void assembleFragments(const std::span<const std::span<const std::byte>> fragments, std::string& message)
+    {
+        if (fragments.size() == 1)
+        {
+            assignFromShared(message, reinterpret_cast<const char*>(fragments.front().data()), fragments.front().size());
+            return;
+        }
+        std::size_t length = 0;
+        for (const std::span<const std::byte>& fragment : fragments)
+        {
+            length += fragment.size();
+        }
+        message.resize(length);
+        std::size_t at = 0;
+        for (const std::span<const std::byte>& fragment : fragments)
+        {
+            copyFromShared(&message[at], fragment.data(), fragment.size());
+            at += fragment.size();
+        }
+    }
+
+public:
+    /**
+     * @brief Create or open a shared memory queue
+     * @param name Queue name
+     * @param capacity Maximum number of messages in queue
+     * @param maxMessageSize Maximum size of each message in bytes
+     * @param isPersistent Whether the queue persists after process exit
+     * @param isWriter True to create/write, false to open/read
+     * @param options Segment options; readers must pass the writer's options
+     */
+    SharedMemoryQueue(const std::string& name, std::uint32_t capacity,
+                      std::uint32_t maxMessageSize, bool isPersistent, bool isWriter,
+                      const QueueOptions& options = {})
+        : _memory(name, segmentSize(capacity, maxMessageSize, featuresOf(options)), isPersistent)
+        , _capacity(capacity)
+        , _maxMessageSize(maxMessageSize)
+        , _isWriter(isWriter)
+    {
+        if (isWriter)
+        {
+            initialize(options);
+        }
+        else
+        {
+            attach(featuresOf(options), _memory.size());
+        }
+    }
+
+    /**
+     * @brief Open an existing queue as a reader
+     * Capacity, maximum message size and options are taken from the segment.
+     * @param name Queue name
+     * @param isPersistent Whether the queue persists after process exit
+     */
+    SharedMemoryQueue(const std::string& name, bool isPersistent)
+        : _memory(name, 0, isPersistent)
+        , _capacity(0)
+        , _maxMessageSize(0)
+        , _isWriter(false)
+    {
+        attach(std::nullopt, 0);
+    }
+
+    /**
+     * @brief Create or open a queue channel of a registry
+     * Writers register the channel, or take over an existing one of the same
+     * size; readers check it against the given parameters.
+     */
+    SharedMemoryQueue(SharedMemoryRegistry& registry, const std::string& channel, std::uint32_t capacity,
+                      std::uint32_t maxMessageSize, bool isWriter, const QueueOptions& options = {})
+        : _memory(isWriter ? registry.allocate(channel, segmentSize(capacity, maxMessageSize, featuresOf(options)))
+                           : registry.attach(channel))
+        , _capacity(capacity)
+        , _maxMessageSize(maxMessageSize)
+        , _isWriter(isWriter)
+    {
+        if (isWriter)
+        {
+            initialize(options);
+        }
+        else
+        {
+            attach(featuresOf(options), segmentSize(capacity, maxMessageSize, featuresOf(options)));
+        }
+    }
+
+    /**
+     * @brief Open a queue channel of a registry as a reader, taking its parameters from the segment
+     */
+    SharedMemoryQueue(const SharedMemoryRegistry& registry, const std::string& channel)
+        : _memory(registry.attach(channel))
+        , _capacity(0)
+        , _maxMessageSize(0)
+        , _isWriter(false)
+    {
+        attach(std::nullopt, 0);
+    }
+
+    // counters of the segment, or nothing if QueueOptions::statistics was off
+    [[nodiscard]] std::optional<QueueStatistics> statistics() const noexcept
+    {
+        if (!_stats)
+        {
+            return std::nullopt;
+        }
+        return snapshotStatistics(*_stats);
+    }
+
+    // queue residence times of dequeued messages, or nothing if QueueOptions::timestamps was off
+    [[nodiscard]] std::optional<LatencyDistribution> latency() const noexcept
+    {
+        if (!_latency)
+        {
+            return std::nullopt;
+        }
+        return snapshotHistogram(*_latency);
+    }
+
+    // messages evicted unread since the queue was created, or nothing if QueueOptions::overwrite was off;
+    // consumers share one read position, so the count covers all of them
+    [[nodiscard]] std::optional<std::uint64_t> dropped() const noexcept
+    {
+        if (!_overwrite)
+        {
+            return std::nullopt;
+        }
+        return _overwrite->dropped.load(std::memory_order_relaxed);
+    }
+
+    // zeroes the residence histogram for every process using the queue
+    void resetLatency() noexcept
+    {
+        if (_latency)
+        {
+            lsm_sync_detail::clearHistogram(*_latency);
+        }
+    }
+
+    /**
+     * @brief Records lock wait and hold times in the "<name>_lockprof" side segment
+     * Costs two steady_clock reads per acquisition; see LockProfiler.
+     */
+    void enableLockProfiling()
+    {
+        if (!_lockProfiler)
+        {
+            _lockProfiler = std::make_unique<LockProfiler>(_memory.name());
+        }
+    }
+
+    // wait/hold histograms of the producer and consumer locks, or nothing if profiling is off
+    [[nodiscard]] std::optional<QueueLockProfile> lockProfile() const noexcept
+    {
+        if (!_lockProfiler)
+        {
+            return std::nullopt;
+        }
+        return QueueLockProfile{_lockProfiler->snapshot(kProducerLock), _lockProfiler->snapshot(kConsumerLock)};
+    }
+
+    void resetLockProfile() noexcept
+    {
+        if (_lockProfiler)
+        {
+            _lockProfiler->reset();
+        }
+    }
+
+    [[nodiscard]] bool isEmpty() const noexcept
+    {
+        return queuedSlots() == 0;
+    }
+
+    [[nodiscard]] bool isFull() const noexcept
+    {
+        return queuedSlots() >= _capacity;
+    }
+
+    [[nodiscard]] std::uint32_t size() const noexcept
+    {
+        return queuedSlots();
+    }
+
+    [[nodiscard]] std::uint32_t capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    [[nodiscard]] std::uint32_t maxMessageSize() const noexcept
+    {
+        return _maxMessageSize;
+    }
+
+    /**
+     * @brief Enqueue a message (writer only)
+     * @param message Message to enqueue
+     * @return true if message was enqueued, false if queue is full; always true
+     * in overwrite mode, where a full queue drops its oldest message instead
+     */
+    bool enqueue(std::string_view message)
+    {
+        if (!_isWriter)
+        {
+            throw std::runtime_error("Cannot enqueue from a reader queue instance.");
+        }
+
+        const std::uint32_t slots = slotsFor(message.size());
+
+        if (_transaction)
+        {
+            if (!reserveSlots(slots))
+            {
+                return false;
+            }
+            writeFragments(message, slots, (readUInt32(kWriteIndexOffset) + _transaction->slots) % _capacity);
+            _transaction->slots += slots;
+            _transaction->messages += 1;
+            _transaction->bytes += message.size();
+            return true;
+        }
+
+        lockProducer();
+
+        if (!reserveSlots(slots))
+        {
+            unlockProducer();
+            return false;
+        }
+
+        writeFragments(message, slots, readUInt32(kWriteIndexOffset));
+        publish(Transaction{slots, 1, message.size()});
+        unlockProducer();
+
+        return true;
+    }
+
+    /**
+     * @brief Enqueue a SharedBufferPool descriptor (writer only)
+     * The queue needs a maxMessageSize of at least sizeof(BufferDescriptor);
+     * the consumer becomes responsible for one reference to the buffer.
+     */
+    bool enqueue(const BufferDescriptor& descriptor)
+    {
+        return enqueue(std::string_view{reinterpret_cast<const char*>(&descriptor), sizeof(descriptor)});
+    }
+
+    /**
+     * @brief Start staging messages to publish together (writer only)
+     * Until commit() or abort(), enqueue() writes messages into free slots
+     * behind the write index without making them visible, and returns false
+     * once the staged messages and the queue contents fill the queue. The
+     * producer lock is held for the whole transaction, so other producers
+     * wait until it ends.
+     */
+    void beginTransaction()
+    {
+        if (!_isWriter)
+        {
+            throw std::runtime_error("Cannot enqueue from a reader queue instance.");
+        }
+        if (_transaction)
+        {
+            throw std::runtime_error("A queue transaction is already open.");
+        }
+
+        lockProducer();
+        _transaction.emplace();
+    }
+
+    /**
+     * @brief Publish the staged messages with a single update of the write index and count
+     * @return the number of messages published
+     */
+    std::uint32_t commit()
+    {
+        if (!_transaction)
+        {
+            throw std::runtime_error("No queue transaction is open.");
+        }
+
+        const Transaction staged = *_transaction;
+        _transaction.reset();
+        if (staged.messages > 0)
+        {
+            publish(staged);
+        }
+        unlockProducer();
+
+        return staged.messages;
+    }
+
+    /**
+     * @brief Discard the staged messages; consumers never see them
+     */
+    void abort() noexcept
+    {
+        if (_transaction)
+        {
+            _transaction.reset();
+            unlockProducer();
+        }
+    }
+
+    [[nodiscard]] bool inTransaction() const noexcept
+    {
+        return _transaction.has_value();
+    }
+
+    /**
+     * @brief Dequeue a message (reader only)
+     * @param message Output parameter for dequeued message
+     * @return true if message was dequeued, false if queue is empty
+     */
+    bool dequeue(std::string& message)
+    {
+        return dequeueWith([&message](const std::span<const std::span<const std::byte>> fragments) {
+            assembleFragments(fragments, message);
+        });
+    }
+
+    /**
+     * @brief Dequeue a descriptor sent with enqueue(const BufferDescriptor&) (reader only)
+     * Throws, leaving the message queued, if the next message is not a descriptor.
+     * @return true if a descriptor was dequeued, false if queue is empty
+     */
+    bool dequeue(BufferDescriptor& descriptor)
+    {
+        return dequeueWith([&descriptor](const std::span<const std::span<const std::byte>> fragments) {
+            if (fragments.size() != 1 || fragments.front().size() != sizeof(descriptor))
+            {
+                throw std::runtime_error("Dequeued message is not a buffer descriptor.");
+            }
+            std::memcpy(&descriptor, fragments.front().data(), sizeof(descriptor));
+        });
+    }
+
+    /**
+     * @brief Dequeue a message without copying it (reader only)
+     * Calls consume(std::span<const std::span<const std::byte>>) with the
+     * message's fragments in order, one span per slot it occupies. The spans
+     * point into the segment and are only valid during the call.
+     * Throws on QueueOptions::overwrite queues: their producer does not wait
+     * for the consumer lock and may rewrite the slots during the call.
+     * @return true if message was dequeued, false if queue is empty
+     */
+    template <typename Consume>
+    bool dequeueInPlace(Consume&& consume)
+    {
+        if (_overwrite)
+        {
+            throw std::runtime_error("dequeueInPlace() is not available on overwrite queues, use dequeue().");
+        }
+        return dequeueWith(std::forward<Consume>(consume));
+    }
+
+    /**
+     * @brief Peek at the next message without dequeuing (reader only)
+     * @param message Output parameter for peeked message
+     * @return true if message was peeked, false if queue is empty
+     */
+    bool peek(std::string& message) const
+    {
+        if (_isWriter)
+        {
+            throw std::runtime_error("Cannot peek from a writer queue instance.");
+        }
+
+        lockConsumer();
+
+        for (;;)
+        {
+            if (isEmpty())
+            {
+                unlockConsumer();
+                return false;
+            }
+
+            if (!_overwrite)
+            {
+                collectFragments(readUInt32(kReadIndexOffset));
+                assembleFragments(_fragments, message);
+                break;
+            }
+
+            // the copy only counts if no producer evicted the message meanwhile
+            const std::uint64_t head = _overwrite->head.load(std::memory_order_acquire);
+            collectFragments(static_cast<std::uint32_t>(head % _capacity));
+            assembleFragments(_fragments, message);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_overwrite->head.load(std::memory_order_relaxed) == head)
+            {
+                break;
+            }
+        }
+
+        unlockConsumer();
+
+        return true;
+    }
+
+    // an open transaction is aborted, so its producer lock never outlives the queue object
+    ~SharedMemoryQueue()
+    {
+        abort();
+    }
+
+    void close()
+    {
+        abort();
+        _memory.close();
+        _stats = nullptr;
+        _latency = nullptr;
+        _overwrite = nullptr;
+        _lockProfiler.reset();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+        LockProfiler::destroy(_memory.name());
+    }
+
+private:
+    // takes the next message off the queue, handing its fragments to consume(fragments)
+    // while the consumer lock is held. In overwrite mode the producer does not wait for
+    // that lock, so the message is copied optimistically: if head moved during consume,
+    // the message was evicted, the copy may be torn, and the next message is tried instead.
+    template <typename Consume>
+    bool dequeueWith(Consume&& consume)
+    {
+        if (_isWriter)
+        {
+            throw std::runtime_error("Cannot dequeue from a writer queue instance.");
+        }
+
+        lockConsumer();
+
+        std::uint32_t readIndex = 0;
+        std::uint32_t slots = 0;
+        std::size_t messageLength = 0;
+        std::uint64_t stamp = 0;
+        for (;;)
+        {
+            if (isEmpty())
+            {
+                if (_stats)
+                {
+                    lsm_sync_detail::addRelaxed(_stats->consumer.emptyRejections, 1);
+                }
+                LSM_PROBE1(queue_empty, _memory.path().c_str());
+                unlockConsumer();
+                return false;
+            }
+
+            const std::uint64_t head = _overwrite ? _overwrite->head.load(std::memory_order_acquire) : 0;
+            readIndex = _overwrite ? static_cast<std::uint32_t>(head % _capacity) : readUInt32(kReadIndexOffset);
+            slots = collectFragments(readIndex);
+            messageLength = 0;
+            for (const std::span<const std::byte>& fragment : _fragments)
+            {
+                messageLength += fragment.size();
+            }
+
+            try
+            {
+                consume(std::span<const std::span<const std::byte>>{_fragments});
+            }
+            catch (...)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_overwrite && _overwrite->head.load(std::memory_order_relaxed) != head)
+                {
+                    continue; // consume saw a torn message
+                }
+                unlockConsumer(); // the message stays queued
+                throw;
+            }
+
+            if (_latency)
+            {
+                const auto memory = static_cast<const char*>(_memory.data());
+                std::memcpy(&stamp, &memory[getMessageOffset(readIndex) + sizeof(std::uint32_t)], kTimestampSize);
+            }
+
+            if (!_overwrite)
+            {
+                // Update read index (circular), past every fragment
+                writeUInt32(kReadIndexOffset, (readIndex + slots) % _capacity);
+                // atomic decrement of count
+                atomicCount().fetch_sub(slots, std::memory_order_release);
+                break;
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::uint64_t expected = head;
+            if (_overwrite->head.compare_exchange_strong(expected, head + slots, std::memory_order_acq_rel,
+                                                         std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        if (_latency)
+        {
+            const std::uint64_t now = lsm_sync_detail::steadyNanoseconds();
+            lsm_sync_detail::recordLatency(*_latency, now > stamp ? now - stamp : 0);
+        }
+
+        if (_stats)
+        {
+            lsm_sync_detail::addRelaxed(_stats->consumer.dequeues, 1);
+            lsm_sync_detail::addRelaxed(_stats->consumer.bytes, messageLength);
+        }
+
+        [[maybe_unused]] const std::uint32_t count = queuedSlots();
+
+        LSM_PROBE4(queue_dequeue, _memory.path().c_str(), readIndex, messageLength, count);
+        unlockConsumer();
+
+        return true;
+    }
+};
+
+// Priority queue
+//
+// A small fixed number of FIFO lanes in one segment, lane 0 first. A dequeue
+// always serves the highest-priority lane holding a message, so a control
+// message sent on lane 0 overtakes any backlog of bulk data on the others.
+// Which lanes hold messages is kept in an occupancy bitmask next to the lock
+// words, so picking the lane is one load and a count-trailing-zeros instead
+// of a scan. Producers and consumers serialize on their own locks as in
+// SharedMemoryQueue.
+// |segment header(16)|lanes(4)|capacity(4)|maxMessageSize(4)|occupancy(4)|producerLock(4)|consumerLock(4)|pad(24)|
+// |lane headers: writeIndex(4) readIndex(4) count(4) pad(4)|slots: [length(4)][data(maxMessageSize)], lane by lane|
+
+class SharedMemoryPriorityQueue
+{
+public:
+    static constexpr std::uint32_t kMaxLanes = 32;
+
+    /**
+     * @brief Create or open a priority queue
+     * @param lanes Number of priority lanes, 1 to kMaxLanes; lane 0 is served first
+     * @param capacity Maximum number of messages per lane
+     * @param isWriter True to create/enqueue, false to open/dequeue
+     */
+    SharedMemoryPriorityQueue(const std::string& name, const std::uint32_t lanes, const std::uint32_t capacity,
+                              const std::uint32_t maxMessageSize, const bool isPersistent, const bool isWriter):
+        _memory(name, segmentSize(lanes, capacity, maxMessageSize), isPersistent),
+        _lanes(lanes),
+        _capacity(capacity),
+        _maxMessageSize(maxMessageSize),
+        _isWriter(isWriter)
+    {
+        if (isWriter)
+        {
+            initialize();
+        }
+        else
+        {
+            attach(_memory.size());
+        }
+    }
+
+    /**
+     * @brief Open an existing priority queue as a reader, taking its parameters from the segment
+     */
+    SharedMemoryPriorityQueue(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent),
+        _isWriter(false)
+    {
+        attach(0);
+    }
+
+    /**
+     * @brief Create or open a priority queue channel of a registry
+     */
+    SharedMemoryPriorityQueue(SharedMemoryRegistry& registry, const std::string& channel, const std::uint32_t lanes,
+                              const std::uint32_t capacity, const std::uint32_t maxMessageSize, const bool isWriter):
+        _memory(isWriter ? registry.allocate(channel, segmentSize(lanes, capacity, maxMessageSize))
+                         : registry.attach(channel)),
+        _lanes(lanes),
+        _capacity(capacity),
+        _maxMessageSize(maxMessageSize),
+        _isWriter(isWriter)
+    {
+        if (isWriter)
+        {
+            initialize();
+        }
+        else
+        {
+            attach(segmentSize(lanes, capacity, maxMessageSize));
+        }
+    }
+
+    /**
+     * @brief Open a priority queue channel of a registry as a reader, taking its parameters from the segment
+     */
+    SharedMemoryPriorityQueue(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel)),
+        _isWriter(false)
+    {
+        attach(0);
+    }
+
+    /**
+     * @brief Enqueue a message on a lane (writer only)
+     * @return true if message was enqueued, false if that lane is full
+     */
+    bool enqueue(const std::uint32_t lane, const std::string_view message)
+    {
+        if (!_isWriter)
+        {
+            throw std::runtime_error("Cannot enqueue from a reader queue instance.");
+        }
+        checkLane(lane);
+        if (message.size() > _maxMessageSize)
+        {
+            throw std::runtime_error("Message exceeds maximum message size.");
+        }
+
+        lsm_sync_detail::acquireSpinLock(atomicAt(kProducerLockOffset));
+        std::atomic<std::uint32_t>& count = atomicAt(laneOffset(lane) + kLaneCount);
+        if (count.load(std::memory_order_acquire) >= _capacity)
+        {
+            lsm_sync_detail::releaseSpinLock(atomicAt(kProducerLockOffset));
+            return false;
+        }
+
+        const std::uint32_t writeIndex = readUInt32(laneOffset(lane) + kLaneWriteIndex);
+        auto memory = static_cast<char*>(_memory.data());
+        const std::size_t offset = messageOffset(lane, writeIndex);
+        const auto messageLength = static_cast<std::uint32_t>(message.size());
+        std::memcpy(&memory[offset], &messageLength, sizeof(messageLength));
+        copyToShared(&memory[offset + sizeof(messageLength)], message.data(), messageLength);
+        writeUInt32(laneOffset(lane) + kLaneWriteIndex, (writeIndex + 1) % _capacity);
+
+        // count first, then the bit: a consumer that empties the lane meanwhile
+        // rechecks the count after clearing the bit. The bit can still land after
+        // that consumer took both messages, so dequeue() trusts the count over it.
+        [[maybe_unused]] const std::uint32_t queued = count.fetch_add(1) + 1;
+        atomicAt(kOccupancyOffset).fetch_or(1u << lane);
+
+        LSM_PROBE4(queue_enqueue, _memory.path().c_str(), writeIndex, messageLength, queued);
+        lsm_sync_detail::releaseSpinLock(atomicAt(kProducerLockOffset));
+        return true;
+    }
+
+    /**
+     * @brief Dequeue the oldest message of the highest-priority non-empty lane (reader only)
+     * @return true if message was dequeued, false if every lane is empty
+     */
+    bool dequeue(std::string& message)
+    {
+        std::uint32_t lane = 0;
+        return dequeue(message, lane);
+    }
+
+    /**
+     * @brief Dequeue as above and report the lane the message came from
+     */
+    bool dequeue(std::string& message, std::uint32_t& lane)
+    {
+        if (_isWriter)
+        {
+            throw std::runtime_error("Cannot dequeue from a writer queue instance.");
+        }
+
+        lsm_sync_detail::acquireSpinLock(atomicAt(kConsumerLockOffset));
+        std::atomic<std::uint32_t>& occupancy = atomicAt(kOccupancyOffset);
+        std::uint32_t lanes = occupancy.load(std::memory_order_acquire);
+        while (lanes != 0)
+        {
+            lane = static_cast<std::uint32_t>(std::countr_zero(lanes));
+            if (atomicAt(laneOffset(lane) + kLaneCount).load(std::memory_order_acquire) != 0)
+            {
+                break;
+            }
+            // stale bit of an empty lane: clear it unless a message arrived meanwhile
+            occupancy.fetch_and(~(1u << lane));
+            if (atomicAt(laneOffset(lane) + kLaneCount).load() != 0)
+            {
+                occupancy.fetch_or(1u << lane);
+                break;
+            }
+            lanes &= ~(1u << lane);
+        }
+        if (lanes == 0)
+        {
+            LSM_PROBE1(queue_empty, _memory.path().c_str());
+            lsm_sync_detail::releaseSpinLock(atomicAt(kConsumerLockOffset));
+            return false;
+        }
+
+        const std::uint32_t readIndex = readUInt32(laneOffset(lane) + kLaneReadIndex);
+        const auto memory = static_cast<const char*>(_memory.data());
+        const std::size_t offset = messageOffset(lane, readIndex);
+        std::uint32_t messageLength = 0;
+        std::memcpy(&messageLength, &memory[offset], sizeof(messageLength));
+        assignFromShared(message, &memory[offset + sizeof(messageLength)], messageLength);
+        writeUInt32(laneOffset(lane) + kLaneReadIndex, (readIndex + 1) % _capacity);
+
+        // only consumers take messages out, so a lane whose count is still
+        // non-zero after its bit was cleared got a message in the meantime
+        std::atomic<std::uint32_t>& count = atomicAt(laneOffset(lane) + kLaneCount);
+        const std::uint32_t remaining = count.fetch_sub(1) - 1;
+        if (remaining == 0)
+        {
+            occupancy.fetch_and(~(1u << lane));
+            if (count.load() != 0)
+            {
+                occupancy.fetch_or(1u << lane);
+            }
+        }
+
+        LSM_PROBE4(queue_dequeue, _memory.path().c_str(), readIndex, messageLength, remaining);
+        lsm_sync_detail::releaseSpinLock(atomicAt(kConsumerLockOffset));
+        return true;
+    }
+
+    // bit i is set while lane i holds a message; a racing producer can leave
+    // the bit of an emptied lane set until the next dequeue() clears it
+    [[nodiscard]] std::uint32_t occupancy() const noexcept
+    {
+        return atomicAt(kOccupancyOffset).load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool isEmpty() const noexcept
+    {
+        return occupancy() == 0;
+    }
+
+    // messages waiting on one lane
+    [[nodiscard]] std::uint32_t size(const std::uint32_t lane) const
+    {
+        return atomicAt(laneOffset(checkLane(lane)) + kLaneCount).load(std::memory_order_acquire);
+    }
+
+    // messages waiting on all lanes
+    [[nodiscard]] std::uint32_t size() const noexcept
+    {
+        std::uint32_t total = 0;
+        for (std::uint32_t lane = 0; lane < _lanes; ++lane)
+        {
+            total += atomicAt(laneOffset(lane) + kLaneCount).load(std::memory_order_acquire);
+        }
+        return total;
+    }
+
+    [[nodiscard]] std::uint32_t lanes() const noexcept
+    {
+        return _lanes;
+    }
+
+    // capacity of each lane
+    [[nodiscard]] std::uint32_t capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    [[nodiscard]] std::uint32_t maxMessageSize() const noexcept
+    {
+        return _maxMessageSize;
+    }
+
+    void close()
+    {
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kLanesOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kCapacityOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kMaxMessageSizeOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kOccupancyOffset = segmentHeaderSize + 12;
+    static constexpr std::size_t kProducerLockOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kConsumerLockOffset = segmentHeaderSize + 20;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    // fields of a lane header
+    static constexpr std::size_t kLaneWriteIndex = 0;
+    static constexpr std::size_t kLaneReadIndex = 4;
+    static constexpr std::size_t kLaneCount = 8;
+    static constexpr std::size_t kLaneHeaderSize = 16;
+
+    Memory _memory;
+    std::uint32_t _lanes = 0;
+    std::uint32_t _capacity = 0;
+    std::uint32_t _maxMessageSize = 0;
+    bool _isWriter;
+
+    [[nodiscard]] static std::size_t segmentSize(const std::uint32_t lanes, const std::uint32_t capacity,
+                                                 const std::uint32_t maxMessageSize)
     {
-        auto memory = static_cast<char*>(_memory.data());
-        std::memcpy(&memory[offset], &value, sizeof(std::uint32_t));
+        if (lanes == 0 || lanes > kMaxLanes)
+        {
+            throw std::runtime_error("Priority queues have 1 to 32 lanes.");
+        }
+        if (capacity == 0)
+        {
+            throw std::runtime_error("Priority queue lanes need a capacity of at least one message.");
+        }
+        return kHeaderSize + lanes * kLaneHeaderSize
+               + static_cast<std::size_t>(lanes) * capacity * (sizeof(std::uint32_t) + maxMessageSize);
     }
 
-    [[nodiscard]] std::size_t getMessageOffset(std::uint32_t index) const noexcept
+    [[nodiscard]] static std::size_t laneOffset(const std::uint32_t lane) noexcept
     {
-        // Each slot contains: [length(4)][data(maxMessageSize)]
-        return kHeaderSize + index * (_maxMessageSize + sizeof(std::uint32_t));
+        return kHeaderSize + lane * kLaneHeaderSize;
     }
 
-    // Helper to access atomic count field in shared memory
-    [[nodiscard]] std::atomic<std::uint32_t>& atomicCount() const noexcept
+    [[nodiscard]] std::size_t messageOffset(const std::uint32_t lane, const std::uint32_t index) const noexcept
     {
-        auto memory = static_cast<char*>(_memory.data());
-        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kCountOffset]);
+        const std::size_t slot = static_cast<std::size_t>(lane) * _capacity + index;
+        return kHeaderSize + _lanes * kLaneHeaderSize + slot * (sizeof(std::uint32_t) + _maxMessageSize);
     }
 
-    [[nodiscard]] std::atomic<std::uint32_t>& atomicProducerLock() const noexcept
+    std::uint32_t checkLane(const std::uint32_t lane) const
     {
-        auto memory = static_cast<char*>(_memory.data());
-        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kProducerLockOffset]);
+        if (lane >= _lanes)
+        {
+            throw std::runtime_error("Priority queue lane is out of range.");
+        }
+        return lane;
     }
 
-    [[nodiscard]] std::atomic<std::uint32_t>& atomicConsumerLock() const noexcept
+    [[nodiscard]] std::atomic<std::uint32_t>& atomicAt(const std::size_t offset) const noexcept
     {
-        auto memory = static_cast<char*>(_memory.data());
-        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&memory[kConsumerLockOffset]);
+        return *reinterpret_cast<std::atomic<std::uint32_t>*>(&static_cast<char*>(_memory.data())[offset]);
     }
 
-    void lockProducer() const noexcept
+    [[nodiscard]] std::uint32_t readUInt32(const std::size_t offset) const noexcept
     {
-        std::uint32_t expected = 0;
-        while (!atomicProducerLock().compare_exchange_weak(
-                   expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
-        {
-            expected = 0;
-            std::this_thread::yield();
-        }
+        std::uint32_t value = 0;
+        std::memcpy(&value, &static_cast<const char*>(_memory.data())[offset], sizeof(value));
+        return value;
     }
 
-    void unlockProducer() const noexcept
+    void writeUInt32(const std::size_t offset, const std::uint32_t value) const noexcept
     {
-        atomicProducerLock().store(0, std::memory_order_release);
+        std::memcpy(&static_cast<char*>(_memory.data())[offset], &value, sizeof(value));
     }
 
-    void lockConsumer() const noexcept
+    void initialize()
     {
-        std::uint32_t expected = 0;
-        while (!atomicConsumerLock().compare_exchange_weak(
-                   expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+        if (_memory.create() != Error::OK)
         {
-            expected = 0;
-            std::this_thread::yield();
+            throw std::runtime_error("Shared memory priority queue could not be created.");
+        }
+        auto memory = static_cast<char*>(_memory.data());
+        writeUInt32(kLanesOffset, _lanes);
+        writeUInt32(kCapacityOffset, _capacity);
+        writeUInt32(kMaxMessageSizeOffset, _maxMessageSize);
+        new (&memory[kOccupancyOffset]) std::atomic<std::uint32_t>(0);
+        new (&memory[kProducerLockOffset]) std::atomic<std::uint32_t>(0);
+        new (&memory[kConsumerLockOffset]) std::atomic<std::uint32_t>(0);
+        for (std::uint32_t lane = 0; lane < _lanes; ++lane)
+        {
+            writeUInt32(laneOffset(lane) + kLaneWriteIndex, 0);
+            writeUInt32(laneOffset(lane) + kLaneReadIndex, 0);
+            new (&memory[laneOffset(lane) + kLaneCount]) std::atomic<std::uint32_t>(0);
         }
+        writeSegmentHeader(_memory, SegmentType::PriorityQueue);
     }
 
-    void unlockConsumer() const noexcept
+    // expectedSize is 0 to adopt the segment's parameters
+    void attach(const std::size_t expectedSize)
     {
-        atomicConsumerLock().store(0, std::memory_order_release);
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory priority queue could not be opened.");
+        }
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::PriorityQueue, 0);
+        _lanes = readUInt32(kLanesOffset);
+        _capacity = readUInt32(kCapacityOffset);
+        _maxMessageSize = readUInt32(kMaxMessageSizeOffset);
+        if (_lanes == 0 || _lanes > kMaxLanes || _capacity == 0
+            || size != segmentSize(_lanes, _capacity, _maxMessageSize))
+        {
+            throw std::runtime_error("Shared memory priority queue has a corrupt header.");
+        }
+        if (expectedSize != 0 && size != expectedSize)
+        {
+            throw std::runtime_error("Lanes, capacity or message size do not match the shared memory priority queue.");
+        }
     }
+};
 
+// Conflating queue
+//
+// A FIFO of keyed messages holding at most one pending message per key.
+// Enqueuing a key that is already pending replaces that message's payload in
+// place and keeps its position, so after a backlog a consumer handles one
+// message per distinct key (the latest for each) rather than every update.
+// Pending keys are found through an open-addressing index of slot numbers,
+// sized at twice the capacity and kept free of tombstones by backward-shift
+// deletion. Producers and consumers both touch the index, so they share one
+// lock.
+// |segment header(16)|capacity(4)|maxMessageSize(4)|writeIndex(4)|readIndex(4)|count(4)|lock(4)|conflated(8)|pad(16)|
+// |index: slot + 1 per bucket, 0 when empty|slots: [key(8)][length(4)][pad(4)][data(maxMessageSize)]|
+
+class SharedMemoryConflatingQueue
+{
 public:
     /**
-     * @brief Create or open a shared memory queue
-     * @param name Queue name
-     * @param capacity Maximum number of messages in queue
-     * @param maxMessageSize Maximum size of each message in bytes
-     * @param isPersistent Whether the queue persists after process exit
-     * @param isWriter True to create/write, false to open/read
+     * @brief Create or open a conflating queue
+     * @param capacity Maximum number of pending keys
+     * @param isWriter True to create/enqueue, false to open/dequeue
      */
-    SharedMemoryQueue(const std::string& name, std::uint32_t capacity,
-                      std::uint32_t maxMessageSize, bool isPersistent, bool isWriter)
-        : _memory(name, kHeaderSize + capacity * (maxMessageSize + sizeof(std::uint32_t)), isPersistent)
-        , _capacity(capacity)
-        , _maxMessageSize(maxMessageSize)
-        , _isWriter(isWriter)
+    SharedMemoryConflatingQueue(const std::string& name, const std::uint32_t capacity,
+                                const std::uint32_t maxMessageSize, const bool isPersistent, const bool isWriter):
+        _memory(name, segmentSize(capacity, maxMessageSize), isPersistent),
+        _capacity(capacity),
+        _maxMessageSize(maxMessageSize),
+        _isWriter(isWriter)
     {
         if (isWriter)
         {
-            if (_memory.create() != Error::OK)
-            {
-                throw std::runtime_error("Shared memory queue could not be created.");
-            }
-
-            // Initialize queue metadata
-            writeUInt32(kWriteIndexOffset, 0);
-            writeUInt32(kReadIndexOffset, 0);
-            writeUInt32(kCapacityOffset, capacity);
-            // construct atomic count with placement new to ensure proper atomic object initialization
-            auto memory = static_cast<char*>(_memory.data());
-            new (&memory[kCountOffset]) std::atomic<std::uint32_t>(0);
-            writeUInt32(kMaxMessageSizeOffset, maxMessageSize);
-            new (&memory[kProducerLockOffset]) std::atomic<std::uint32_t>(0);
-            new (&memory[kConsumerLockOffset]) std::atomic<std::uint32_t>(0);
+            initialize();
         }
         else
         {
-            if (_memory.open() != Error::OK)
-            {
-                throw std::runtime_error("Shared memory queue could not be opened.");
-            }
-
-            // Read queue metadata
-            _capacity = readUInt32(kCapacityOffset);
-            _maxMessageSize = readUInt32(kMaxMessageSizeOffset);
+            attach(_memory.size());
         }
     }
 
-    [[nodiscard]] bool isEmpty() const noexcept
-    {
-        return atomicCount().load(std::memory_order_acquire) == 0;
-    }
-
-    [[nodiscard]] bool isFull() const noexcept
+    /**
+     * @brief Open an existing conflating queue as a reader, taking its parameters from the segment
+     */
+    SharedMemoryConflatingQueue(const std::string& name, const bool isPersistent):
+        _memory(name, 0, isPersistent),
+        _isWriter(false)
     {
-        return atomicCount().load(std::memory_order_acquire) >= _capacity;
+        attach(0);
     }
 
-    [[nodiscard]] std::uint32_t size() const noexcept
+    /**
+     * @brief Create or open a conflating queue channel of a registry
+     */
+    SharedMemoryConflatingQueue(SharedMemoryRegistry& registry, const std::string& channel,
+                                const std::uint32_t capacity, const std::uint32_t maxMessageSize,
+                                const bool isWriter):
+        _memory(isWriter ? registry.allocate(channel, segmentSize(capacity, maxMessageSize))
+                         : registry.attach(channel)),
+        _capacity(capacity),
+        _maxMessageSize(maxMessageSize),
+        _isWriter(isWriter)
     {
-        return atomicCount().load(std::memory_order_acquire);
+        if (isWriter)
+        {
+            initialize();
+        }
+        else
+        {
+            attach(segmentSize(capacity, maxMessageSize));
+        }
     }
 
-    [[nodiscard]] std::uint32_t capacity() const noexcept
+    /**
+     * @brief Open a conflating queue channel of a registry as a reader, taking its parameters from the segment
+     */
+    SharedMemoryConflatingQueue(const SharedMemoryRegistry& registry, const std::string& channel):
+        _memory(registry.attach(channel)),
+        _isWriter(false)
     {
-        return _capacity;
+        attach(0);
     }
 
     /**
-     * @brief Enqueue a message (writer only)
-     * @param message Message to enqueue
-     * @return true if message was enqueued, false if queue is full
+     * @brief Enqueue the latest message for key (writer only)
+     * If key is already pending, its payload is replaced and it keeps its place.
+     * @return true if message was enqueued or conflated, false if key is new and the queue is full
      */
-    bool enqueue(std::string_view message)
+    bool enqueue(const std::uint64_t key, const std::string_view message)
     {
         if (!_isWriter)
         {
             throw std::runtime_error("Cannot enqueue from a reader queue instance.");
         }
-
         if (message.size() > _maxMessageSize)
         {
             throw std::runtime_error("Message exceeds maximum message size.");
         }
 
-        lockProducer();
-
-        if (isFull())
+        lsm_sync_detail::acquireSpinLock(atomicAt<std::uint32_t>(kLockOffset));
+        const std::size_t bucket = findBucket(key);
+        std::uint32_t slot = readUInt32(bucketOffset(bucket));
+        if (slot != 0)
         {
-            unlockProducer();
+            --slot;
+            lsm_sync_detail::addRelaxed(atomicAt<std::uint64_t>(kConflatedOffset), 1);
+        }
+        else if (atomicAt<std::uint32_t>(kCountOffset).load(std::memory_order_relaxed) >= _capacity)
+        {
+            LSM_PROBE1(queue_full, _memory.path().c_str());
+            lsm_sync_detail::releaseSpinLock(atomicAt<std::uint32_t>(kLockOffset));
             return false;
         }
+        else
+        {
+            slot = readUInt32(kWriteIndexOffset);
+            writeUInt32(kWriteIndexOffset, (slot + 1) % _capacity);
+            writeUInt32(bucketOffset(bucket), slot + 1);
+            std::memcpy(&bytes()[slotOffset(slot)], &key, sizeof(key));
+            atomicAt<std::uint32_t>(kCountOffset).fetch_add(1, std::memory_order_release);
+        }
 
-        const std::uint32_t writeIndex = readUInt32(kWriteIndexOffset);
-        const std::size_t offset = getMessageOffset(writeIndex);
-
-        auto memory = static_cast<char*>(_memory.data());
-
-        // Write message length
         const auto messageLength = static_cast<std::uint32_t>(message.size());
-        std::memcpy(&memory[offset], &messageLength, sizeof(std::uint32_t));
-
-        // Write message data
-        std::memcpy(&memory[offset + sizeof(std::uint32_t)], message.data(), messageLength);
-
-        // Update write index (circular)
-        const std::uint32_t newWriteIndex = (writeIndex + 1) % _capacity;
-        writeUInt32(kWriteIndexOffset, newWriteIndex);
-
-        // atomic increment of count
-        atomicCount().fetch_add(1, std::memory_order_release);
-
-        unlockProducer();
+        std::memcpy(&bytes()[slotOffset(slot) + kSlotLength], &messageLength, sizeof(messageLength));
+        copyToShared(&bytes()[slotOffset(slot) + kSlotHeaderSize], message.data(), messageLength);
 
+        LSM_PROBE4(queue_enqueue, _memory.path().c_str(), slot, messageLength, size());
+        lsm_sync_detail::releaseSpinLock(atomicAt<std::uint32_t>(kLockOffset));
         return true;
     }
 
     /**
-     * @brief Dequeue a message (reader only)
-     * @param message Output parameter for dequeued message
+     * @brief Dequeue the oldest pending key and its latest message (reader only)
      * @return true if message was dequeued, false if queue is empty
      */
-    bool dequeue(std::string& message)
+    bool dequeue(std::uint64_t& key, std::string& message)
     {
         if (_isWriter)
         {
             throw std::runtime_error("Cannot dequeue from a writer queue instance.");
         }
 
-        lockConsumer();
-
-        if (isEmpty())
+        lsm_sync_detail::acquireSpinLock(atomicAt<std::uint32_t>(kLockOffset));
+        if (atomicAt<std::uint32_t>(kCountOffset).load(std::memory_order_relaxed) == 0)
         {
-            unlockConsumer();
+            LSM_PROBE1(queue_empty, _memory.path().c_str());
+            lsm_sync_detail::releaseSpinLock(atomicAt<std::uint32_t>(kLockOffset));
             return false;
         }
 
-        const std::uint32_t readIndex = readUInt32(kReadIndexOffset);
-        const std::size_t offset = getMessageOffset(readIndex);
+        const std::uint32_t slot = readUInt32(kReadIndexOffset);
+        std::uint32_t messageLength = 0;
+        std::memcpy(&key, &bytes()[slotOffset(slot)], sizeof(key));
+        std::memcpy(&messageLength, &bytes()[slotOffset(slot) + kSlotLength], sizeof(messageLength));
+        assignFromShared(message, &bytes()[slotOffset(slot) + kSlotHeaderSize], messageLength);
 
-        const auto memory = static_cast<const char*>(_memory.data());
+        eraseBucket(findBucket(key));
+        writeUInt32(kReadIndexOffset, (slot + 1) % _capacity);
+        [[maybe_unused]] const std::uint32_t count = atomicAt<std::uint32_t>(kCountOffset).fetch_sub(1, std::memory_order_release) - 1;
 
-        // Read message length
-        std::uint32_t messageLength = 0;
-        std::memcpy(&messageLength, &memory[offset], sizeof(std::uint32_t));
+        LSM_PROBE4(queue_dequeue, _memory.path().c_str(), slot, messageLength, count);
+        lsm_sync_detail::releaseSpinLock(atomicAt<std::uint32_t>(kLockOffset));
+        return true;
+    }
 
-        // Read message data
-        message.resize(messageLength);
-        std::memcpy(&message[0], &memory[offset + sizeof(std::uint32_t)], messageLength);
+    // pending keys
+    [[nodiscard]] std::uint32_t size() const noexcept
+    {
+        return atomicAt<std::uint32_t>(kCountOffset).load(std::memory_order_acquire);
+    }
 
-        // Update read index (circular)
-        const std::uint32_t newReadIndex = (readIndex + 1) % _capacity;
-        writeUInt32(kReadIndexOffset, newReadIndex);
+    [[nodiscard]] bool isEmpty() const noexcept
+    {
+        return size() == 0;
+    }
 
-        // atomic decrement of count
-        atomicCount().fetch_sub(1, std::memory_order_release);
+    // updates that replaced a pending message instead of adding one, since the queue was created
+    [[nodiscard]] std::uint64_t conflated() const noexcept
+    {
+        return atomicAt<std::uint64_t>(kConflatedOffset).load(std::memory_order_relaxed);
+    }
 
-        unlockConsumer();
+    [[nodiscard]] std::uint32_t capacity() const noexcept
+    {
+        return _capacity;
+    }
 
-        return true;
+    [[nodiscard]] std::uint32_t maxMessageSize() const noexcept
+    {
+        return _maxMessageSize;
     }
 
-    /**
-     * @brief Peek at the next message without dequeuing (reader only)
-     * @param message Output parameter for peeked message
-     * @return true if message was peeked, false if queue is empty
-     */
-    bool peek(std::string& message) const
+    void close()
     {
-        if (_isWriter)
+        _memory.close();
+    }
+
+    void destroy() const
+    {
+        _memory.destroy();
+    }
+
+private:
+    static constexpr std::size_t kCapacityOffset = segmentHeaderSize + 0;
+    static constexpr std::size_t kMaxMessageSizeOffset = segmentHeaderSize + 4;
+    static constexpr std::size_t kWriteIndexOffset = segmentHeaderSize + 8;
+    static constexpr std::size_t kReadIndexOffset = segmentHeaderSize + 12;
+    static constexpr std::size_t kCountOffset = segmentHeaderSize + 16;
+    static constexpr std::size_t kLockOffset = segmentHeaderSize + 20;
+    static constexpr std::size_t kConflatedOffset = segmentHeaderSize + 24;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    // fields of a slot
+    static constexpr std::size_t kSlotLength = 8;
+    static constexpr std::size_t kSlotHeaderSize = 16;
+
+    Memory _memory;
+    std::uint32_t _capacity = 0;
+    std::uint32_t _maxMessageSize = 0;
+    bool _isWriter;
+
+    [[nodiscard]] static std::size_t bucketCount(const std::uint32_t capacity) noexcept
+    {
+        return std::bit_ceil(static_cast<std::size_t>(capacity) * 2);
+    }
+
+    [[nodiscard]] static std::size_t slotStride(const std::uint32_t maxMessageSize) noexcept
+    {
+        return (kSlotHeaderSize + maxMessageSize + 7) & ~std::size_t{7};
+    }
+
+    [[nodiscard]] static std::size_t slotsOffset(const std::uint32_t capacity) noexcept
+    {
+        return kHeaderSize + ((bucketCount(capacity) * sizeof(std::uint32_t) + 63) & ~std::size_t{63});
+    }
+
+    [[nodiscard]] static std::size_t segmentSize(const std::uint32_t capacity, const std::uint32_t maxMessageSize)
+    {
+        if (capacity == 0 || capacity > (1u << 30))
         {
-            throw std::runtime_error("Cannot peek from a writer queue instance.");
+            throw std::runtime_error("Conflating queue capacity must be between 1 and 2^30.");
         }
+        return slotsOffset(capacity) + capacity * slotStride(maxMessageSize);
+    }
 
-        lockConsumer();
+    [[nodiscard]] char* bytes() const noexcept
+    {
+        return static_cast<char*>(_memory.data());
+    }
+
+    template <typename T>
+    [[nodiscard]] std::atomic<T>& atomicAt(const std::size_t offset) const noexcept
+    {
+        return *reinterpret_cast<std::atomic<T>*>(&bytes()[offset]);
+    }
+
+    [[nodiscard]] std::uint32_t readUInt32(const std::size_t offset) const noexcept
+    {
+        std::uint32_t value = 0;
+        std::memcpy(&value, &bytes()[offset], sizeof(value));
+        return value;
+    }
+
+    void writeUInt32(const std::size_t offset, const std::uint32_t value) const noexcept
+    {
+        std::memcpy(&bytes()[offset], &value, sizeof(value));
+    }
+
+    [[nodiscard]] std::size_t slotOffset(const std::uint32_t slot) const noexcept
+    {
+        return slotsOffset(_capacity) + slot * slotStride(_maxMessageSize);
+    }
+
+    [[nodiscard]] static std::size_t bucketOffset(const std::size_t bucket) noexcept
+    {
+        return kHeaderSize + bucket * sizeof(std::uint32_t);
+    }
+
+    [[nodiscard]] std::uint64_t slotKey(const std::uint32_t slot) const noexcept
+    {
+        std::uint64_t key = 0;
+        std::memcpy(&key, &bytes()[slotOffset(slot)], sizeof(key));
+        return key;
+    }
+
+    [[nodiscard]] std::size_t homeBucket(const std::uint64_t key) const noexcept
+    {
+        return SharedHash<std::uint64_t>{}(key) & (bucketCount(_capacity) - 1);
+    }
 
-        if (isEmpty())
+    // the bucket naming key's slot, or the empty bucket where it would go; the
+    // index is at most half full, so the probe always ends
+    [[nodiscard]] std::size_t findBucket(const std::uint64_t key) const noexcept
+    {
+        const std::size_t mask = bucketCount(_capacity) - 1;
+        std::size_t bucket = homeBucket(key);
+        while (true)
         {
-            unlockConsumer();
-            return false;
+            const std::uint32_t slot = readUInt32(bucketOffset(bucket));
+            if (slot == 0 || slotKey(slot - 1) == key)
+            {
+                return bucket;
+            }
+            bucket = (bucket + 1) & mask;
         }
+    }
 
-        const std::uint32_t readIndex = readUInt32(kReadIndexOffset);
-        const std::size_t offset = getMessageOffset(readIndex);
+    // empties a bucket and shifts later entries of its probe run back, so lookups never need tombstones
+    void eraseBucket(std::size_t hole) const noexcept
+    {
+        const std::size_t mask = bucketCount(_capacity) - 1;
+        std::size_t next = hole;
+        while (true)
+        {
+            next = (next + 1) & mask;
+            const std::uint32_t slot = readUInt32(bucketOffset(next));
+            if (slot == 0)
+            {
+                break;
+            }
+            // an entry may fill the hole unless its home lies cyclically in (hole, next]
+            const std::size_t home = homeBucket(slotKey(slot - 1));
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                writeUInt32(bucketOffset(hole), slot);
+                hole = next;
+            }
+        }
+        writeUInt32(bucketOffset(hole), 0);
+    }
 
-        const auto memory = static_cast<const char*>(_memory.data());
+    void initialize()
+    {
+        if (_memory.create() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory conflating queue could not be created.");
+        }
+        // the mapping is zero-filled: indices, count, lock and an empty index
+        writeUInt32(kCapacityOffset, _capacity);
+        writeUInt32(kMaxMessageSizeOffset, _maxMessageSize);
+        new (&bytes()[kCountOffset]) std::atomic<std::uint32_t>(0);
+        new (&bytes()[kLockOffset]) std::atomic<std::uint32_t>(0);
+        new (&bytes()[kConflatedOffset]) std::atomic<std::uint64_t>(0);
+        writeSegmentHeader(_memory, SegmentType::ConflatingQueue);
+    }
 
-        // Read message length
-        std::uint32_t messageLength = 0;
-        std::memcpy(&messageLength, &memory[offset], sizeof(std::uint32_t));
+    // expectedSize is 0 to adopt the segment's parameters
+    void attach(const std::size_t expectedSize)
+    {
+        if (_memory.open() != Error::OK)
+        {
+            throw std::runtime_error("Shared memory conflating queue could not be opened.");
+        }
+        const std::size_t size = checkSegmentHeader(_memory, SegmentType::ConflatingQueue, 0);
+        _capacity = readUInt32(kCapacityOffset);
+        _maxMessageSize = readUInt32(kMaxMessageSizeOffset);
+        if (_capacity == 0 || _capacity > (1u << 30) || size != segmentSize(_capacity, _maxMessageSize))
+        {
+            throw std::runtime_error("Shared memory conflating queue has a corrupt header.");
+        }
+        if (expectedSize != 0 && size != expectedSize)
+        {
+            throw std::runtime_error("Capacity or message size does not match the shared memory conflating queue.");
+        }
+    }
+};
 
-        // Read message data
-        message.resize(messageLength);
-        std::memcpy(&message[0], &memory[offset + sizeof(std::uint32_t)], messageLength);
+// Inspection
+//
+// inspectStream() and inspectQueue() decode a mapped segment without taking
+// any of its locks, so they work on a read-only mapping (Memory::openReadOnly)
+// and never stall the processes using the segment. Fields are loaded one by
+// one and may be off by an operation relative to each other.
 
-        unlockConsumer();
+/**
+ * @brief Lock-free view of a stream segment's metadata, see inspectStream()
+ */
+struct StreamSnapshot
+{
+    std::size_t segmentSize = 0; // buffer size the writer created the stream with
+    std::uint8_t dataType = 0; // kMemoryType* of the current payload, 0 before the first write
+    std::uint32_t revision = 0;
+    std::uint32_t ack = 0;
+    std::uint32_t payloadSize = 0;
+    std::size_t dataCapacity = 0;
+    std::size_t dirtyBlockSize = 0; // 0 when dirty tracking is off
+    std::uint32_t lockHolder = 0; // process id, 0 when free
+    std::optional<StreamStatistics> statistics;
+
+    // writes the reader has not acknowledged yet
+    [[nodiscard]] std::uint32_t ackLag() const noexcept
+    {
+        return revision - ack;
+    }
+};
 
-        return true;
+[[nodiscard]] inline StreamSnapshot inspectStream(const Memory& memory)
+{
+    if (!memory.data() || memory.size() < dataOffset)
+    {
+        throw std::runtime_error("Mapping is too small for a stream header.");
     }
 
-    void close()
+    const auto base = static_cast<const char*>(memory.data());
+    const auto load = [base](const std::size_t offset) {
+        return reinterpret_cast<const std::atomic<std::uint32_t>*>(&base[offset])->load(std::memory_order_acquire);
+    };
+
+    const std::size_t segmentSize = checkSegmentHeader(memory, SegmentType::Stream, 0);
+    const auto dirtyShift = static_cast<std::uint8_t>(base[dirtyShiftOffset]);
+    const StreamLayout layout = computeStreamLayout(segmentSize, dirtyShift,
+                                                    static_cast<std::uint8_t>(base[featureFlagsOffset]));
+
+    StreamSnapshot snapshot;
+    snapshot.segmentSize = segmentSize;
+    snapshot.dataType = static_cast<std::uint8_t>(base[flagsOffset] & ~kMemoryChanged);
+    snapshot.revision = load(revisionOffset);
+    snapshot.ack = load(ackOffset);
+    snapshot.payloadSize = load(sizeOffset);
+    snapshot.dataCapacity = layout.dataCapacity;
+    snapshot.dirtyBlockSize = dirtyShift ? std::size_t{1} << dirtyShift : 0;
+    snapshot.lockHolder = load(lockOffset);
+    if (layout.statsOffset != 0)
     {
-        _memory.close();
+        snapshot.statistics = snapshotStatistics(*reinterpret_cast<const StreamStatsBlock*>(&base[layout.statsOffset]));
     }
+    return snapshot;
+}
 
-    void destroy() const
+/**
+ * @brief Decodes a queue segment
+ * A mapping of only the header is enough to learn segmentSize; statistics
+ * and latency are filled in once the mapping covers the whole segment.
+ */
+[[nodiscard]] inline QueueSnapshot inspectQueue(const Memory& memory)
+{
+    using Q = SharedMemoryQueue;
+    if (!memory.data() || memory.size() < Q::kHeaderSize)
     {
-        _memory.destroy();
+        throw std::runtime_error("Mapping is too small for a queue header.");
     }
-};
+
+    // the size check of checkSegmentHeader() does not apply: a header-only mapping is fine here
+    const std::optional<SegmentDescriptor> descriptor = readSegmentHeader(memory);
+    if (!descriptor || descriptor->version != kSegmentVersion || descriptor->type != SegmentType::Queue)
+    {
+        throw std::runtime_error("Shared memory segment is not a queue.");
+    }
+
+    const auto base = static_cast<const char*>(memory.data());
+    const auto load = [base](const std::size_t offset) {
+        return reinterpret_cast<const std::atomic<std::uint32_t>*>(&base[offset])->load(std::memory_order_acquire);
+    };
+
+    QueueSnapshot snapshot;
+    snapshot.capacity = load(Q::kCapacityOffset);
+    snapshot.maxMessageSize = load(Q::kMaxMessageSizeOffset);
+    snapshot.count = load(Q::kCountOffset);
+    snapshot.writeIndex = load(Q::kWriteIndexOffset);
+    snapshot.readIndex = load(Q::kReadIndexOffset);
+    snapshot.producerLockHolder = load(Q::kProducerLockOffset);
+    snapshot.consumerLockHolder = load(Q::kConsumerLockOffset);
+    snapshot.features = load(Q::kFeaturesOffset);
+    snapshot.segmentSize = descriptor->size;
+
+    if (memory.size() >= snapshot.segmentSize)
+    {
+        if (snapshot.features & Q::kFeatureStatistics)
+        {
+            const std::size_t offset = Q::statsOffset(snapshot.capacity, snapshot.maxMessageSize, snapshot.features);
+            snapshot.statistics = snapshotStatistics(*reinterpret_cast<const QueueStatsBlock*>(&base[offset]));
+        }
+        if (snapshot.features & Q::kFeatureTimestamps)
+        {
+            const std::size_t offset = Q::latencyOffset(snapshot.capacity, snapshot.maxMessageSize, snapshot.features);
+            snapshot.latency = snapshotHistogram(*reinterpret_cast<const LatencyHistogramBlock*>(&base[offset]));
+        }
+        if (snapshot.features & Q::kFeatureOverwrite)
+        {
+            const std::size_t offset = Q::overwriteOffset(snapshot.capacity, snapshot.maxMessageSize, snapshot.features);
+            const auto& positions = *reinterpret_cast<const QueueOverwriteBlock*>(&base[offset]);
+            snapshot.dropped = positions.dropped.load(std::memory_order_relaxed);
+            const std::uint64_t head = positions.head.load(std::memory_order_acquire);
+            const std::uint64_t tail = positions.tail.load(std::memory_order_acquire);
+            snapshot.count = static_cast<std::uint32_t>(std::min<std::uint64_t>(tail - head, snapshot.capacity));
+            snapshot.readIndex = snapshot.capacity ? static_cast<std::uint32_t>(head % snapshot.capacity) : 0;
+        }
+    }
+    return snapshot;
+}
 
 }; // namespace lsm
+
+// internal to the copy kernels; keep them out of includers
+#undef LSM_TARGET_AVX512
+#undef LSM_TARGET_AVX2
+#undef LSM_COPY_X86
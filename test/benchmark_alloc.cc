@@ -0,0 +1,231 @@
+// Shared allocator throughput benchmark.
+//
+// Compares SharedAllocator::allocate()/deallocate() with malloc()/free() for
+// several block sizes and thread counts. Each thread of the shared allocator
+// scenarios maps the segment on its own, as separate processes would. Two
+// patterns are measured: "pair" frees every block right after allocating it
+// (the free-list fast path), "batch" allocates 256 blocks and then frees them
+// all (slab refills and longer free lists). Every block is written to once so
+// malloc cannot skip the allocation.
+//
+// Usage: lsm_bench_alloc [--ops N] [--perf] [--perf-hitm RAWCONFIG]
+//                        [--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include "benchmark_report.hpp"
+#include "perf_counters.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lsm;
+using lsm_bench::MetricKind;
+using lsm_bench::PerfCounters;
+using lsm_bench::PerfSample;
+using lsm_bench::Record;
+
+namespace {
+
+constexpr const char *kSegmentName = "bench_alloc_heap";
+constexpr std::size_t kSegmentSize = std::size_t{256} << 20;
+constexpr std::size_t kBatch = 256;
+
+struct Options {
+    std::size_t opsPerThread = 1000000;
+};
+
+Options parseOptions(const int argc, char *argv[], lsm_bench::Reporter &reporter, PerfCounters &perf) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (reporter.parseArgument(i, argc, argv) || perf.parseArgument(i, argc, argv)) {
+            continue;
+        } else if (arg == "--ops" && hasValue) {
+            options.opsPerThread = static_cast<std::size_t>(std::stoull(argv[++i]));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--ops N] " << PerfCounters::usage() << " "
+                      << lsm_bench::Reporter::usage() << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+enum class Pattern { Pair, Batch };
+
+const char *patternName(const Pattern pattern) {
+    return pattern == Pattern::Pair ? "pair" : "batch";
+}
+
+// malloc/free behind the same interface as SharedAllocator
+struct SystemHeap {
+    void *allocate(const std::size_t size) { return std::malloc(size); }
+    void deallocate(void *block, std::size_t) { std::free(block); }
+    static void touch(void *block) { static_cast<volatile char *>(block)[0] = 1; }
+};
+
+struct SharedHeap {
+    SharedAllocator allocator{kSegmentName, true};
+
+    SharedBlock allocate(const std::size_t size) { return allocator.allocate(size); }
+    void deallocate(const SharedBlock &block, std::size_t) { allocator.deallocate(block); }
+    void touch(const SharedBlock &block) { static_cast<volatile char *>(allocator.data(block))[0] = 1; }
+};
+
+// allocate/free pairs performed by one thread; returns how many failed
+template <typename Heap>
+std::size_t runThread(Heap &heap, const Pattern pattern, const std::size_t size, const std::size_t ops) {
+    using Block = decltype(heap.allocate(size));
+    std::size_t failures = 0;
+    if (pattern == Pattern::Pair) {
+        for (std::size_t i = 0; i < ops; ++i) {
+            const Block block = heap.allocate(size);
+            if (!block) {
+                ++failures;
+                continue;
+            }
+            heap.touch(block);
+            heap.deallocate(block, size);
+        }
+        return failures;
+    }
+
+    std::vector<Block> blocks;
+    blocks.reserve(kBatch);
+    for (std::size_t done = 0; done < ops; done += kBatch) {
+        for (std::size_t i = 0; i < kBatch; ++i) {
+            const Block block = heap.allocate(size);
+            if (!block) {
+                ++failures;
+                continue;
+            }
+            heap.touch(block);
+            blocks.push_back(block);
+        }
+        for (const Block &block : blocks) {
+            heap.deallocate(block, size);
+        }
+        blocks.clear();
+    }
+    return failures;
+}
+
+struct Measurement {
+    double mops = 0.0;
+    std::size_t ops = 0;
+    std::size_t failures = 0;
+    PerfSample counters;
+};
+
+template <typename MakeHeap>
+Measurement measure(const Options &options, const Pattern pattern, const std::size_t size, const unsigned threads,
+                    PerfCounters &perf, MakeHeap &&makeHeap) {
+    std::atomic<std::size_t> failures{0};
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            auto heap = makeHeap();
+            runThread(*heap, pattern, size, kBatch); // warm up: fault in pages and fill free lists
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            failures.fetch_add(runThread(*heap, pattern, size, options.opsPerThread));
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+
+    perf.start();
+    const auto t0 = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    Measurement m;
+    m.counters = perf.stop();
+    m.ops = options.opsPerThread * threads;
+    m.failures = failures.load();
+    const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    m.mops = seconds > 0.0 ? static_cast<double>(m.ops) / seconds / 1e6 : 0.0;
+    return m;
+}
+
+std::string formatSize(const std::size_t bytes) {
+    if (bytes >= (std::size_t{1} << 10)) {
+        return std::to_string(bytes >> 10) + "K";
+    }
+    return std::to_string(bytes);
+}
+
+Record toRecord(const std::string &heap, const Pattern pattern, const std::size_t size, const unsigned threads,
+                const Measurement &m, const MetricKind kind) {
+    Record record{"alloc", heap + "/" + patternName(pattern) + "/bytes=" + std::to_string(size) +
+                               "/threads=" + std::to_string(threads), {}};
+    record.add("mops", m.mops, kind);
+    m.counters.addPerOp(record, m.ops);
+    return record;
+}
+
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    lsm_bench::Reporter reporter;
+    PerfCounters perf;
+    const Options options = parseOptions(argc, argv, reporter, perf);
+
+    SharedAllocator segment{kSegmentName, kSegmentSize, true};
+
+    std::cout << "libsharedmemory shared allocator vs malloc (million allocate+free pairs/s)" << std::endl;
+    std::cout << "-------------------------------------------------------------------------" << std::endl;
+
+    for (const Pattern pattern : {Pattern::Pair, Pattern::Batch}) {
+        for (const std::size_t size : {std::size_t{64}, std::size_t{1024}, std::size_t{16384}, std::size_t{262144}}) {
+            for (const unsigned threads : {1u, 2u, 4u, 8u}) {
+                // every thread's batch must fit at once; larger blocks are not the allocator's bottleneck
+                if (pattern == Pattern::Batch && size * kBatch * threads > kSegmentSize / 2) {
+                    continue;
+                }
+                const Measurement system = measure(options, pattern, size, threads, perf,
+                                                   [] { return std::make_unique<SystemHeap>(); });
+                const Measurement shared = measure(options, pattern, size, threads, perf,
+                                                   [] { return std::make_unique<SharedHeap>(); });
+
+                std::cout << std::left << std::setw(6) << patternName(pattern) << std::right << std::setw(5)
+                          << formatSize(size) << "  threads=" << threads << std::fixed << std::setprecision(2)
+                          << "  malloc=" << std::setw(8) << system.mops << "  shared=" << std::setw(8) << shared.mops
+                          << " (" << std::setprecision(0) << std::setw(3)
+                          << (system.mops > 0.0 ? shared.mops / system.mops * 100.0 : 0.0) << "%)";
+                if (shared.failures != 0) {
+                    std::cout << "  failed=" << shared.failures;
+                }
+                std::cout << std::endl;
+                system.counters.printPerOp(system.ops, "malloc");
+                shared.counters.printPerOp(shared.ops, "shared");
+
+                // malloc is the reference point, not a property of the library
+                reporter.add(toRecord("malloc", pattern, size, threads, system, MetricKind::Info));
+                reporter.add(toRecord("shared", pattern, size, threads, shared, MetricKind::Throughput));
+            }
+        }
+    }
+
+    segment.close();
+    segment.destroy();
+    return reporter.finish();
+}
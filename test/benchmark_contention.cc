@@ -1,15 +1,35 @@
+// In-process lock contention benchmark.
+//
+// Covers concurrent stream writers, queue producers and queue consumers, and
+// the stream fan-out we run in production: one writer publishing while many
+// readers poll the same segment, which shows what reader locking on
+// lockOffset costs the writer.
+//
+// Usage: lsm_bench [--perf] [--perf-hitm RAWCONFIG]
+//                  [--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]
+
 #include <libsharedmemory/libsharedmemory.hpp>
 
+#include "benchmark_report.hpp"
+#include "latency_histogram.hpp"
+#include "perf_counters.hpp"
+
 #include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <span>
 #include <string>
 #include <thread>
 #include <vector>
 
 using namespace lsm;
+using lsm_bench::LatencyHistogram;
+using lsm_bench::MetricKind;
+using lsm_bench::PerfCounters;
+using lsm_bench::PerfSample;
+using lsm_bench::Record;
 
 namespace {
 
@@ -18,6 +38,7 @@ struct BenchResult {
     int threads;
     std::uint64_t operations;
     double seconds;
+    PerfSample counters;
 
     [[nodiscard]] double opsPerSec() const {
         return seconds > 0.0 ? static_cast<double>(operations) / seconds : 0.0;
@@ -48,7 +69,7 @@ private:
     std::atomic<bool> _go{false};
 };
 
-BenchResult benchStreamWriters(const int writerThreads, const int opsPerThread) {
+BenchResult benchStreamWriters(const int writerThreads, const int opsPerThread, PerfCounters &perf) {
     const std::string shmName = "bench_stream_contention";
     SharedMemoryWriteStream writer{shmName, 1024, true};
 
@@ -56,6 +77,7 @@ BenchResult benchStreamWriters(const int writerThreads, const int opsPerThread)
     std::vector<std::thread> threads;
     threads.reserve(static_cast<std::size_t>(writerThreads));
 
+    perf.start();
     const auto t0 = std::chrono::steady_clock::now();
 
     for (int tid = 0; tid < writerThreads; ++tid) {
@@ -75,14 +97,16 @@ BenchResult benchStreamWriters(const int writerThreads, const int opsPerThread)
 
     const auto t1 = std::chrono::steady_clock::now();
     const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    const PerfSample counters = perf.stop();
 
     writer.close();
     writer.destroy();
 
-    return {"stream_writers", writerThreads, static_cast<std::uint64_t>(writerThreads) * opsPerThread, seconds};
+    return {"stream_writers", writerThreads, static_cast<std::uint64_t>(writerThreads) * opsPerThread, seconds,
+            counters};
 }
 
-BenchResult benchQueueProducers(const int producerThreads, const int msgsPerProducer) {
+BenchResult benchQueueProducers(const int producerThreads, const int msgsPerProducer, PerfCounters &perf) {
     const std::string qName = "bench_queue_producers";
     SharedMemoryQueue writer{qName, 4096, 64, true, true};
     SharedMemoryQueue reader{qName, 4096, 64, true, false};
@@ -91,6 +115,8 @@ BenchResult benchQueueProducers(const int producerThreads, const int msgsPerProd
     std::atomic<std::uint64_t> consumed{0};
 
     StartGate gate(producerThreads + 1);
+    // counters are inherited only by threads spawned after they are opened
+    perf.start();
 
     std::thread consumer([&]() {
         gate.arriveAndWait();
@@ -130,15 +156,16 @@ BenchResult benchQueueProducers(const int producerThreads, const int msgsPerProd
 
     const auto t1 = std::chrono::steady_clock::now();
     const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    const PerfSample counters = perf.stop();
 
     writer.close();
     reader.close();
     writer.destroy();
 
-    return {"queue_producers", producerThreads, total, seconds};
+    return {"queue_producers", producerThreads, total, seconds, counters};
 }
 
-BenchResult benchQueueConsumers(const int consumerThreads, const int msgsPerConsumer) {
+BenchResult benchQueueConsumers(const int consumerThreads, const int msgsPerConsumer, PerfCounters &perf) {
     const std::string qName = "bench_queue_consumers";
     SharedMemoryQueue writer{qName, 4096, 64, true, true};
 
@@ -149,6 +176,8 @@ BenchResult benchQueueConsumers(const int consumerThreads, const int msgsPerCons
     std::atomic<bool> producerDone{false};
 
     StartGate gate(consumerThreads + 1);
+    // counters are inherited only by threads spawned after they are opened
+    perf.start();
 
     std::thread producer([&]() {
         gate.arriveAndWait();
@@ -195,11 +224,158 @@ BenchResult benchQueueConsumers(const int consumerThreads, const int msgsPerCons
 
     const auto t1 = std::chrono::steady_clock::now();
     const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    const PerfSample counters = perf.stop();
+
+    writer.close();
+    writer.destroy();
+
+    return {"queue_consumers", consumerThreads, consumed.load(std::memory_order_acquire), seconds,
+            counters};
+}
+
+enum class ReadKind { String, FloatArray };
+
+struct FanoutConfig {
+    ReadKind kind;
+    std::size_t payloadBytes;
+    std::chrono::microseconds writeInterval; // zero: the writer publishes back to back
+};
+
+struct FanoutResult {
+    std::string name;
+    int readers;
+    LatencyHistogram publish; // duration of each write() call, in ns
+    std::uint64_t writes;
+    std::uint64_t reads;
+    double seconds;
+    PerfSample counters;
+
+    [[nodiscard]] double writesPerSec() const { return seconds > 0.0 ? static_cast<double>(writes) / seconds : 0.0; }
+    [[nodiscard]] double readsPerSec() const { return seconds > 0.0 ? static_cast<double>(reads) / seconds : 0.0; }
+};
+
+std::string fanoutName(const FanoutConfig &config) {
+    return std::string(config.kind == ReadKind::String ? "fanout_string" : "fanout_float_array")
+           + "/bytes=" + std::to_string(config.payloadBytes)
+           + "/interval_us=" + std::to_string(config.writeInterval.count());
+}
+
+// one writer thread publishes for a fixed duration while every reader thread,
+// each with its own mapping, reads the latest payload in a loop
+FanoutResult benchStreamFanout(const FanoutConfig &config, const int readerThreads,
+                               const std::chrono::milliseconds duration, PerfCounters &perf) {
+    const std::string shmName = "bench_stream_fanout";
+    const std::size_t bufferSize = config.payloadBytes + dataOffset;
+    SharedMemoryWriteStream writer{shmName, bufferSize, true};
+
+    const std::string text(config.payloadBytes, 'f');
+    const std::vector<float> floats(config.payloadBytes / sizeof(float), 1.0f);
+    const auto publish = [&]() {
+        if (config.kind == ReadKind::String) {
+            writer.write(text);
+        } else {
+            writer.write(std::span<const float>(floats));
+        }
+    };
+    publish(); // readers never see an empty segment
+
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> reads{0};
+    StartGate gate(readerThreads + 1);
+
+    perf.start();
+
+    FanoutResult result{fanoutName(config), readerThreads, {}, 0, 0, 0.0, {}};
+    std::thread writerThread([&]() {
+        gate.arriveAndWait();
+        auto next = std::chrono::steady_clock::now();
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (config.writeInterval.count() > 0) {
+                next += config.writeInterval;
+                while (std::chrono::steady_clock::now() < next) {
+                    if (stop.load(std::memory_order_relaxed)) return;
+                }
+            }
+            const auto t0 = std::chrono::steady_clock::now();
+            publish();
+            const auto t1 = std::chrono::steady_clock::now();
+            result.publish.record(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+            ++result.writes;
+        }
+    });
+
+    std::vector<std::thread> readers;
+    readers.reserve(static_cast<std::size_t>(readerThreads));
+    for (int i = 0; i < readerThreads; ++i) {
+        readers.emplace_back([&]() {
+            SharedMemoryReadStream reader{shmName, bufferSize, true};
+            gate.arriveAndWait();
+            std::uint64_t local = 0;
+            std::size_t checksum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (config.kind == ReadKind::String) {
+                    checksum += reader.readString().size();
+                } else {
+                    const float *data = reader.readFloatArray();
+                    checksum += data[0] > 0.0f ? 1 : 0;
+                    delete[] data;
+                }
+                ++local;
+            }
+            if (checksum == 0) {
+                std::cerr << "fan-out reader saw no data" << std::endl;
+            }
+            reads.fetch_add(local, std::memory_order_relaxed);
+            reader.close();
+        });
+    }
+
+    gate.releaseAll();
+    const auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+
+    writerThread.join();
+    for (auto &th : readers) {
+        th.join();
+    }
+
+    const auto t1 = std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(t1 - t0).count();
+    result.counters = perf.stop();
+    result.reads = reads.load(std::memory_order_relaxed);
 
     writer.close();
     writer.destroy();
+    return result;
+}
+
+void printFanout(const FanoutResult &r) {
+    const auto us = [](const std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    std::cout << std::left << std::setw(48) << r.name
+              << " readers=" << std::setw(2) << r.readers
+              << std::fixed << std::setprecision(2)
+              << " publish_us: p50=" << std::setw(8) << us(r.publish.percentile(50.0))
+              << " p99=" << std::setw(8) << us(r.publish.percentile(99.0))
+              << " max=" << std::setw(9) << us(r.publish.max())
+              << std::setprecision(1)
+              << " writes/s=" << std::setw(11) << r.writesPerSec()
+              << " reads/s=" << r.readsPerSec()
+              << std::endl;
+    r.counters.printPerOp(static_cast<double>(r.writes + r.reads));
+}
 
-    return {"queue_consumers", consumerThreads, consumed.load(std::memory_order_acquire), seconds};
+Record toRecord(const FanoutResult &r) {
+    Record record{"contention", r.name + "/readers=" + std::to_string(r.readers), {}};
+    record.add("publish_p50_ns", static_cast<double>(r.publish.percentile(50.0)))
+          .add("publish_p99_ns", static_cast<double>(r.publish.percentile(99.0)), MetricKind::TailLatency)
+          .add("publish_max_ns", static_cast<double>(r.publish.max()))
+          .add("writes_per_sec", r.writesPerSec())
+          .add("reads_per_sec", r.readsPerSec(), MetricKind::Throughput)
+          .add("reads_per_sec_per_reader", r.readsPerSec() / r.readers);
+    r.counters.addPerOp(record, static_cast<double>(r.writes + r.reads));
+    return record;
 }
 
 void printResult(const BenchResult &r, const double baselineOpsPerSec) {
@@ -213,11 +389,31 @@ void printResult(const BenchResult &r, const double baselineOpsPerSec) {
               << " ops/s=" << std::fixed << std::setprecision(1) << std::setw(12) << current
               << " drop_vs_1t=" << std::fixed << std::setprecision(1) << dropPct << "%"
               << std::endl;
+    r.counters.printPerOp(static_cast<double>(r.operations));
+}
+
+Record toRecord(const BenchResult &r) {
+    Record record{"contention", r.name + "/threads=" + std::to_string(r.threads), {}};
+    record.add("ops_per_sec", r.opsPerSec(), MetricKind::Throughput)
+          .add("operations", static_cast<double>(r.operations))
+          .add("seconds", r.seconds);
+    r.counters.addPerOp(record, static_cast<double>(r.operations));
+    return record;
 }
 
 } // namespace
 
-int main() {
+int main(const int argc, char *argv[]) {
+    lsm_bench::Reporter reporter;
+    PerfCounters perf;
+    for (int i = 1; i < argc; ++i) {
+        if (!reporter.parseArgument(i, argc, argv) && !perf.parseArgument(i, argc, argv)) {
+            std::cerr << "usage: " << argv[0] << " " << PerfCounters::usage() << " "
+                      << lsm_bench::Reporter::usage() << std::endl;
+            return 2;
+        }
+    }
+
     std::cout << "libsharedmemory contention benchmark" << std::endl;
     std::cout << "------------------------------------" << std::endl;
 
@@ -226,11 +422,12 @@ int main() {
     // Stream writer contention
     std::vector<BenchResult> streamResults;
     for (const int t : threadCounts) {
-        streamResults.push_back(benchStreamWriters(t, 200000));
+        streamResults.push_back(benchStreamWriters(t, 200000, perf));
     }
     const double streamBaseline = streamResults.front().opsPerSec();
     for (const auto &r : streamResults) {
         printResult(r, streamBaseline);
+        reporter.add(toRecord(r));
     }
 
     std::cout << std::endl;
@@ -238,11 +435,12 @@ int main() {
     // Queue producer contention (single consumer)
     std::vector<BenchResult> producerResults;
     for (const int t : threadCounts) {
-        producerResults.push_back(benchQueueProducers(t, 100000));
+        producerResults.push_back(benchQueueProducers(t, 100000, perf));
     }
     const double producerBaseline = producerResults.front().opsPerSec();
     for (const auto &r : producerResults) {
         printResult(r, producerBaseline);
+        reporter.add(toRecord(r));
     }
 
     std::cout << std::endl;
@@ -250,11 +448,33 @@ int main() {
     // Queue consumer contention (single producer)
     std::vector<BenchResult> consumerResults;
     for (const int t : threadCounts) {
-        consumerResults.push_back(benchQueueConsumers(t, 100000));
+        consumerResults.push_back(benchQueueConsumers(t, 100000, perf));
     }
     const double consumerBaseline = consumerResults.front().opsPerSec();
     for (const auto &r : consumerResults) {
         printResult(r, consumerBaseline);
+        reporter.add(toRecord(r));
+    }
+
+    std::cout << std::endl;
+
+    // Stream fan-out: one writer, many readers. The paced configurations model
+    // a realistic publish rate; back-to-back writes show the worst case for
+    // the writer competing with readers for lockOffset.
+    const std::vector<FanoutConfig> fanoutConfigs = {
+        {ReadKind::String, 64, std::chrono::microseconds(0)},
+        {ReadKind::String, 64, std::chrono::microseconds(100)},
+        {ReadKind::String, 65536, std::chrono::microseconds(0)},
+        {ReadKind::FloatArray, 4096, std::chrono::microseconds(0)},
+        {ReadKind::FloatArray, 4096, std::chrono::microseconds(100)},
+    };
+    const std::vector<int> readerCounts = {1, 2, 4, 8, 16, 32};
+    for (const FanoutConfig &config : fanoutConfigs) {
+        for (const int readers : readerCounts) {
+            const FanoutResult r = benchStreamFanout(config, readers, std::chrono::milliseconds(200), perf);
+            printFanout(r);
+            reporter.add(toRecord(r));
+        }
     }
-    return 0;
+    return reporter.finish();
 }
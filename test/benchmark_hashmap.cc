@@ -0,0 +1,233 @@
+// Shared hash map lookup throughput benchmark.
+//
+// Fills a SharedHashMap with --entries keys (at a load factor of about one
+// half), then measures lookups of random present keys from 1 to 8 reader
+// threads, each mapping the segment on its own as separate processes would,
+// once with the table at rest and once while a writer thread keeps updating
+// random entries. A private std::unordered_map probed the same way is shown
+// as a reference point.
+//
+// Usage: lsm_bench_hashmap [--entries N] [--lookups N] [--perf] [--perf-hitm RAWCONFIG]
+//                          [--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include "benchmark_report.hpp"
+#include "perf_counters.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace lsm;
+using lsm_bench::MetricKind;
+using lsm_bench::PerfCounters;
+using lsm_bench::PerfSample;
+using lsm_bench::Record;
+
+namespace {
+
+constexpr const char *kSegmentName = "bench_hashmap";
+
+struct Options {
+    std::size_t entries = 1000000;
+    std::size_t lookupsPerThread = 2000000;
+};
+
+Options parseOptions(const int argc, char *argv[], lsm_bench::Reporter &reporter, PerfCounters &perf) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (reporter.parseArgument(i, argc, argv) || perf.parseArgument(i, argc, argv)) {
+            continue;
+        } else if (arg == "--entries" && hasValue) {
+            options.entries = static_cast<std::size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--lookups" && hasValue) {
+            options.lookupsPerThread = static_cast<std::size_t>(std::stoull(argv[++i]));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--entries N] [--lookups N] " << PerfCounters::usage() << " "
+                      << lsm_bench::Reporter::usage() << std::endl;
+            std::exit(2);
+        }
+    }
+    if (options.entries == 0) {
+        std::cerr << "--entries must be at least 1" << std::endl;
+        std::exit(2);
+    }
+    return options;
+}
+
+// a per-symbol state record, as a trading or telemetry table would keep
+struct State {
+    std::uint64_t price = 0;
+    std::uint64_t quantity = 0;
+    std::uint64_t updated = 0;
+};
+
+using Table = SharedHashMap<std::uint64_t, State>;
+
+// keys are spread out so they do not hash to consecutive buckets by accident
+std::uint64_t keyOf(const std::size_t index) {
+    return index * 0x9E3779B97F4A7C15ull + 1;
+}
+
+// xorshift64, cheap enough not to dominate a lookup
+struct Random {
+    std::uint64_t state;
+
+    std::uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+struct SharedTable {
+    Table table{kSegmentName, true};
+
+    bool find(const std::uint64_t key) const { return table.find(key).has_value(); }
+};
+
+struct PrivateTable {
+    const std::unordered_map<std::uint64_t, State> &map;
+
+    bool find(const std::uint64_t key) const { return map.find(key) != map.end(); }
+};
+
+struct Measurement {
+    double mops = 0.0;
+    std::size_t ops = 0;
+    std::size_t misses = 0;
+    PerfSample counters;
+};
+
+template <typename MakeTable>
+Measurement measure(const Options &options, const unsigned threads, const bool withWriter, PerfCounters &perf,
+                    MakeTable &&makeTable) {
+    std::atomic<std::size_t> misses{0};
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            const auto table = makeTable();
+            Random random{0x2545F4914F6CDD1Dull + t};
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            std::size_t missed = 0;
+            for (std::size_t i = 0; i < options.lookupsPerThread; ++i) {
+                missed += table->find(keyOf(random.next() % options.entries)) ? 0 : 1;
+            }
+            misses.fetch_add(missed);
+        });
+    }
+    std::thread writer;
+    if (withWriter) {
+        writer = std::thread([&]() {
+            Table table{kSegmentName, true};
+            Random random{0x9E3779B97F4A7C15ull};
+            std::uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                table.update(keyOf(random.next() % options.entries), [n](State &state) {
+                    state.price += 1;
+                    state.updated = n;
+                });
+                ++n;
+            }
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+
+    perf.start();
+    const auto t0 = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    Measurement m;
+    m.counters = perf.stop();
+    stop.store(true);
+    if (writer.joinable()) {
+        writer.join();
+    }
+
+    m.ops = options.lookupsPerThread * threads;
+    m.misses = misses.load();
+    const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    m.mops = seconds > 0.0 ? static_cast<double>(m.ops) / seconds / 1e6 : 0.0;
+    return m;
+}
+
+Record toRecord(const std::string &table, const unsigned threads, const bool withWriter, const Measurement &m,
+                const MetricKind kind) {
+    Record record{"hashmap", table + "/" + (withWriter ? "writer" : "idle") + "/threads=" + std::to_string(threads),
+                  {}};
+    record.add("mops", m.mops, kind);
+    m.counters.addPerOp(record, m.ops);
+    return record;
+}
+
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    lsm_bench::Reporter reporter;
+    PerfCounters perf;
+    const Options options = parseOptions(argc, argv, reporter, perf);
+
+    Table table{kSegmentName, options.entries * 2, true};
+    std::unordered_map<std::uint64_t, State> reference;
+    reference.reserve(options.entries);
+    for (std::size_t i = 0; i < options.entries; ++i) {
+        const State state{i, i, 0};
+        table.store(keyOf(i), state);
+        reference.emplace(keyOf(i), state);
+    }
+
+    std::cout << "libsharedmemory shared hash map lookups (" << options.entries << " entries, "
+              << table.capacity() << " buckets, million lookups/s)" << std::endl;
+    std::cout << "-----------------------------------------------------------------------------" << std::endl;
+
+    for (const bool withWriter : {false, true}) {
+        for (const unsigned threads : {1u, 2u, 4u, 8u}) {
+            const Measurement shared = measure(options, threads, withWriter, perf,
+                                               [] { return std::make_unique<SharedTable>(); });
+            std::cout << std::left << std::setw(7) << (withWriter ? "writer" : "idle") << std::right
+                      << "threads=" << threads << std::fixed << std::setprecision(2) << "  shared=" << std::setw(8)
+                      << shared.mops;
+            if (!withWriter) {
+                const Measurement local = measure(options, threads, false, perf, [&reference] {
+                    return std::make_unique<PrivateTable>(PrivateTable{reference});
+                });
+                std::cout << "  unordered_map=" << std::setw(8) << local.mops;
+                // the private map is the reference point, not a property of the library
+                reporter.add(toRecord("unordered_map", threads, false, local, MetricKind::Info));
+            }
+            if (shared.misses != 0) {
+                std::cout << "  missed=" << shared.misses;
+            }
+            std::cout << std::endl;
+            shared.counters.printPerOp(shared.ops, "shared");
+            reporter.add(toRecord("shared", threads, withWriter, shared, MetricKind::Throughput));
+        }
+    }
+
+    table.close();
+    table.destroy();
+    return reporter.finish();
+}
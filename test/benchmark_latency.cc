@@ -0,0 +1,339 @@
+// Cross-process ping-pong latency benchmark.
+//
+// Forks a responder process and measures the round trip of one message
+// through a pair of streams and through a pair of queues at several payload
+// sizes. Every sample is recorded, so tail latency (p99, p99.9, max) is
+// visible rather than averaged away as in the in-process contention bench.
+//
+// Usage: lsm_bench_latency [--samples N] [--warmup N] [--sizes 8,64,...]
+//                          [--pin-ping CPU] [--pin-pong CPU] [--perf] [--perf-hitm RAWCONFIG]
+//                          [--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include "benchmark_report.hpp"
+#include "latency_histogram.hpp"
+#include "perf_counters.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+
+int main() {
+    std::cout << "lsm_bench_latency needs fork() and is not available on Windows" << std::endl;
+    return 0;
+}
+
+#else
+
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+using namespace lsm;
+using lsm_bench::LatencyHistogram;
+using lsm_bench::MetricKind;
+using lsm_bench::PerfCounters;
+using lsm_bench::PerfSample;
+using lsm_bench::Record;
+
+namespace {
+
+struct Options {
+    int samples = 20000;
+    int warmup = 1000;
+    std::vector<std::size_t> sizes = {8, 64, 512, 4096, 65536};
+    int pinPing = -1;
+    int pinPong = -1;
+};
+
+Options parseOptions(const int argc, char *argv[], lsm_bench::Reporter &reporter, PerfCounters &perf) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (reporter.parseArgument(i, argc, argv) || perf.parseArgument(i, argc, argv)) {
+            continue;
+        } else if (arg == "--samples" && hasValue) {
+            options.samples = std::atoi(argv[++i]);
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::atoi(argv[++i]);
+        } else if (arg == "--pin-ping" && hasValue) {
+            options.pinPing = std::atoi(argv[++i]);
+        } else if (arg == "--pin-pong" && hasValue) {
+            options.pinPong = std::atoi(argv[++i]);
+        } else if (arg == "--sizes" && hasValue) {
+            options.sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                options.sizes.push_back(static_cast<std::size_t>(std::stoull(item)));
+            }
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--samples N] [--warmup N] [--sizes 8,64,...] [--pin-ping CPU] [--pin-pong CPU] "
+                      << PerfCounters::usage() << " " << lsm_bench::Reporter::usage() << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+void pinToCpu(const int cpu, const char *side) {
+    if (cpu < 0) {
+        return;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "warning: could not pin " << side << " to cpu " << cpu << std::endl;
+    }
+#else
+    std::cerr << "warning: cpu pinning is only supported on Linux (" << side << ")" << std::endl;
+#endif
+}
+
+#if defined(__linux__)
+// affinity the process started with, before the ping side was pinned
+cpu_set_t startAffinity;
+bool startAffinitySaved = false;
+#endif
+
+void saveStartAffinity() {
+#if defined(__linux__)
+    startAffinitySaved = sched_getaffinity(0, sizeof(startAffinity), &startAffinity) == 0;
+#endif
+}
+
+// a forked responder inherits the ping side's pinning; without --pin-pong it
+// gets the original mask back, so both sides never share a core by accident
+void pinResponder(const int cpu) {
+    if (cpu >= 0) {
+        pinToCpu(cpu, "pong");
+        return;
+    }
+#if defined(__linux__)
+    if (startAffinitySaved && sched_setaffinity(0, sizeof(startAffinity), &startAffinity) != 0) {
+        std::cerr << "warning: could not restore the affinity of pong" << std::endl;
+    }
+#endif
+}
+
+// spin briefly, then yield so both sides also make progress on a single core
+template <typename Predicate>
+void waitFor(Predicate &&ready) {
+    int spins = 0;
+    while (!ready()) {
+        if (++spins > 1000) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+std::uint64_t nowNs() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+pid_t forkResponder(const int pinCpu, void (*respond)(void *, int), void *context, const int rounds) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        std::exit(1);
+    }
+    if (pid == 0) {
+        pinResponder(pinCpu);
+        respond(context, rounds);
+        // skip destructors: the parent owns and destroys the segments
+        _exit(0);
+    }
+    return pid;
+}
+
+bool joinResponder(const pid_t pid) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+struct LatencyResult {
+    LatencyHistogram histogram;
+    PerfSample counters; // covers warmup rounds and the responder process
+    int rounds = 0;
+};
+
+struct StreamPair {
+    SharedMemoryWriteStream &pingWriter;
+    SharedMemoryReadStream &pingReader;
+    SharedMemoryWriteStream &pongWriter;
+    SharedMemoryReadStream &pongReader;
+};
+
+void streamResponder(void *context, const int rounds) {
+    auto &pair = *static_cast<StreamPair *>(context);
+    for (int i = 0; i < rounds; ++i) {
+        waitFor([&]() { return pair.pingReader.hasNewData(); });
+        const std::string message = pair.pingReader.readString();
+        pair.pingReader.markAsRead();
+        pair.pongWriter.write(message);
+    }
+}
+
+LatencyResult benchStreams(const Options &options, const std::size_t size, PerfCounters &perf) {
+    const std::size_t bufferSize = size + dataOffset + 64;
+    SharedMemoryWriteStream pingWriter{"bench_latency_ping", bufferSize, true};
+    SharedMemoryReadStream pingReader{"bench_latency_ping", bufferSize, true};
+    SharedMemoryWriteStream pongWriter{"bench_latency_pong", bufferSize, true};
+    SharedMemoryReadStream pongReader{"bench_latency_pong", bufferSize, true};
+    StreamPair pair{pingWriter, pingReader, pongWriter, pongReader};
+
+    const int rounds = options.warmup + options.samples;
+    perf.start();
+    const pid_t child = forkResponder(options.pinPong, streamResponder, &pair, rounds);
+
+    const std::string payload(size, 'x');
+    LatencyResult result;
+    result.rounds = rounds;
+    for (int i = 0; i < rounds; ++i) {
+        const std::uint64_t t0 = nowNs();
+        pingWriter.write(payload);
+        waitFor([&]() { return pongReader.hasNewData(); });
+        const std::string echo = pongReader.readString();
+        pongReader.markAsRead();
+        const std::uint64_t t1 = nowNs();
+        if (i >= options.warmup) {
+            result.histogram.record(t1 - t0);
+        }
+    }
+
+    if (!joinResponder(child)) {
+        std::cerr << "stream responder failed" << std::endl;
+    }
+    result.counters = perf.stop();
+
+    pingWriter.destroy();
+    pongWriter.destroy();
+    return result;
+}
+
+struct QueuePair {
+    SharedMemoryQueue &pingReader;
+    SharedMemoryQueue &pongWriter;
+};
+
+void queueResponder(void *context, const int rounds) {
+    auto &pair = *static_cast<QueuePair *>(context);
+    std::string message;
+    for (int i = 0; i < rounds; ++i) {
+        waitFor([&]() { return pair.pingReader.dequeue(message); });
+        waitFor([&]() { return pair.pongWriter.enqueue(message); });
+    }
+}
+
+LatencyResult benchQueues(const Options &options, const std::size_t size, PerfCounters &perf) {
+    const auto maxMessageSize = static_cast<std::uint32_t>(size);
+    SharedMemoryQueue pingWriter{"bench_latency_qping", 4, maxMessageSize, true, true};
+    SharedMemoryQueue pingReader{"bench_latency_qping", 4, maxMessageSize, true, false};
+    SharedMemoryQueue pongWriter{"bench_latency_qpong", 4, maxMessageSize, true, true};
+    SharedMemoryQueue pongReader{"bench_latency_qpong", 4, maxMessageSize, true, false};
+    QueuePair pair{pingReader, pongWriter};
+
+    const int rounds = options.warmup + options.samples;
+    perf.start();
+    const pid_t child = forkResponder(options.pinPong, queueResponder, &pair, rounds);
+
+    const std::string payload(size, 'x');
+    std::string echo;
+    LatencyResult result;
+    result.rounds = rounds;
+    for (int i = 0; i < rounds; ++i) {
+        const std::uint64_t t0 = nowNs();
+        waitFor([&]() { return pingWriter.enqueue(payload); });
+        waitFor([&]() { return pongReader.dequeue(echo); });
+        const std::uint64_t t1 = nowNs();
+        if (i >= options.warmup) {
+            result.histogram.record(t1 - t0);
+        }
+    }
+
+    if (!joinResponder(child)) {
+        std::cerr << "queue responder failed" << std::endl;
+    }
+    result.counters = perf.stop();
+
+    pingWriter.destroy();
+    pongWriter.destroy();
+    return result;
+}
+
+void printResult(const std::string &transport, const std::size_t size, const LatencyResult &result) {
+    const LatencyHistogram &h = result.histogram;
+    const auto us = [](const std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    std::cout << std::left << std::setw(8) << transport
+              << " bytes=" << std::setw(7) << size
+              << " samples=" << std::setw(7) << h.count()
+              << std::fixed << std::setprecision(2)
+              << " rtt_us: min=" << std::setw(8) << us(h.min())
+              << " p50=" << std::setw(8) << us(h.percentile(50.0))
+              << " p99=" << std::setw(8) << us(h.percentile(99.0))
+              << " p99.9=" << std::setw(8) << us(h.percentile(99.9))
+              << " max=" << us(h.max())
+              << std::endl;
+    result.counters.printPerOp(result.rounds);
+}
+
+Record toRecord(const std::string &transport, const std::size_t size, const LatencyResult &result) {
+    const LatencyHistogram &h = result.histogram;
+    Record record{"latency", transport + "/bytes=" + std::to_string(size), {}};
+    record.add("samples", static_cast<double>(h.count()))
+          .add("min_ns", static_cast<double>(h.min()))
+          .add("p50_ns", static_cast<double>(h.percentile(50.0)))
+          .add("p99_ns", static_cast<double>(h.percentile(99.0)), MetricKind::TailLatency)
+          .add("p999_ns", static_cast<double>(h.percentile(99.9)))
+          .add("max_ns", static_cast<double>(h.max()));
+    result.counters.addPerOp(record, result.rounds);
+    return record;
+}
+
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    lsm_bench::Reporter reporter;
+    PerfCounters perf;
+    const Options options = parseOptions(argc, argv, reporter, perf);
+
+    std::cout << "libsharedmemory cross-process ping-pong latency" << std::endl;
+    std::cout << "-----------------------------------------------" << std::endl;
+
+    saveStartAffinity();
+    pinToCpu(options.pinPing, "ping");
+
+    for (const std::size_t size : options.sizes) {
+        const LatencyResult result = benchStreams(options, size, perf);
+        printResult("stream", size, result);
+        reporter.add(toRecord("stream", size, result));
+    }
+
+    std::cout << std::endl;
+
+    for (const std::size_t size : options.sizes) {
+        const LatencyResult result = benchQueues(options, size, perf);
+        printResult("queue", size, result);
+        reporter.add(toRecord("queue", size, result));
+    }
+    return reporter.finish();
+}
+
+#endif // !_WIN32
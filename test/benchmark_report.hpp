@@ -0,0 +1,443 @@
+#pragma once
+
+// Machine-readable benchmark records and baseline comparison.
+//
+// Every benchmark executable collects its results as Records and hands them
+// to a Reporter, which can write them as JSON (--json FILE) or CSV
+// (--csv FILE) together with a description of the machine and build, and can
+// compare them against a previously stored JSON file (--compare FILE). Any
+// throughput metric that dropped, or tail-latency metric that rose, by more
+// than --threshold percent is flagged and makes the process exit non-zero,
+// so a library upgrade can be gated on a local perf check:
+//
+//   lsm_bench --json baseline.json            # on the old version
+//   lsm_bench --compare baseline.json         # on the new version
+//
+// The JSON output keeps one record per line so the comparison needs nothing
+// more than a flat-object parser.
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#ifndef LSM_BUILD_TYPE
+#define LSM_BUILD_TYPE ""
+#endif
+
+namespace lsm_bench {
+
+enum class MetricKind {
+    Throughput,  // higher is better, gated by --compare
+    TailLatency, // lower is better, gated by --compare
+    Info,        // reported only
+};
+
+struct Metric {
+    std::string name;
+    double value = 0.0;
+    MetricKind kind = MetricKind::Info;
+};
+
+struct Record {
+    std::string suite;
+    std::string scenario;
+    std::vector<Metric> metrics;
+
+    Record &add(std::string name, const double value, const MetricKind kind = MetricKind::Info) {
+        metrics.push_back({std::move(name), value, kind});
+        return *this;
+    }
+
+    [[nodiscard]] std::string key() const { return suite + "/" + scenario; }
+};
+
+struct Environment {
+    std::string cpuModel;
+    unsigned cores = 0;
+    std::string compiler;
+    std::string buildType;
+    bool assertions = true;
+    std::string os;
+    std::string libraryVersion;
+    std::string timestamp;
+};
+
+namespace detail {
+
+inline std::string trim(const std::string &text) {
+    const auto begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return {};
+    }
+    const auto end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+inline std::string cpuModel() {
+#if defined(__linux__)
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        const auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        const std::string field = trim(line.substr(0, colon));
+        if (field == "model name" || field == "Hardware" || field == "Model") {
+            return trim(line.substr(colon + 1));
+        }
+    }
+#elif defined(__APPLE__)
+    char brand[256] = {0};
+    std::size_t length = sizeof(brand);
+    if (sysctlbyname("machdep.cpu.brand_string", brand, &length, nullptr, 0) == 0) {
+        return brand;
+    }
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[12] = {0};
+    __cpuid(regs, 0x80000002);
+    __cpuid(regs + 4, 0x80000003);
+    __cpuid(regs + 8, 0x80000004);
+    return trim(std::string(reinterpret_cast<const char *>(regs), sizeof(regs)).c_str());
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned regs[12] = {0};
+    __get_cpuid(0x80000002, &regs[0], &regs[1], &regs[2], &regs[3]);
+    __get_cpuid(0x80000003, &regs[4], &regs[5], &regs[6], &regs[7]);
+    __get_cpuid(0x80000004, &regs[8], &regs[9], &regs[10], &regs[11]);
+    return trim(std::string(reinterpret_cast<const char *>(regs), sizeof(regs)).c_str());
+#else
+    return "unknown";
+#endif
+}
+
+inline std::string compiler() {
+#if defined(__clang__)
+    return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_FULL_VER);
+#else
+    return "unknown";
+#endif
+}
+
+inline std::string escapeJson(const std::string &text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+inline std::string escapeCsv(const std::string &text) {
+    if (text.find_first_of(",\"\n") == std::string::npos) {
+        return text;
+    }
+    std::string escaped = "\"";
+    for (const char c : text) {
+        escaped += c;
+        if (c == '"') {
+            escaped += '"';
+        }
+    }
+    return escaped + "\"";
+}
+
+inline std::string formatNumber(const double value) {
+    std::ostringstream out;
+    out << std::setprecision(10) << value;
+    return out.str();
+}
+
+// parses one flat JSON object of string and number members; nested values
+// are not part of the record format and make the line unparseable
+inline bool parseFlatObject(const std::string &line, std::map<std::string, std::string> &strings,
+                            std::map<std::string, double> &numbers) {
+    std::size_t pos = 0;
+    const auto skipSpace = [&]() {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) ++pos;
+    };
+    const auto parseString = [&](std::string &out) {
+        if (pos >= line.size() || line[pos] != '"') return false;
+        ++pos;
+        out.clear();
+        while (pos < line.size() && line[pos] != '"') {
+            if (line[pos] == '\\' && pos + 1 < line.size()) ++pos;
+            out += line[pos++];
+        }
+        if (pos >= line.size()) return false;
+        ++pos;
+        return true;
+    };
+
+    skipSpace();
+    if (pos >= line.size() || line[pos] != '{') return false;
+    ++pos;
+    for (;;) {
+        skipSpace();
+        if (pos < line.size() && line[pos] == '}') return true;
+        std::string name;
+        if (!parseString(name)) return false;
+        skipSpace();
+        if (pos >= line.size() || line[pos] != ':') return false;
+        ++pos;
+        skipSpace();
+        if (pos < line.size() && line[pos] == '"') {
+            std::string value;
+            if (!parseString(value)) return false;
+            strings[name] = value;
+        } else {
+            const char *begin = line.c_str() + pos;
+            char *end = nullptr;
+            const double value = std::strtod(begin, &end);
+            if (end == begin) return false;
+            numbers[name] = value;
+            pos += static_cast<std::size_t>(end - begin);
+        }
+        skipSpace();
+        if (pos < line.size() && line[pos] == ',') ++pos;
+    }
+}
+
+} // namespace detail
+
+inline Environment captureEnvironment() {
+    Environment env;
+    env.cpuModel = detail::cpuModel();
+    env.cores = std::thread::hardware_concurrency();
+    env.compiler = detail::compiler();
+    env.buildType = std::string(LSM_BUILD_TYPE).empty() ? "unspecified" : LSM_BUILD_TYPE;
+#if defined(NDEBUG)
+    env.assertions = false;
+#endif
+#if defined(_WIN32)
+    env.os = "windows";
+#elif defined(__APPLE__)
+    env.os = "macos";
+#elif defined(__linux__)
+    env.os = "linux";
+#else
+    env.os = "unknown";
+#endif
+    env.libraryVersion = std::to_string(LIBSHAREDMEMORY_VERSION_MAJOR) + "." +
+                         std::to_string(LIBSHAREDMEMORY_VERSION_MINOR) + "." +
+                         std::to_string(LIBSHAREDMEMORY_VERSION_PATCH);
+
+    const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm utc{};
+#if defined(_WIN32)
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char buffer[32] = {0};
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    env.timestamp = buffer;
+    return env;
+}
+
+class Reporter {
+public:
+    // consumes the reporting options at argv[i] (and its value); returns
+    // false for arguments that belong to the benchmark itself
+    bool parseArgument(int &i, const int argc, char *argv[]) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (arg == "--json") {
+            _jsonPath = argv[++i];
+        } else if (arg == "--csv") {
+            _csvPath = argv[++i];
+        } else if (arg == "--compare") {
+            _baselinePath = argv[++i];
+        } else if (arg == "--threshold") {
+            _thresholdPct = std::atof(argv[++i]);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static const char *usage() {
+        return "[--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]";
+    }
+
+    void add(Record record) { _records.push_back(std::move(record)); }
+
+    // writes the requested outputs and runs the baseline comparison;
+    // returns the process exit code (1 when a regression was flagged)
+    int finish() {
+        const Environment env = captureEnvironment();
+        if (!_jsonPath.empty()) {
+            writeJson(env);
+        }
+        if (!_csvPath.empty()) {
+            writeCsv(env);
+        }
+        if (!_baselinePath.empty()) {
+            return compare() ? 0 : 1;
+        }
+        return 0;
+    }
+
+private:
+    void writeJson(const Environment &env) const {
+        std::ofstream out(_jsonPath);
+        if (!out) {
+            std::cerr << "could not write " << _jsonPath << std::endl;
+            return;
+        }
+        out << "{\n\"environment\": {"
+            << "\"cpu\": \"" << detail::escapeJson(env.cpuModel) << "\", "
+            << "\"cores\": " << env.cores << ", "
+            << "\"compiler\": \"" << detail::escapeJson(env.compiler) << "\", "
+            << "\"build_type\": \"" << detail::escapeJson(env.buildType) << "\", "
+            << "\"assertions\": " << (env.assertions ? "true" : "false") << ", "
+            << "\"os\": \"" << env.os << "\", "
+            << "\"library_version\": \"" << env.libraryVersion << "\", "
+            << "\"timestamp\": \"" << env.timestamp << "\"},\n"
+            << "\"records\": [\n";
+        for (std::size_t i = 0; i < _records.size(); ++i) {
+            const Record &r = _records[i];
+            out << "{\"suite\": \"" << detail::escapeJson(r.suite) << "\", \"scenario\": \""
+                << detail::escapeJson(r.scenario) << "\"";
+            for (const Metric &m : r.metrics) {
+                out << ", \"" << detail::escapeJson(m.name) << "\": " << detail::formatNumber(m.value);
+            }
+            out << "}" << (i + 1 < _records.size() ? "," : "") << "\n";
+        }
+        out << "]\n}\n";
+    }
+
+    void writeCsv(const Environment &env) const {
+        std::ofstream out(_csvPath);
+        if (!out) {
+            std::cerr << "could not write " << _csvPath << std::endl;
+            return;
+        }
+        out << "# cpu=" << env.cpuModel << "\n"
+            << "# cores=" << env.cores << "\n"
+            << "# compiler=" << env.compiler << "\n"
+            << "# build_type=" << env.buildType << "\n"
+            << "# assertions=" << (env.assertions ? "on" : "off") << "\n"
+            << "# os=" << env.os << "\n"
+            << "# library_version=" << env.libraryVersion << "\n"
+            << "# timestamp=" << env.timestamp << "\n"
+            << "suite,scenario,metric,value\n";
+        for (const Record &r : _records) {
+            for (const Metric &m : r.metrics) {
+                out << detail::escapeCsv(r.suite) << "," << detail::escapeCsv(r.scenario) << ","
+                    << detail::escapeCsv(m.name) << "," << detail::formatNumber(m.value) << "\n";
+            }
+        }
+    }
+
+    // returns false when at least one gated metric regressed
+    bool compare() const {
+        std::ifstream in(_baselinePath);
+        if (!in) {
+            std::cerr << "could not read baseline " << _baselinePath << std::endl;
+            return false;
+        }
+
+        std::map<std::string, std::map<std::string, double>> baseline;
+        std::string line;
+        while (std::getline(in, line)) {
+            // record lines end in "}," except the last one
+            const std::string record = detail::trim(line);
+            std::map<std::string, std::string> strings;
+            std::map<std::string, double> numbers;
+            if (detail::parseFlatObject(record.substr(0, record.rfind('}') + 1), strings, numbers)
+                && strings.count("suite") && strings.count("scenario")) {
+                baseline[strings["suite"] + "/" + strings["scenario"]] = numbers;
+            }
+        }
+
+        std::cout << std::endl << "comparison against " << _baselinePath
+                  << " (threshold " << std::defaultfloat << _thresholdPct << "%)" << std::endl;
+
+        int regressions = 0;
+        int matched = 0;
+        for (const Record &r : _records) {
+            const auto found = baseline.find(r.key());
+            if (found == baseline.end()) {
+                continue;
+            }
+            for (const Metric &m : r.metrics) {
+                if (m.kind == MetricKind::Info) {
+                    continue;
+                }
+                const auto old = found->second.find(m.name);
+                if (old == found->second.end() || old->second <= 0.0) {
+                    continue;
+                }
+                ++matched;
+                const double deltaPct = (m.value - old->second) / old->second * 100.0;
+                const bool regressed = m.kind == MetricKind::Throughput ? deltaPct < -_thresholdPct
+                                                                        : deltaPct > _thresholdPct;
+                regressions += regressed ? 1 : 0;
+
+                std::cout << std::left << std::setw(40) << r.key() << " " << std::setw(12) << m.name
+                          << std::right << std::fixed << std::setprecision(3)
+                          << " baseline=" << std::setw(16) << old->second
+                          << " current=" << std::setw(16) << m.value
+                          << std::setprecision(1)
+                          << " delta=" << std::showpos << std::setw(7) << deltaPct << "%" << std::noshowpos
+                          << (regressed ? "  REGRESSION" : "") << std::endl;
+            }
+        }
+
+        // a wrong or stale baseline matches nothing, which must not pass as "no regressions"
+        if (matched == 0) {
+            std::cerr << "no metric of this run has a baseline value in " << _baselinePath << std::endl;
+            return false;
+        }
+
+        std::cout << (regressions ? std::to_string(regressions) + " regression(s) past threshold"
+                                  : std::string("no regressions past threshold"))
+                  << std::endl;
+        return regressions == 0;
+    }
+
+    std::vector<Record> _records;
+    std::string _jsonPath;
+    std::string _csvPath;
+    std::string _baselinePath;
+    double _thresholdPct = 10.0;
+};
+
+} // namespace lsm_bench
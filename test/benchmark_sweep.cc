@@ -0,0 +1,230 @@
+// Payload-size sweep throughput benchmark.
+//
+// Measures stream writes, stream reads and queue round trips from 8 bytes up
+// to 64 MiB and reports each as GB/s next to a plain memcpy of the same size
+// measured on the same machine. Small sizes show the fixed per-operation cost
+// (locking, metadata), large sizes show how close the library gets to the
+// memory-bandwidth roofline.
+//
+// Usage: lsm_bench_sweep [--max-size BYTES] [--bytes-per-point BYTES] [--perf] [--perf-hitm RAWCONFIG]
+//                        [--json FILE] [--csv FILE] [--compare BASELINE.json] [--threshold PCT]
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include "benchmark_report.hpp"
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace lsm;
+using lsm_bench::MetricKind;
+using lsm_bench::PerfCounters;
+using lsm_bench::PerfSample;
+using lsm_bench::Record;
+
+namespace {
+
+struct Options {
+    std::size_t maxSize = std::size_t{64} << 20;
+    std::size_t bytesPerPoint = std::size_t{512} << 20;
+};
+
+Options parseOptions(const int argc, char *argv[], lsm_bench::Reporter &reporter, PerfCounters &perf) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (reporter.parseArgument(i, argc, argv) || perf.parseArgument(i, argc, argv)) {
+            continue;
+        } else if (arg == "--max-size" && hasValue) {
+            options.maxSize = static_cast<std::size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--bytes-per-point" && hasValue) {
+            options.bytesPerPoint = static_cast<std::size_t>(std::stoull(argv[++i]));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--max-size BYTES] [--bytes-per-point BYTES] "
+                      << PerfCounters::usage() << " " << lsm_bench::Reporter::usage() << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+// compiler barrier: the copy into p must be assumed to be observed
+void doNotOptimize(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(p) : "memory");
+#else
+    static const void *volatile sink = nullptr;
+    sink = p;
+#endif
+}
+
+std::vector<std::size_t> sweepSizes(const std::size_t maxSize) {
+    std::vector<std::size_t> sizes;
+    for (std::size_t size = 8; size <= maxSize; size *= 4) {
+        sizes.push_back(size);
+    }
+    if (sizes.empty() || sizes.back() != maxSize) {
+        sizes.push_back(maxSize);
+    }
+    return sizes;
+}
+
+// enough iterations to move bytesPerPoint, bounded so tiny sizes finish quickly
+int iterationsFor(const Options &options, const std::size_t size) {
+    const std::size_t wanted = options.bytesPerPoint / size;
+    return static_cast<int>(std::clamp<std::size_t>(wanted, 5, 2000000));
+}
+
+struct Measurement {
+    double gbps = 0.0;
+    int iterations = 0;
+    PerfSample counters;
+};
+
+// runs body once to fault in pages, then times the requested iterations
+template <typename Body>
+Measurement measure(const std::size_t size, const int iterations, PerfCounters &perf, Body &&body) {
+    body();
+    perf.start();
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        body();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    Measurement m;
+    m.counters = perf.stop();
+    m.iterations = iterations;
+    const double seconds = std::chrono::duration<double>(t1 - t0).count();
+    m.gbps = seconds > 0.0 ? static_cast<double>(size) * iterations / seconds / 1e9 : 0.0;
+    return m;
+}
+
+struct SweepPoint {
+    std::size_t size;
+    Measurement memcpy;
+    Measurement streamWrite;
+    Measurement streamRead;
+    Measurement queueRoundTrip;
+};
+
+SweepPoint runPoint(const Options &options, const std::size_t size, PerfCounters &perf) {
+    const int iterations = iterationsFor(options, size);
+    const std::string payload(size, 'x');
+    SweepPoint point{size, {}, {}, {}, {}};
+
+    std::vector<char> target(size);
+    point.memcpy = measure(size, iterations, perf, [&]() {
+        std::memcpy(target.data(), payload.data(), size);
+        // keep the copy observable so it is not optimized away
+        doNotOptimize(target.data());
+    });
+
+    {
+        const std::size_t bufferSize = size + dataOffset;
+        SharedMemoryWriteStream writer{"bench_sweep_stream", bufferSize, true};
+        SharedMemoryReadStream reader{"bench_sweep_stream", bufferSize, true};
+
+        point.streamWrite = measure(size, iterations, perf, [&]() { writer.write(payload); });
+
+        std::size_t checksum = 0;
+        point.streamRead = measure(size, iterations, perf, [&]() { checksum += reader.readString().size(); });
+        if (checksum == 0) {
+            std::cerr << "stream read returned no data" << std::endl;
+        }
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+    }
+
+    {
+        const auto maxMessageSize = static_cast<std::uint32_t>(size);
+        SharedMemoryQueue writer{"bench_sweep_queue", 2, maxMessageSize, true, true};
+        SharedMemoryQueue reader{"bench_sweep_queue", 2, maxMessageSize, true, false};
+
+        std::string message;
+        point.queueRoundTrip = measure(size, iterations, perf, [&]() {
+            writer.enqueue(payload);
+            reader.dequeue(message);
+        });
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+    }
+
+    return point;
+}
+
+std::string formatSize(const std::size_t bytes) {
+    if (bytes >= (std::size_t{1} << 20)) {
+        return std::to_string(bytes >> 20) + "M";
+    }
+    if (bytes >= (std::size_t{1} << 10)) {
+        return std::to_string(bytes >> 10) + "K";
+    }
+    return std::to_string(bytes);
+}
+
+void printPoint(const SweepPoint &p) {
+    const double base = p.memcpy.gbps;
+    const auto ofMemcpy = [&](const double gbps) { return base > 0.0 ? gbps / base * 100.0 : 0.0; };
+    std::cout << std::right << std::setw(6) << formatSize(p.size)
+              << std::fixed << std::setprecision(2)
+              << "  memcpy=" << std::setw(7) << base
+              << "  stream_write=" << std::setw(7) << p.streamWrite.gbps
+              << " (" << std::setprecision(0) << std::setw(3) << ofMemcpy(p.streamWrite.gbps) << "%)"
+              << std::setprecision(2)
+              << "  stream_read=" << std::setw(7) << p.streamRead.gbps
+              << " (" << std::setprecision(0) << std::setw(3) << ofMemcpy(p.streamRead.gbps) << "%)"
+              << std::setprecision(2)
+              << "  queue_rtt=" << std::setw(7) << p.queueRoundTrip.gbps
+              << " (" << std::setprecision(0) << std::setw(3) << ofMemcpy(p.queueRoundTrip.gbps) << "%)"
+              << std::endl;
+    for (const auto &[name, m] : {std::pair{"memcpy", &p.memcpy}, std::pair{"stream_write", &p.streamWrite},
+                                  std::pair{"stream_read", &p.streamRead}, std::pair{"queue_rtt", &p.queueRoundTrip}}) {
+        m->counters.printPerOp(m->iterations, name);
+    }
+}
+
+Record toRecord(const std::string &scenario, const std::size_t size, const Measurement &m, const MetricKind kind) {
+    Record record{"sweep", scenario + "/bytes=" + std::to_string(size), {}};
+    record.add("gbps", m.gbps, kind);
+    m.counters.addPerOp(record, m.iterations);
+    return record;
+}
+
+void addRecords(lsm_bench::Reporter &reporter, const SweepPoint &p) {
+    // memcpy is the machine's roofline, not a property of the library
+    reporter.add(toRecord("memcpy", p.size, p.memcpy, MetricKind::Info));
+    reporter.add(toRecord("stream_write", p.size, p.streamWrite, MetricKind::Throughput));
+    reporter.add(toRecord("stream_read", p.size, p.streamRead, MetricKind::Throughput));
+    reporter.add(toRecord("queue_rtt", p.size, p.queueRoundTrip, MetricKind::Throughput));
+}
+
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    lsm_bench::Reporter reporter;
+    PerfCounters perf;
+    const Options options = parseOptions(argc, argv, reporter, perf);
+
+    std::cout << "libsharedmemory payload-size sweep (GB/s, % of memcpy)" << std::endl;
+    std::cout << "------------------------------------------------------" << std::endl;
+
+    for (const std::size_t size : sweepSizes(options.maxSize)) {
+        const SweepPoint point = runPoint(options, size, perf);
+        printPoint(point);
+        addRecords(reporter, point);
+    }
+    return reporter.finish();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// Log-linear latency histogram in the style of HdrHistogram.
+//
+// Values below 128 are counted exactly; above that every power of two is
+// split into 64 equal sub-buckets, which bounds the relative error of any
+// reported percentile to 1/64 (~1.6%) while covering the full uint64 range
+// in a fixed 3.8k-bucket array. Recording is a shift and an increment, cheap
+// enough to keep every sample of a benchmark run.
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace lsm_bench {
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : _counts(kBucketCount, 0) {}
+
+    void record(const std::uint64_t value) {
+        ++_counts[indexOf(value)];
+        ++_total;
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+        _sum += static_cast<double>(value);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            _counts[i] += other._counts[i];
+        }
+        _total += other._total;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+        _sum += other._sum;
+    }
+
+    void reset() {
+        std::fill(_counts.begin(), _counts.end(), 0);
+        _total = 0;
+        _min = std::numeric_limits<std::uint64_t>::max();
+        _max = 0;
+        _sum = 0.0;
+    }
+
+    [[nodiscard]] std::uint64_t count() const { return _total; }
+    [[nodiscard]] std::uint64_t min() const { return _total ? _min : 0; }
+    [[nodiscard]] std::uint64_t max() const { return _max; }
+    [[nodiscard]] double mean() const { return _total ? _sum / static_cast<double>(_total) : 0.0; }
+
+    // value at the given percentile (0..100), reported as the upper edge of
+    // its bucket and clamped to the recorded maximum
+    [[nodiscard]] std::uint64_t percentile(const double pct) const {
+        if (_total == 0) {
+            return 0;
+        }
+        const double clamped = std::clamp(pct, 0.0, 100.0);
+        auto rank = static_cast<std::uint64_t>(clamped / 100.0 * static_cast<double>(_total) + 0.5);
+        rank = std::clamp<std::uint64_t>(rank, 1, _total);
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return std::min(upperEdgeOf(i), _max);
+            }
+        }
+        return _max;
+    }
+
+private:
+    static constexpr unsigned kLinearBits = 7;                     // exact below 128
+    static constexpr std::uint64_t kLinear = 1ULL << kLinearBits;
+    static constexpr std::uint64_t kHalf = kLinear / 2;            // sub-buckets per power of two
+    static constexpr std::size_t kBucketCount = kLinear + (64 - kLinearBits + 1) * kHalf;
+
+    static std::size_t indexOf(const std::uint64_t value) {
+        if (value < kLinear) {
+            return static_cast<std::size_t>(value);
+        }
+        const unsigned shift = static_cast<unsigned>(std::bit_width(value)) - kLinearBits;
+        const std::uint64_t mantissa = value >> shift; // in [kHalf, kLinear)
+        return static_cast<std::size_t>(kLinear + (shift - 1) * kHalf + (mantissa - kHalf));
+    }
+
+    static std::uint64_t upperEdgeOf(const std::size_t index) {
+        if (index < kLinear) {
+            return index;
+        }
+        const std::uint64_t shift = (index - kLinear) / kHalf + 1;
+        const std::uint64_t mantissa = (index - kLinear) % kHalf + kHalf;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t> _counts;
+    std::uint64_t _total = 0;
+    std::uint64_t _min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t _max = 0;
+    double _sum = 0.0;
+};
+
+} // namespace lsm_bench
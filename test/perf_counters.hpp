@@ -0,0 +1,204 @@
+#pragma once
+
+// Optional hardware performance counters for the benchmarks (Linux only).
+//
+// A PerfCounters object opens one perf_event_open counter per event when a
+// scenario starts and reads them back when it stops. Counters are opened
+// with inherit=1 so threads and processes spawned by the scenario are
+// included; they are not grouped, since the kernel rejects grouped reads
+// of inherited events, and each value is scaled by its enabled/running
+// time in case the PMU multiplexed them.
+//
+// Events the kernel refuses (perf_event_paranoid, containers, VMs without a
+// virtual PMU) are reported once on stderr and left out of the results, so
+// --perf never makes a benchmark fail.
+//
+// HITM (a load that hit a line modified in another core's cache) has no
+// generic perf event; on Intel it is the raw event 0x04D2
+// (MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM, XSNP_FWD on newer cores). Other CPUs
+// need --perf-hitm RAWCONFIG from their PMU documentation.
+
+#include "benchmark_report.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace lsm_bench {
+
+struct PerfSample {
+    std::vector<std::pair<std::string, double>> values;
+
+    [[nodiscard]] bool empty() const { return values.empty(); }
+
+    [[nodiscard]] double get(const std::string &name) const {
+        for (const auto &[n, v] : values) {
+            if (n == name) return v;
+        }
+        return -1.0;
+    }
+
+    void addPerOp(Record &record, const double operations) const {
+        if (operations <= 0.0) return;
+        for (const auto &[name, value] : values) {
+            record.add(name + "_per_op", value / operations);
+        }
+        const double cycles = get("cycles");
+        const double instructions = get("instructions");
+        if (cycles > 0.0 && instructions >= 0.0) {
+            record.add("ipc", instructions / cycles);
+        }
+    }
+
+    void printPerOp(const double operations, const std::string &label = {}) const {
+        if (empty() || operations <= 0.0) return;
+        std::cout << "    perf/op" << (label.empty() ? "" : " " + label) << ":" << std::fixed << std::setprecision(2);
+        for (const auto &[name, value] : values) {
+            std::cout << " " << name << "=" << value / operations;
+        }
+        const double cycles = get("cycles");
+        if (cycles > 0.0 && get("instructions") >= 0.0) {
+            std::cout << " ipc=" << get("instructions") / cycles;
+        }
+        std::cout << std::endl;
+    }
+};
+
+class PerfCounters {
+public:
+    // consumes --perf and --perf-hitm RAWCONFIG at argv[i]
+    bool parseArgument(int &i, const int argc, char *argv[]) {
+        const std::string arg = argv[i];
+        if (arg == "--perf") {
+            _enabled = true;
+            return true;
+        }
+        if (arg == "--perf-hitm" && i + 1 < argc) {
+            _enabled = true;
+            _hitmConfig = std::stoull(argv[++i], nullptr, 0);
+            return true;
+        }
+        return false;
+    }
+
+    static const char *usage() { return "[--perf] [--perf-hitm RAWCONFIG]"; }
+
+    [[nodiscard]] bool enabled() const { return _enabled; }
+
+    void start() {
+        if (!_enabled) return;
+#if defined(__linux__)
+        if (!_hitmChecked) {
+            _hitmChecked = true;
+            if (_hitmConfig == 0 && isIntel()) {
+                _hitmConfig = 0x04D2;
+            }
+        }
+        open("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open("llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        if (_hitmConfig != 0) {
+            open("hitm", PERF_TYPE_RAW, _hitmConfig);
+        } else {
+            warnOnce("hitm", "no raw event known for this CPU, pass --perf-hitm");
+        }
+        open("context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+#else
+        warnOnce("perf", "hardware counters are only supported on Linux");
+#endif
+    }
+
+    PerfSample stop() {
+        PerfSample sample;
+#if defined(__linux__)
+        for (const Counter &counter : _counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+            std::uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+            if (read(counter.fd, data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[2] > 0) {
+                const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+                sample.values.emplace_back(counter.name, static_cast<double>(data[0]) * scale);
+            }
+            close(counter.fd);
+        }
+        _counters.clear();
+#endif
+        return sample;
+    }
+
+private:
+#if defined(__linux__)
+    struct Counter {
+        std::string name;
+        int fd;
+    };
+
+    static bool isIntel() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+        __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+        char vendor[13] = {0};
+        std::memcpy(vendor, &ebx, 4);
+        std::memcpy(vendor + 4, &edx, 4);
+        std::memcpy(vendor + 8, &ecx, 4);
+        return std::strcmp(vendor, "GenuineIntel") == 0;
+#else
+        return false;
+#endif
+    }
+
+    static int openEvent(const std::uint32_t type, const std::uint64_t config, const bool excludeKernel) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.exclude_kernel = excludeKernel ? 1 : 0;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    void open(const std::string &name, const std::uint32_t type, const std::uint64_t config) {
+        int fd = openEvent(type, config, false);
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+            // perf_event_paranoid >= 2 still allows user-space-only counting
+            fd = openEvent(type, config, true);
+        }
+        if (fd < 0) {
+            warnOnce(name, std::strerror(errno));
+            return;
+        }
+        _counters.push_back({name, fd});
+    }
+
+    std::vector<Counter> _counters;
+#endif
+
+    void warnOnce(const std::string &name, const std::string &reason) {
+        for (const std::string &warned : _warned) {
+            if (warned == name) return;
+        }
+        _warned.push_back(name);
+        std::cerr << "perf: " << name << " unavailable (" << reason << ")" << std::endl;
+    }
+
+    bool _enabled = false;
+    bool _hitmChecked = false;
+    std::uint64_t _hitmConfig = 0;
+    std::vector<std::string> _warned;
+};
+
+} // namespace lsm_bench
@@ -11,6 +11,8 @@
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
+#include <cstdio>
+#include <limits>
 
 using namespace std;
 using namespace lsm;
@@ -912,6 +914,1515 @@ const lest::test specification[] =
         writer.destroy();
     },
 
+    // Dirty-range tracking: writeRange() patches the payload in place and
+    // stamps only the touched blocks, so readChangedRanges() copies just those
+    // blocks into the reader's mirror. The first sync is always a full copy.
+    CASE("writeRange updates a subrange and readChangedRanges copies only dirty blocks")
+    {
+        constexpr std::size_t blockSize = 256;
+        SharedMemoryWriteStream writer{"dirtyRangePipe", 16384, true, {.dirtyBlockSize = blockSize}};
+        SharedMemoryReadStream reader{"dirtyRangePipe", 16384, true};
+
+        const std::string frame(4096, 'a');
+        writer.write(frame);
+
+        std::string mirror;
+        auto ranges = reader.readChangedRanges(mirror);
+        EXPECT(ranges.size() == 1UL);
+        EXPECT(mirror == frame);
+
+        // nothing changed since the last sync
+        EXPECT(reader.readChangedRanges(mirror).empty());
+
+        // two patches in distinct blocks, one straddling a block boundary
+        writer.writeRange(10, "xyz");
+        writer.writeRange(blockSize * 3 - 1, "12");
+
+        std::string expected = frame;
+        expected.replace(10, 3, "xyz");
+        expected.replace(blockSize * 3 - 1, 2, "12");
+
+        ranges = reader.readChangedRanges(mirror);
+        EXPECT(ranges.size() == 2UL);
+        EXPECT(ranges[0].offset == 0UL);
+        EXPECT(ranges[0].size == blockSize);
+        EXPECT(ranges[1].offset == blockSize * 2);
+        EXPECT(ranges[1].size == blockSize * 2);
+        EXPECT(mirror == expected);
+        EXPECT(reader.readString() == expected);
+
+        // appending at the end grows the payload
+        writer.writeRange(frame.size(), "tail");
+        ranges = reader.readChangedRanges(mirror);
+        EXPECT(ranges.size() == 1UL);
+        EXPECT(mirror == expected + "tail");
+
+        // ranges must start inside the payload and fit the buffer
+        EXPECT_THROWS(writer.writeRange(frame.size() + 100, "gap"));
+        EXPECT_THROWS(writer.writeRange(0, std::string(20000, 'z')));
+
+        log_test_message("writeRange + readChangedRanges dirty blocks: SUCCESS");
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+    },
+
+    // The large-copy kernels (streaming stores / prefetching loads) must be
+    // byte-exact for every length and alignment, including the unaligned head
+    // and the sub-vector tail. Lowering the threshold forces them onto small
+    // buffers and onto the stream and queue copy paths.
+    CASE("Large-copy kernels are byte-exact for all sizes and alignments")
+    {
+        // restored even when an EXPECT throws, or later cases would run on the kernels
+        struct ThresholdGuard
+        {
+            std::size_t previous;
+            ~ThresholdGuard()
+            {
+                setLargeCopyThreshold(previous);
+            }
+        } restoreThreshold{largeCopyThreshold()};
+        setLargeCopyThreshold(0);
+
+        std::vector<char> source(8192);
+        for (std::size_t i = 0; i < source.size(); ++i) {
+            source[i] = static_cast<char>((i * 131) ^ (i >> 7));
+        }
+
+        int mismatches = 0;
+        for (std::size_t misalign = 0; misalign < 64; misalign += 7) {
+            for (std::size_t length : {0UL, 1UL, 31UL, 64UL, 255UL, 1000UL, 4097UL, 8000UL}) {
+                std::vector<char> target(8192 + 64, 0);
+                copyToShared(&target[misalign], source.data(), length);
+                if (std::memcmp(&target[misalign], source.data(), length) != 0) ++mismatches;
+
+                std::vector<char> back(8192 + 64, 0);
+                copyFromShared(&back[misalign], &target[misalign], length);
+                if (std::memcmp(&back[misalign], source.data(), length) != 0) ++mismatches;
+            }
+        }
+        EXPECT(mismatches == 0);
+
+        SharedMemoryWriteStream writer{"largeCopyPipe", 1 << 20, true};
+        SharedMemoryReadStream reader{"largeCopyPipe", 1 << 20, true};
+        const std::string frame(500000, 'q');
+        writer.write(frame);
+        EXPECT(reader.readString() == frame);
+
+        SharedMemoryQueue qWriter{"largeCopyQueue", 2, 4096, true, true};
+        SharedMemoryQueue qReader{"largeCopyQueue", 2, 4096, true, false};
+        const std::string message(source.data(), 4000);
+        EXPECT(qWriter.enqueue(message));
+        std::string received;
+        EXPECT(qReader.dequeue(received));
+        EXPECT(received == message);
+
+        std::ostringstream report;
+        report << "Large-copy kernels byte-exact (kernel="
+               << static_cast<int>(activeCopyKernel()) << "): SUCCESS";
+        log_test_message(report.str());
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+        qWriter.close();
+        qReader.close();
+        qWriter.destroy();
+    },
+
+    // Parallel copy: with a thread pool attached, a large payload is split
+    // into chunks copied by several threads on both the write and the read
+    // side. The frame must arrive intact and be published as one revision.
+    CASE("Parallel copy through a shared thread pool round-trips large frames")
+    {
+        auto pool = std::make_shared<CopyThreadPool>(3, 64 * 1024);
+
+        SharedMemoryWriteStream writer{"parallelCopyPipe", 4 << 20, true};
+        SharedMemoryReadStream reader{"parallelCopyPipe", 4 << 20, true};
+        writer.setCopyThreadPool(pool);
+        reader.setCopyThreadPool(pool);
+
+        std::vector<float> frame(900000);
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = static_cast<float>(i) * 0.5f;
+        }
+
+        for (int round = 0; round < 5; ++round) {
+            frame[static_cast<std::size_t>(round) * 1000] = -1.0f * static_cast<float>(round);
+            writer.write(std::span<const float>(frame));
+
+            EXPECT(reader.hasNewData());
+            EXPECT(reader.readLength(kMemoryTypeFloat) == frame.size());
+            float* received = reader.readFloatArray();
+            EXPECT(std::memcmp(received, frame.data(), frame.size() * sizeof(float)) == 0);
+            delete[] received;
+
+            reader.markAsRead();
+            EXPECT(writer.isMessageRead());
+        }
+
+        const std::string text(3 << 20, 'p');
+        writer.write(text);
+        EXPECT(reader.readString() == text);
+
+        log_test_message("Parallel copy (3 workers + caller): SUCCESS");
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+    },
+
+    CASE("Statistics blocks count stream and queue activity")
+    {
+        SharedMemoryWriteStream writer{"statsPipe", 1024, true, {.statistics = true}};
+        SharedMemoryReadStream reader{"statsPipe", 1024, true};
+
+        writer.write("one");
+        writer.write("three");
+        const float values[] = {1.0f, 2.0f};
+        writer.write(values, 2);
+        float* received = reader.readFloatArray();
+        EXPECT(received[1] == 2.0f);
+        delete[] received;
+        writer.write("seven");
+        EXPECT(reader.readString() == "seven");
+
+        // the payload must still fit in front of the statistics block
+        EXPECT_THROWS(writer.write(std::string(1024 - dataOffset, 'x')));
+
+        const auto streamStats = reader.statistics();
+        EXPECT(streamStats.has_value());
+        EXPECT(streamStats->writes == 4);
+        EXPECT(streamStats->bytesWritten == 3 + 5 + 8 + 5);
+        EXPECT(streamStats->writerLockAcquisitions == 4);
+        EXPECT(streamStats->reads == 2);
+        EXPECT(streamStats->bytesRead == 8 + 5);
+        EXPECT(streamStats->readerLockAcquisitions == 2);
+        EXPECT(writer.statistics()->reads == 2);
+
+        SharedMemoryWriteStream plainWriter{"statsPlainPipe", 256, true};
+        EXPECT(!plainWriter.statistics().has_value());
+
+        QueueOptions options{.statistics = true};
+        SharedMemoryQueue producer{"statsQueue", 2, 16, true, true, options};
+        SharedMemoryQueue consumer{"statsQueue", 2, 16, true, false, options};
+        EXPECT_THROWS(SharedMemoryQueue("statsQueue", 2, 16, true, false));
+
+        EXPECT(producer.enqueue("ab"));
+        EXPECT(producer.enqueue("cde"));
+        EXPECT(!producer.enqueue("full"));
+        std::string message;
+        EXPECT(consumer.dequeue(message));
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == "cde");
+        EXPECT(!consumer.dequeue(message));
+
+        const auto queueStats = consumer.statistics();
+        EXPECT(queueStats.has_value());
+        EXPECT(queueStats->enqueues == 2);
+        EXPECT(queueStats->bytesEnqueued == 5);
+        EXPECT(queueStats->fullRejections == 1);
+        EXPECT(queueStats->highWaterMark == 2);
+        EXPECT(queueStats->producerLockAcquisitions == 3);
+        EXPECT(queueStats->dequeues == 2);
+        EXPECT(queueStats->bytesDequeued == 5);
+        EXPECT(queueStats->emptyRejections == 1);
+        EXPECT(queueStats->consumerLockAcquisitions == 3);
+
+        log_test_message("Stream and queue statistics blocks: SUCCESS");
+
+        writer.close();
+        reader.close();
+        writer.destroy();
+        plainWriter.close();
+        plainWriter.destroy();
+        producer.close();
+        consumer.close();
+        producer.destroy();
+    },
+
+    CASE("Read-only inspection decodes stream and queue segments")
+    {
+        SharedMemoryWriteStream writer{"inspectPipe", 1024, true, {.statistics = true}};
+        writer.write("hello");
+        writer.write("inspect");
+
+        Memory view{"inspectPipe", 1024, true};
+        EXPECT(view.openReadOnly() == Error::OK);
+        EXPECT(view.readOnly());
+        const StreamSnapshot stream = inspectStream(view);
+        EXPECT(stream.dataType == kMemoryTypeString);
+        EXPECT(stream.revision == 2);
+        EXPECT(stream.ackLag() == 2);
+        EXPECT(stream.payloadSize == 7);
+        EXPECT(stream.lockHolder == 0);
+        EXPECT(stream.statistics.has_value());
+        EXPECT(stream.statistics->writes == 2);
+
+        // a held lock names its owner
+        Memory control{"inspectPipe", 1024, true};
+        EXPECT(control.open() == Error::OK);
+        auto& lock = *reinterpret_cast<std::atomic<std::uint32_t>*>(static_cast<char*>(control.data()) + lockOffset);
+        (void)lsm_sync_detail::acquireSpinLock(lock);
+        EXPECT(inspectStream(view).lockHolder == lsm_sync_detail::lockOwnerId());
+        EXPECT(inspectStream(view).lockHolder != 0u);
+        lsm_sync_detail::releaseSpinLock(lock);
+        EXPECT(inspectStream(view).lockHolder == 0);
+
+        SharedMemoryQueue producer{"inspectQueue", 4, 32, true, true, {.statistics = true}};
+        EXPECT(producer.enqueue("a"));
+        EXPECT(producer.enqueue("b"));
+        EXPECT(producer.enqueue("c"));
+
+        // the header alone is enough to size the segment
+        Memory header{"inspectQueue", queueHeaderSize, true};
+        EXPECT(header.openReadOnly() == Error::OK);
+        const QueueSnapshot probe = inspectQueue(header);
+        EXPECT(probe.capacity == 4);
+        EXPECT(probe.maxMessageSize == 32);
+        EXPECT(probe.count == 3);
+        EXPECT(!probe.statistics.has_value());
+
+        Memory whole{"inspectQueue", probe.segmentSize, true};
+        EXPECT(whole.openReadOnly() == Error::OK);
+        const QueueSnapshot queue = inspectQueue(whole);
+        EXPECT(queue.fillRatio() == 0.75);
+        EXPECT(queue.writeIndex == 3);
+        EXPECT(queue.producerLockHolder == 0);
+        EXPECT(queue.statistics.has_value());
+        EXPECT(queue.statistics->enqueues == 3);
+
+        log_test_message("Read-only inspection: SUCCESS");
+
+        writer.close();
+        writer.destroy();
+        producer.close();
+        producer.destroy();
+    },
+
+    CASE("Lock profiling records wait and hold histograms in a side segment")
+    {
+        SharedMemoryWriteStream writer{"lockProfPipe", 1024, true};
+        SharedMemoryReadStream reader{"lockProfPipe", 1024, true};
+        EXPECT(!writer.lockProfile().has_value());
+
+        writer.enableLockProfiling();
+        reader.enableLockProfiling();
+
+        std::thread readers([&reader] {
+            for (int i = 0; i < 200; ++i)
+            {
+                (void)reader.readString();
+            }
+        });
+        for (int i = 0; i < 300; ++i)
+        {
+            writer.write("profiled");
+        }
+        readers.join();
+
+        // both processes' views share one segment
+        const LockProfile profile = *reader.lockProfile();
+        EXPECT(profile.wait.count == 500);
+        EXPECT(profile.hold.count == 500);
+        std::uint64_t bucketed = 0;
+        for (const std::uint64_t bucket : profile.hold.buckets)
+        {
+            bucketed += bucket;
+        }
+        EXPECT(bucketed == 500);
+        EXPECT(profile.hold.percentileNs(0.5) <= profile.hold.percentileNs(0.99));
+        EXPECT(profile.hold.percentileNs(1.0) <= profile.hold.maxNs);
+        EXPECT(profile.hold.meanNs() > 0.0);
+
+        // a profiler attached later sees the same counts, and reset clears them for everyone
+        LockProfiler observer{"lockProfPipe"};
+        EXPECT(observer.snapshot(0).wait.count == 500);
+        observer.reset();
+        EXPECT(writer.lockProfile()->wait.count == 0);
+        EXPECT(writer.lockProfile()->hold.maxNs == 0);
+
+        SharedMemoryQueue producer{"lockProfQueue", 8, 16, true, true};
+        SharedMemoryQueue consumer{"lockProfQueue", 8, 16, true, false};
+        producer.enableLockProfiling();
+        consumer.enableLockProfiling();
+        EXPECT(producer.enqueue("a"));
+        EXPECT(producer.enqueue("b"));
+        std::string message;
+        EXPECT(consumer.dequeue(message));
+
+        const QueueLockProfile queueProfile = *consumer.lockProfile();
+        EXPECT(queueProfile.producer.wait.count == 2);
+        EXPECT(queueProfile.producer.hold.count == 2);
+        EXPECT(queueProfile.consumer.hold.count == 1);
+
+        // first users racing to set up a profile share one segment
+        LockProfiler::destroy("lockProfRace");
+        constexpr int racers = 8;
+        std::atomic<int> attached{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < racers; ++i)
+        {
+            threads.emplace_back([&attached] {
+                LockProfiler profiler{"lockProfRace"};
+                ++attached;
+                while (attached.load() < racers)
+                {
+                    std::this_thread::yield();
+                }
+                profiler.acquired(0, LockProfiler::now());
+                profiler.releasing(0);
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        LockProfiler raced{"lockProfRace"};
+        EXPECT(raced.snapshot(0).hold.count == static_cast<std::uint64_t>(racers));
+        LockProfiler::destroy("lockProfRace");
+
+        log_test_message("Lock profiling histograms: SUCCESS");
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+        consumer.close();
+        producer.destroy();
+        producer.close();
+    },
+
+    CASE("Queue timestamps record residence latency in the segment")
+    {
+        const QueueOptions options{.statistics = true, .timestamps = true};
+        SharedMemoryQueue producer{"stampQueue", 4, 32, true, true, options};
+        SharedMemoryQueue consumer{"stampQueue", 4, 32, true, false, options};
+        EXPECT_THROWS(SharedMemoryQueue("stampQueue", 4, 32, true, false, {.statistics = true}));
+
+        EXPECT(producer.enqueue("first"));
+        EXPECT(producer.enqueue("second"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        std::string message;
+        EXPECT(consumer.peek(message));
+        EXPECT(message == "first");
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == "first");
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == "second");
+        EXPECT(!consumer.dequeue(message));
+
+        // messages keep their full size next to the stamp
+        const std::string full(32, 'z');
+        EXPECT(producer.enqueue(full));
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == full);
+
+        const LatencyDistribution latency = *producer.latency();
+        EXPECT(latency.count == 3);
+        EXPECT(latency.maxNs >= 5'000'000u);
+        EXPECT(latency.percentileNs(0.5) >= 4'000'000u);
+        EXPECT(consumer.statistics()->dequeues == 3);
+
+        Memory header{"stampQueue", queueHeaderSize, true};
+        EXPECT(header.openReadOnly() == Error::OK);
+        Memory whole{"stampQueue", inspectQueue(header).segmentSize, true};
+        EXPECT(whole.openReadOnly() == Error::OK);
+        const QueueSnapshot snapshot = inspectQueue(whole);
+        EXPECT(snapshot.latency.has_value());
+        EXPECT(snapshot.latency->count == 3);
+        EXPECT(snapshot.statistics->enqueues == 3);
+
+        consumer.resetLatency();
+        EXPECT(producer.latency()->count == 0);
+
+        SharedMemoryQueue plain{"stampPlainQueue", 2, 8, true, true};
+        EXPECT(!plain.latency().has_value());
+
+        log_test_message("Queue residence latency: SUCCESS");
+
+        consumer.close();
+        producer.close();
+        producer.destroy();
+        plain.close();
+        plain.destroy();
+    },
+
+    CASE("Self-describing segments: readers discover size and parameters")
+    {
+        SharedMemoryWriteStream writer{"describedPipe", 4096, true, {.statistics = true}};
+        writer.write("discovered");
+
+        const auto streamInfo = probeSegment("describedPipe");
+        EXPECT(streamInfo.has_value());
+        EXPECT(streamInfo->type == SegmentType::Stream);
+        EXPECT(streamInfo->version == kSegmentVersion);
+        EXPECT(streamInfo->size == 4096);
+
+        SharedMemoryReadStream reader{"describedPipe", true};
+        EXPECT(reader.bufferSize() == 4096);
+        EXPECT(reader.readString() == "discovered");
+        EXPECT(reader.statistics().has_value());
+
+        // a wrong explicit size is rejected instead of mapping the wrong length
+        EXPECT_THROWS(SharedMemoryReadStream("describedPipe", 2048, true));
+        EXPECT_THROWS(SharedMemoryQueue("describedPipe", true));
+
+        Memory whole{"describedPipe", 0, true};
+        EXPECT(whole.open() == Error::OK);
+        EXPECT(whole.size() >= 4096u);
+
+        const QueueOptions options{.statistics = true, .timestamps = true};
+        SharedMemoryQueue producer{"describedQueue", 5, 48, true, true, options};
+        EXPECT(producer.enqueue("hello"));
+
+        SharedMemoryQueue consumer{"describedQueue", true};
+        EXPECT(consumer.capacity() == 5);
+        EXPECT(consumer.maxMessageSize() == 48);
+        std::string message;
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == "hello");
+        EXPECT(consumer.statistics()->dequeues == 1);
+        EXPECT(consumer.latency()->count == 1);
+        EXPECT(probeSegment("describedQueue")->type == SegmentType::Queue);
+
+        EXPECT_THROWS(SharedMemoryQueue("describedQueue", 6, 48, true, false, options));
+        EXPECT_THROWS(SharedMemoryReadStream("describedQueue", true));
+        EXPECT(!probeSegment("describedMissing").has_value());
+
+        log_test_message("Self-describing segments: SUCCESS");
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+        consumer.close();
+        producer.close();
+        producer.destroy();
+    },
+
+    CASE("Channel registry: many channels carved out of one segment")
+    {
+        SharedMemoryRegistry registry{"channelArena", 1 << 20, 64, true};
+        EXPECT(registry.directoryCapacity() == 64);
+
+        std::vector<std::unique_ptr<SharedMemoryWriteStream>> writers;
+        for (int i = 0; i < 40; ++i)
+        {
+            writers.push_back(std::make_unique<SharedMemoryWriteStream>(registry, "feed." + std::to_string(i), 1024));
+            writers.back()->write("tick " + std::to_string(i));
+        }
+        SharedMemoryQueue producer{registry, "orders", 8, 64, true, {.statistics = true}};
+        EXPECT(producer.enqueue("buy"));
+        EXPECT(registry.channelCount() == 41);
+
+        // another process maps the arena once and finds channels by name
+        SharedMemoryRegistry attached{"channelArena", true};
+        EXPECT(attached.channels().size() == 41);
+        for (int i = 0; i < 40; ++i)
+        {
+            SharedMemoryReadStream reader{attached, "feed." + std::to_string(i)};
+            EXPECT(reader.bufferSize() == 1024);
+            EXPECT(reader.readString() == "tick " + std::to_string(i));
+        }
+        SharedMemoryQueue consumer{attached, "orders"};
+        std::string message;
+        EXPECT(consumer.dequeue(message));
+        EXPECT(message == "buy");
+        EXPECT(consumer.statistics()->dequeues == 1);
+        EXPECT_THROWS(SharedMemoryQueue(attached, "orders", 9, 64, false));
+
+        // a writer re-registering the same channel takes over its region
+        SharedMemoryWriteStream again{registry, "feed.0", 1024};
+        again.write("fresh");
+        EXPECT(SharedMemoryReadStream(attached, "feed.0").readString() == "fresh");
+        EXPECT(registry.channelCount() == 41);
+
+        EXPECT_THROWS(SharedMemoryWriteStream(registry, "feed.0", 2048));
+        EXPECT_THROWS(SharedMemoryReadStream(attached, "missing"));
+        EXPECT_THROWS(SharedMemoryReadStream(attached, "orders"));
+        EXPECT_THROWS(SharedMemoryWriteStream(registry, std::string(101, 'x'), 1024));
+        EXPECT_THROWS(SharedMemoryWriteStream(registry, "huge", 2 << 20));
+
+        SharedMemoryRegistry small{"channelArenaSmall", 1 << 16, 2, true};
+        SharedMemoryWriteStream first{small, "a", 256};
+        SharedMemoryWriteStream second{small, "b", 256};
+        EXPECT_THROWS(SharedMemoryWriteStream(small, "c", 256));
+
+        // channels keep the arena mapped after the registry handle is closed
+        registry.close();
+        writers[1]->write("still mapped");
+        EXPECT(SharedMemoryReadStream(attached, "feed.1").readString() == "still mapped");
+
+        log_test_message("Channel registry: SUCCESS");
+
+        writers.clear();
+        attached.destroy();
+        small.destroy();
+    },
+
+    CASE("SharedAllocator: offsets are valid across mappings and blocks are never handed out twice")
+    {
+        SharedAllocator allocator{"sharedHeap", 4 << 20, true};
+        SharedAllocator attached{"sharedHeap", true};
+        EXPECT(attached.size() == allocator.size());
+
+        const SharedBlock small = allocator.allocate(100);
+        EXPECT(static_cast<bool>(small));
+        EXPECT(small.size == 128);
+        EXPECT(small.offset % 64 == 0);
+        std::memcpy(allocator.data(small), "built in place", 15);
+        EXPECT(std::string(attached.pointer<char>(small.offset)) == "built in place");
+        EXPECT(attached.offsetOf(attached.data(small)) == small.offset);
+
+        // a freed block is reused by any process attached to the segment
+        attached.deallocate(small);
+        EXPECT(allocator.allocate(128).offset == small.offset);
+
+        const SharedBlock large = allocator.allocate(1 << 20);
+        EXPECT(large.size == (1u << 20));
+        EXPECT(!allocator.allocate(0));
+        EXPECT(!allocator.allocate(allocator.maxAllocation() + 1));
+        EXPECT_THROWS(SharedAllocator("sharedHeapTiny", 1024, true));
+        EXPECT_THROWS(SharedAllocator("describedMissing", true));
+
+        // exhaust with large blocks, then everything handed back can be handed out again
+        std::vector<SharedBlock> blocks;
+        while (const SharedBlock block = allocator.allocate(256 << 10))
+        {
+            blocks.push_back(block);
+        }
+        EXPECT(!blocks.empty());
+        EXPECT(allocator.bytesReserved() <= allocator.size());
+        const std::size_t exhausted = blocks.size();
+        for (const SharedBlock& block : blocks)
+        {
+            allocator.deallocate(block);
+        }
+        blocks.clear();
+        while (const SharedBlock block = attached.allocate(256 << 10))
+        {
+            blocks.push_back(block);
+        }
+        EXPECT(blocks.size() == exhausted);
+
+        // threads with separate mappings allocate, stamp, verify and free concurrently
+        SharedAllocator heap{"sharedHeapThreads", 8 << 20, true};
+        std::atomic<int> collisions{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&collisions, t] {
+                SharedAllocator mine{"sharedHeapThreads", true};
+                std::vector<SharedBlock> held;
+                for (int i = 0; i < 20000; ++i)
+                {
+                    const SharedBlock block = mine.allocate(64 << (i % 4));
+                    if (!block)
+                    {
+                        continue;
+                    }
+                    std::memset(mine.data(block), t + 1, block.size);
+                    held.push_back(block);
+                    if (held.size() > 16)
+                    {
+                        const SharedBlock old = held.front();
+                        held.erase(held.begin());
+                        const auto bytes = mine.pointer<const unsigned char>(old.offset);
+                        if (bytes[0] != t + 1 || bytes[old.size - 1] != t + 1)
+                        {
+                            collisions.fetch_add(1);
+                        }
+                        mine.deallocate(old);
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        EXPECT(collisions.load() == 0);
+
+        log_test_message("SharedAllocator: SUCCESS");
+
+        heap.close();
+        heap.destroy();
+        attached.close();
+        allocator.close();
+        allocator.destroy();
+    },
+
+    CASE("Shared containers: structures built in one mapping are read in place through another")
+    {
+        struct Catalog
+        {
+            SharedVector<std::uint64_t> ids;
+            SharedString title;
+            SharedFlatMap<SharedString, SharedString> labels;
+
+            void release(SharedAllocator& allocator)
+            {
+                ids.release(allocator);
+                title.release(allocator);
+                labels.release(allocator);
+            }
+        };
+
+        SharedAllocator allocator{"sharedContainers", 4 << 20, true};
+        Catalog* catalog = allocator.construct<Catalog>();
+        for (std::uint64_t i = 0; i < 1000; ++i)
+        {
+            catalog->ids.pushBack(allocator, i * 3);
+        }
+        catalog->ids.erase(allocator, 0);
+        catalog->ids.emplace(allocator, 0, 42);
+        catalog->title.assign(allocator, "inventory");
+        catalog->title.append(allocator, " 2026");
+        catalog->labels.insertOrAssign(allocator, std::string_view{"region"}, std::string_view{"eu-west"});
+        catalog->labels.insertOrAssign(allocator, std::string_view{"owner"}, std::string_view{"ops"});
+        catalog->labels.insertOrAssign(allocator, std::string_view{"env"}, std::string_view{"staging"});
+        catalog->labels.insertOrAssign(allocator, std::string_view{"env"}, std::string_view{"production"});
+        allocator.setRoot(allocator.offsetOf(catalog));
+
+        // another mapping sits at a different address; offsets still resolve
+        SharedAllocator attached{"sharedContainers", true};
+        const Catalog* seen = attached.root<Catalog>();
+        EXPECT(seen != nullptr);
+        EXPECT(static_cast<const void*>(seen) != static_cast<const void*>(catalog));
+        EXPECT(seen->ids.size() == 1000);
+        EXPECT(seen->ids[0] == 42);
+        EXPECT(seen->ids[1] == 3);
+        EXPECT(seen->ids.back() == 999 * 3);
+        EXPECT_THROWS_AS((void)seen->ids.at(1000), std::out_of_range);
+        EXPECT(seen->title == "inventory 2026");
+        EXPECT(std::string(seen->title.cStr()) == "inventory 2026");
+        EXPECT(seen->labels.size() == 3);
+        EXPECT(seen->labels.begin()->key == "env"); // kept sorted
+        const SharedString* env = seen->labels.find(std::string_view{"env"});
+        EXPECT(env != nullptr);
+        EXPECT(*env == "production");
+        EXPECT(!seen->labels.contains(std::string_view{"zone"}));
+
+        EXPECT(catalog->labels.erase(allocator, std::string_view{"owner"}));
+        EXPECT(!catalog->labels.erase(allocator, std::string_view{"owner"}));
+        EXPECT(seen->labels.size() == 2);
+
+        // disposing of the root hands every nested block back to the allocator
+        const std::size_t reserved = allocator.bytesReserved();
+        allocator.setRoot(0);
+        allocator.dispose(catalog);
+        EXPECT(attached.root() == 0);
+        Catalog* again = attached.construct<Catalog>();
+        for (std::uint64_t i = 0; i < 1000; ++i)
+        {
+            again->ids.pushBack(attached, i);
+        }
+        EXPECT(allocator.bytesReserved() == reserved); // served from the freed blocks
+        attached.dispose(again);
+
+        log_test_message("Shared containers: SUCCESS");
+
+        attached.close();
+        allocator.close();
+        allocator.destroy();
+    },
+
+    CASE("SharedBufferPool: descriptors fan a buffer out to consumers without copying it")
+    {
+        constexpr std::uint32_t payloadSize = 2 << 20;
+        SharedBufferPool pool{"framePool", 4, payloadSize, true};
+        EXPECT(pool.available() == 4);
+
+        constexpr int consumers = 3;
+        std::vector<std::unique_ptr<SharedMemoryQueue>> producers;
+        for (int c = 0; c < consumers; ++c)
+        {
+            producers.push_back(std::make_unique<SharedMemoryQueue>("frameDescriptors" + std::to_string(c), 8,
+                                                                    sizeof(BufferDescriptor), true, true));
+        }
+
+        const std::optional<std::uint32_t> id = pool.acquire();
+        EXPECT(id.has_value());
+        EXPECT(pool.referenceCount(*id) == 1);
+        const std::span<std::byte> frame = pool.buffer(*id);
+        for (std::size_t i = 0; i < payloadSize; ++i)
+        {
+            frame[i] = static_cast<std::byte>(i * 7);
+        }
+        const BufferDescriptor descriptor{*id, 16, payloadSize - 16};
+
+        // one reference per consumer, then the producer drops its own
+        pool.retain(*id, consumers);
+        for (const auto& queue : producers)
+        {
+            EXPECT(queue->enqueue(descriptor));
+        }
+        EXPECT(!pool.release(*id));
+        EXPECT(pool.available() == 3);
+
+        std::atomic<int> mismatches{0};
+        std::atomic<int> returned{0};
+        std::vector<std::thread> threads;
+        for (int c = 0; c < consumers; ++c)
+        {
+            threads.emplace_back([&, c] {
+                SharedBufferPool mapped{"framePool", true};
+                SharedMemoryQueue queue{"frameDescriptors" + std::to_string(c), true};
+                BufferDescriptor received;
+                while (!queue.dequeue(received))
+                {
+                    std::this_thread::yield();
+                }
+                const std::span<const std::byte> bytes = mapped.payload(received);
+                for (std::size_t i = 0; i < bytes.size(); i += 4099)
+                {
+                    if (bytes[i] != static_cast<std::byte>((i + 16) * 7))
+                    {
+                        mismatches.fetch_add(1);
+                    }
+                }
+                if (bytes.size() != payloadSize - 16)
+                {
+                    mismatches.fetch_add(1);
+                }
+                if (mapped.release(received.buffer))
+                {
+                    returned.fetch_add(1);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        EXPECT(mismatches.load() == 0);
+        EXPECT(returned.load() == 1); // only the last release returns the buffer
+        EXPECT(pool.available() == 4);
+        EXPECT(pool.referenceCount(*id) == 0);
+
+        EXPECT_THROWS(pool.release(*id));
+        EXPECT_THROWS(pool.retain(*id));
+        EXPECT_THROWS((void)pool.buffer(4));
+        EXPECT_THROWS((void)pool.payload({0, payloadSize - 8, 16}));
+
+        // exhaustion, and reuse once a buffer comes back
+        std::vector<std::uint32_t> held;
+        while (const auto buffer = pool.acquire())
+        {
+            held.push_back(*buffer);
+        }
+        EXPECT(held.size() == 4);
+        EXPECT(pool.available() == 0);
+        EXPECT(pool.release(held.back()));
+        EXPECT(pool.acquire() == held.back());
+
+        // a descriptor queue rejects ordinary messages and leaves them queued
+        EXPECT(producers[0]->enqueue("hi"));
+        SharedMemoryQueue reader{"frameDescriptors0", true};
+        BufferDescriptor received;
+        EXPECT_THROWS(reader.dequeue(received));
+        EXPECT(reader.size() == 1);
+        std::string text;
+        EXPECT(reader.dequeue(text));
+        EXPECT(text == "hi");
+
+        log_test_message("SharedBufferPool: SUCCESS");
+
+        reader.close();
+        for (const auto& queue : producers)
+        {
+            queue->close();
+            queue->destroy();
+        }
+        pool.close();
+        pool.destroy();
+    },
+
+    CASE("SharedHashMap: concurrent updates from separate mappings, lookups never see torn values")
+    {
+        struct State
+        {
+            std::uint64_t price = 0;
+            std::uint64_t check = 0; // always ~price
+        };
+        using Symbol = std::array<char, 8>;
+        const auto symbol = [](const int i) {
+            Symbol key{};
+            std::snprintf(key.data(), key.size(), "S%06d", i);
+            return key;
+        };
+
+        SharedHashMap<Symbol, State> table{"sharedTable", 1000, true};
+        EXPECT(table.capacity() == 1024);
+        SharedHashMap<Symbol, State> attached{"sharedTable", true};
+        EXPECT(attached.capacity() == 1024);
+        EXPECT_THROWS((SharedHashMap<Symbol, std::uint32_t>{"sharedTable", true}));
+
+        EXPECT(table.store(symbol(1), State{10, ~std::uint64_t{10}}));
+        EXPECT(attached.find(symbol(1)).has_value());
+        EXPECT(attached.find(symbol(1))->price == 10);
+        EXPECT(!attached.find(symbol(2)).has_value());
+        EXPECT(attached.update(symbol(1), [](State& state) {
+            state.price += 5;
+            state.check = ~state.price;
+        }));
+        EXPECT(table.find(symbol(1))->price == 15);
+        EXPECT(table.size() == 1);
+
+        // writers in separate mappings update the same keys; a reader checks every copy
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0};
+        std::thread reader([&done, &torn, &symbol] {
+            SharedHashMap<Symbol, State> mine{"sharedTable", true};
+            while (!done.load())
+            {
+                for (int i = 0; i < 64; ++i)
+                {
+                    const std::optional<State> state = mine.find(symbol(i));
+                    if (state && state->check != ~state->price)
+                    {
+                        torn.fetch_add(1);
+                    }
+                }
+            }
+        });
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&symbol] {
+                SharedHashMap<Symbol, State> mine{"sharedTable", true};
+                for (int n = 0; n < 2000; ++n)
+                {
+                    mine.update(symbol(n % 64), [](State& state) {
+                        ++state.price;
+                        state.check = ~state.price;
+                    });
+                }
+            });
+        }
+        for (std::thread& writer : writers)
+        {
+            writer.join();
+        }
+        done.store(true);
+        reader.join();
+        EXPECT(torn.load() == 0);
+        EXPECT(table.size() == 64);
+        std::uint64_t total = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            total += table.find(symbol(i))->price;
+        }
+        EXPECT(total == 15 + 4 * 2000); // symbol(1) started at 15, no update was lost
+
+        // a full map still updates existing keys but takes no new ones
+        SharedHashMap<std::uint64_t, std::uint64_t> small{"sharedTableSmall", 4, true};
+        for (std::uint64_t key = 0; key < 4; ++key)
+        {
+            EXPECT(small.store(key, key * key));
+        }
+        EXPECT(!small.store(99, 1));
+        EXPECT(small.store(3, 1));
+        EXPECT(*small.find(3) == 1);
+        EXPECT(!small.contains(99));
+
+        // keys match by bytes, as they are hashed: no NaN claims a new bucket per store
+        SharedHashMap<double, int> byBits{"sharedTableDouble", 8, true};
+        EXPECT(byBits.store(0.0, 1));
+        EXPECT(byBits.store(-0.0, 2));
+        EXPECT(byBits.store(std::numeric_limits<double>::quiet_NaN(), 3));
+        EXPECT(byBits.store(std::numeric_limits<double>::quiet_NaN(), 4));
+        EXPECT(byBits.size() == 3u);
+        EXPECT(*byBits.find(0.0) == 1);
+        EXPECT(*byBits.find(-0.0) == 2);
+        EXPECT(*byBits.find(std::numeric_limits<double>::quiet_NaN()) == 4);
+        byBits.close();
+        byBits.destroy();
+
+        // an update that throws releases its bucket, keeping what it changed
+        EXPECT_THROWS((void)small.update(3, [](std::uint64_t& value) {
+            value = 7;
+            throw std::runtime_error("update failed");
+        }));
+        EXPECT(*small.find(3) == 7);
+        EXPECT(small.update(3, [](std::uint64_t& value) { ++value; }));
+        EXPECT(*small.find(3) == 8);
+
+        log_test_message("SharedHashMap: SUCCESS");
+
+        small.close();
+        small.destroy();
+        attached.close();
+        table.close();
+        table.destroy();
+    },
+
+    CASE("SharedValueTable: slots are updated independently and readers poll the keys that changed")
+    {
+        struct Quote
+        {
+            double bid = 0.0;
+            double ask = 0.0;
+        };
+
+        SharedValueTable table{"sharedQuotes", 1000, sizeof(Quote), 50, true};
+        EXPECT(table.ringCapacity() == 64);
+        SharedValueTable view{"sharedQuotes", true};
+        EXPECT(view.slotCount() == 1000);
+        EXPECT(view.valueSize() == sizeof(Quote));
+        EXPECT_THROWS(table.write(1000, Quote{}));
+        EXPECT_THROWS(table.write(0, std::uint32_t{1}));
+
+        TableCursor cursor = view.cursor();
+        table.write(7, Quote{99.5, 100.5});
+        table.write(42, Quote{10.0, 10.5});
+        table.write(7, Quote{99.75, 100.25});
+        EXPECT(view.read<Quote>(7).ask == 100.25);
+        EXPECT(view.version(7) == 2);
+        EXPECT(view.version(8) == 0);
+
+        std::vector<std::uint32_t> changed;
+        EXPECT(view.changes(cursor, changed));
+        EXPECT((changed == std::vector<std::uint32_t>{7, 42, 7}));
+        changed.clear();
+        EXPECT(view.changes(cursor, changed));
+        EXPECT(changed.empty());
+
+        std::vector<Quote> range(3);
+        view.readRange(41, 3, std::as_writable_bytes(std::span{range}));
+        EXPECT(range[1].bid == 10.0);
+        EXPECT(range[0].bid == 0.0);
+
+        // a reader more than the ring behind is told to rescan
+        for (std::uint32_t i = 0; i < 100; ++i)
+        {
+            table.write(i, Quote{static_cast<double>(i), 0.0});
+        }
+        EXPECT(!view.changes(cursor, changed));
+        EXPECT(view.changes(cursor, changed));
+        EXPECT(changed.empty());
+
+        // writers of separate keys and of the same key; the reader never sees a torn slot
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0};
+        std::thread reader([&done, &torn] {
+            SharedValueTable mine{"sharedQuotes", true};
+            while (!done.load())
+            {
+                for (std::uint32_t key = 500; key < 504; ++key)
+                {
+                    Quote quote;
+                    const std::uint64_t version = mine.read(key, std::as_writable_bytes(std::span{&quote, 1}));
+                    if (version != 0 && quote.ask != quote.bid + 1.0)
+                    {
+                        torn.fetch_add(1);
+                    }
+                }
+            }
+        });
+        std::vector<std::thread> writers;
+        for (std::uint32_t t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([t] {
+                SharedValueTable mine{"sharedQuotes", true};
+                for (int n = 0; n < 2000; ++n)
+                {
+                    mine.write(500 + (t + n) % 4, Quote{static_cast<double>(n), n + 1.0});
+                }
+            });
+        }
+        for (std::thread& writer : writers)
+        {
+            writer.join();
+        }
+        done.store(true);
+        reader.join();
+        EXPECT(torn.load() == 0);
+        EXPECT(view.version(500) + view.version(501) + view.version(502) + view.version(503) == 8000);
+
+        log_test_message("SharedValueTable: SUCCESS");
+
+        view.close();
+        table.close();
+        table.destroy();
+    },
+
+    CASE("SharedMemoryPriorityQueue: control messages overtake a backlog of bulk data")
+    {
+        SharedMemoryPriorityQueue writer{"priorityQueue", 3, 100, 32, true, true};
+        SharedMemoryPriorityQueue reader{"priorityQueue", true};
+        EXPECT(reader.lanes() == 3);
+        EXPECT(reader.capacity() == 100);
+        EXPECT(reader.maxMessageSize() == 32);
+        EXPECT_THROWS(writer.enqueue(3, "no such lane"));
+        EXPECT_THROWS((SharedMemoryPriorityQueue{"priorityQueueBad", 33, 1, 1, true, true}));
+        EXPECT_THROWS((SharedMemoryPriorityQueue{"priorityQueue", 2, 100, 32, true, false}));
+
+        for (int i = 0; i < 100; ++i)
+        {
+            EXPECT(writer.enqueue(2, "data-" + std::to_string(i)));
+        }
+        EXPECT(!writer.enqueue(2, "lane full"));
+        EXPECT(writer.enqueue(1, "flush"));
+        EXPECT(writer.enqueue(0, "cancel"));
+        EXPECT(reader.occupancy() == 0b111);
+        EXPECT(reader.size() == 102);
+
+        std::string message;
+        std::uint32_t lane = 99;
+        EXPECT(reader.dequeue(message, lane));
+        EXPECT(message == "cancel");
+        EXPECT(lane == 0);
+        EXPECT(reader.dequeue(message, lane));
+        EXPECT(message == "flush");
+        EXPECT(lane == 1);
+        EXPECT(reader.occupancy() == 0b100);
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "data-0");
+        EXPECT(writer.enqueue(0, "shutdown"));
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "shutdown");
+        for (int i = 1; i < 100; ++i)
+        {
+            EXPECT(reader.dequeue(message));
+            EXPECT(message == "data-" + std::to_string(i));
+        }
+        EXPECT(!reader.dequeue(message));
+        EXPECT(reader.isEmpty());
+
+        // a producer and a consumer racing on the occupancy bits lose nothing and keep lanes in order
+        std::thread producer([&writer] {
+            for (int i = 0; i < 3000; ++i)
+            {
+                while (!writer.enqueue(static_cast<std::uint32_t>(i % 3), std::to_string(i)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        int received = 0;
+        int outOfOrder = 0;
+        std::array<int, 3> last{-1, -1, -1};
+        while (received < 3000)
+        {
+            if (!reader.dequeue(message, lane))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            const int value = std::stoi(message);
+            outOfOrder += value % 3 != static_cast<int>(lane) || value <= last[lane] ? 1 : 0;
+            last[lane] = value;
+            ++received;
+        }
+        producer.join();
+        EXPECT(outOfOrder == 0);
+        EXPECT(reader.isEmpty());
+
+        // a producer preempted between its count increment and setting the lane bit can set
+        // the bit after the consumer emptied the lane; dequeue() must go by the lane counts
+        Memory raw{"priorityQueue", 0, true};
+        EXPECT(raw.open() == Error::OK);
+        auto& occupancy = *reinterpret_cast<std::atomic<std::uint32_t>*>(static_cast<char*>(raw.data())
+                                                                          + segmentHeaderSize + 12);
+        occupancy.fetch_or(0b001);
+        EXPECT(reader.occupancy() == 0b001);
+        EXPECT(!reader.dequeue(message));
+        EXPECT(reader.occupancy() == 0);
+        EXPECT(reader.size(0) == 0);
+
+        occupancy.fetch_or(0b011);
+        EXPECT(writer.enqueue(2, "behind stale bits"));
+        EXPECT(reader.dequeue(message, lane));
+        EXPECT(message == "behind stale bits");
+        EXPECT(lane == 2);
+        EXPECT(reader.isEmpty());
+        EXPECT(writer.enqueue(0, "lane 0 still works"));
+        EXPECT(reader.dequeue(message, lane));
+        EXPECT(lane == 0);
+        EXPECT(reader.size() == 0);
+        raw.close();
+
+        log_test_message("SharedMemoryPriorityQueue: SUCCESS");
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+    },
+
+    CASE("SharedMemoryQueue: overwrite mode evicts the oldest messages and counts them")
+    {
+        const QueueOptions options{.statistics = true, .timestamps = true, .overwrite = true};
+        SharedMemoryQueue writer{"overwriteQueue", 4, 64, true, true, options};
+        SharedMemoryQueue reader{"overwriteQueue", true};
+        EXPECT(reader.dropped().has_value());
+        EXPECT(*reader.dropped() == 0);
+        EXPECT(!SharedMemoryQueue("overwriteQueuePlain", 4, 64, true, true).dropped().has_value());
+
+        for (int i = 0; i < 10; ++i)
+        {
+            EXPECT(writer.enqueue("m" + std::to_string(i)));
+        }
+        EXPECT(reader.size() == 4);
+        EXPECT(*reader.dropped() == 6);
+        std::string message;
+        for (int i = 6; i < 10; ++i)
+        {
+            EXPECT(reader.dequeue(message));
+            EXPECT(message == "m" + std::to_string(i));
+        }
+        EXPECT(!reader.dequeue(message));
+
+        Memory inspected{"overwriteQueue", 0, true};
+        EXPECT(inspected.openReadOnly() == Error::OK);
+        EXPECT(inspectQueue(inspected).dropped == std::optional<std::uint64_t>{6});
+        inspected.close();
+
+        // a consumer holding its lock, stalled mid-dequeue, does not hold up the producer
+        Memory raw{"overwriteQueue", 0, true};
+        EXPECT(raw.open() == Error::OK);
+        auto& consumerLock = *reinterpret_cast<std::atomic<std::uint32_t>*>(static_cast<char*>(raw.data())
+                                                                             + segmentHeaderSize + 24);
+        EXPECT(consumerLock.exchange(lsm_sync_detail::lockOwnerId()) == 0u);
+        for (int i = 10; i < 110; ++i)
+        {
+            EXPECT(writer.enqueue("m" + std::to_string(i)));
+        }
+        EXPECT(reader.size() == 4);
+        EXPECT(*reader.dropped() == 102);
+        EXPECT(inspectQueue(raw).count == 4u);
+        consumerLock.store(0);
+        raw.close();
+        for (int i = 106; i < 110; ++i)
+        {
+            EXPECT(reader.dequeue(message));
+            EXPECT(message == "m" + std::to_string(i));
+        }
+        EXPECT(!reader.dequeue(message));
+
+        // a producer that never waits for the consumer: every message read is whole and in order
+        constexpr int total = 20000;
+        std::atomic<int> rejected{0};
+        std::thread producer([&writer, &rejected] {
+            for (int i = 0; i < total; ++i)
+            {
+                const std::string text = std::to_string(i);
+                std::string payload;
+                while (payload.size() + text.size() + 1 <= 64)
+                {
+                    payload += text + ":";
+                }
+                rejected += writer.enqueue(payload) ? 0 : 1;
+            }
+        });
+        int received = 0;
+        int broken = 0;
+        int last = -1;
+        while (true)
+        {
+            if (!reader.dequeue(message))
+            {
+                if (received + static_cast<int>(*reader.dropped()) - 102 == total)
+                {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            const int value = std::stoi(message);
+            const std::string text = std::to_string(value) + ":";
+            for (std::size_t at = 0; at < message.size(); at += text.size())
+            {
+                broken += message.compare(at, text.size(), text) != 0 ? 1 : 0;
+            }
+            broken += value <= last ? 1 : 0;
+            last = value;
+            ++received;
+        }
+        producer.join();
+        EXPECT(rejected.load() == 0);
+        EXPECT(broken == 0);
+        EXPECT(last == total - 1);
+
+        log_test_message("SharedMemoryQueue overwrite mode: dropped=" + std::to_string(*reader.dropped() - 102)
+                         + " of " + std::to_string(total));
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+    },
+
+    CASE("SharedMemoryQueue: fragmentation carries messages larger than a slot")
+    {
+        const QueueOptions options{.fragmentation = true};
+        SharedMemoryQueue writer{"fragmentedQueue", 8, 16, true, true, options};
+        SharedMemoryQueue reader{"fragmentedQueue", true};
+
+        std::string large;
+        for (int i = 0; large.size() < 60; ++i)
+        {
+            large += static_cast<char>('a' + i % 26);
+        }
+        EXPECT(writer.enqueue("small"));
+        EXPECT(writer.enqueue(large)); // 60 bytes in four 16-byte slots
+        EXPECT(writer.enqueue(std::string(16, 'x')));
+        EXPECT(reader.size() == 6);
+        EXPECT_THROWS(writer.enqueue(std::string(16 * 8 + 1, 'y')));
+        EXPECT(!writer.enqueue(std::string(48, 'z'))); // needs three slots, two are free
+
+        std::string message;
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "small");
+        EXPECT(reader.peek(message));
+        EXPECT(message == large);
+
+        std::size_t pieces = 0;
+        std::string joined;
+        EXPECT(reader.dequeueInPlace([&](const std::span<const std::span<const std::byte>> fragments) {
+            pieces = fragments.size();
+            for (const std::span<const std::byte>& fragment : fragments)
+            {
+                joined.append(reinterpret_cast<const char*>(fragment.data()), fragment.size());
+            }
+        }));
+        EXPECT(pieces == 4);
+        EXPECT(joined == large);
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == std::string(16, 'x'));
+        EXPECT(reader.isEmpty());
+
+        // a fragmented message wraps around the end of the ring
+        EXPECT(writer.enqueue(std::string(100, 'w')));
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == std::string(100, 'w'));
+
+        // overwrite mode evicts as many whole messages as the new one needs
+        const QueueOptions evicting{.overwrite = true, .fragmentation = true};
+        SharedMemoryQueue ring{"fragmentedRing", 4, 8, true, true, evicting};
+        SharedMemoryQueue ringReader{"fragmentedRing", true};
+        EXPECT(ring.enqueue("one"));
+        EXPECT(ring.enqueue("two"));
+        EXPECT(ring.enqueue(std::string(16, '3')));
+        EXPECT(ring.enqueue(std::string(12, '4')));
+        EXPECT(*ringReader.dropped() == 2);
+        EXPECT_THROWS(ringReader.dequeueInPlace([](const std::span<const std::span<const std::byte>>) {}));
+        EXPECT(ringReader.dequeue(message));
+        EXPECT(message == std::string(16, '3'));
+        EXPECT(ringReader.dequeue(message));
+        EXPECT(message == std::string(12, '4'));
+        EXPECT(ringReader.isEmpty());
+
+        ringReader.close();
+        ring.close();
+        ring.destroy();
+        reader.close();
+        writer.close();
+        writer.destroy();
+    },
+
+    CASE("SharedMemoryQueue: a transaction publishes its messages together or not at all")
+    {
+        const QueueOptions options{.statistics = true, .timestamps = true, .fragmentation = true};
+        SharedMemoryQueue writer{"transactionQueue", 8, 16, true, true, options};
+        SharedMemoryQueue reader{"transactionQueue", true};
+        EXPECT_THROWS(writer.commit());
+        EXPECT_THROWS(reader.beginTransaction());
+
+        std::string message;
+        writer.beginTransaction();
+        EXPECT(writer.inTransaction());
+        EXPECT_THROWS(writer.beginTransaction());
+        EXPECT(writer.enqueue("order"));
+        EXPECT(writer.enqueue(std::string(40, 'l'))); // a leg in three slots
+        EXPECT(writer.enqueue("leg 2"));
+        EXPECT(reader.isEmpty());
+        EXPECT(!reader.dequeue(message));
+        EXPECT(writer.commit() == 3);
+        EXPECT(!writer.inTransaction());
+        EXPECT(reader.size() == 5);
+        EXPECT(reader.statistics()->enqueues == 3);
+
+        // staged slots count against the capacity
+        writer.beginTransaction();
+        EXPECT(writer.enqueue("x"));
+        EXPECT(writer.enqueue("y"));
+        EXPECT(writer.enqueue("z"));
+        EXPECT(!writer.enqueue("full"));
+        writer.abort();
+        EXPECT(reader.size() == 5);
+
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "order");
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == std::string(40, 'l'));
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "leg 2");
+        EXPECT(reader.isEmpty());
+        EXPECT(reader.latency()->count == 3);
+
+        // the producer lock is free again once the transaction ends
+        EXPECT(writer.enqueue("after"));
+        writer.beginTransaction();
+        EXPECT(writer.commit() == 0);
+        EXPECT(reader.dequeue(message));
+        EXPECT(message == "after");
+
+        // a consumer racing a producer only ever sees whole groups
+        constexpr int groups = 2000;
+        std::thread producer([&writer] {
+            for (int group = 0; group < groups;)
+            {
+                writer.beginTransaction();
+                if (writer.enqueue(std::to_string(group) + ":a") && writer.enqueue(std::to_string(group) + ":b"))
+                {
+                    writer.commit();
+                    ++group;
+                }
+                else
+                {
+                    writer.abort();
+                    std::this_thread::yield();
+                }
+            }
+        });
+        int received = 0;
+        int broken = 0;
+        while (received < groups)
+        {
+            if (!reader.dequeue(message))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::string second;
+            broken += reader.dequeue(second) ? 0 : 1;
+            broken += message == std::to_string(received) + ":a" && second == std::to_string(received) + ":b" ? 0 : 1;
+            ++received;
+        }
+        producer.join();
+        EXPECT(broken == 0);
+
+        // a writer destroyed mid-transaction, here by unwinding, releases the producer lock
+        try
+        {
+            SharedMemoryQueue unwound{"transactionQueue", 8, 16, true, true, options};
+            unwound.beginTransaction();
+            EXPECT(unwound.enqueue("never published"));
+            throw std::runtime_error("unwind");
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        Memory inspected{"transactionQueue", 0, true};
+        EXPECT(inspected.openReadOnly() == Error::OK);
+        const std::uint32_t holder = inspectQueue(inspected).producerLockHolder;
+        inspected.close();
+        EXPECT(holder == 0u);
+        if (holder == 0)
+        {
+            EXPECT(writer.enqueue("next"));
+            EXPECT(reader.dequeue(message));
+            EXPECT(message == "next");
+        }
+        EXPECT(reader.isEmpty());
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+    },
+
+    CASE("SharedMemoryConflatingQueue: a backlog holds only the latest message per key")
+    {
+        SharedMemoryConflatingQueue writer{"conflatingQueue", 16, 32, true, true};
+        SharedMemoryConflatingQueue reader{"conflatingQueue", true};
+        EXPECT(reader.capacity() == 16);
+        EXPECT(reader.maxMessageSize() == 32);
+
+        for (int update = 0; update < 1000; ++update)
+        {
+            EXPECT(writer.enqueue(static_cast<std::uint64_t>(100 + update % 3), "v" + std::to_string(update)));
+        }
+        EXPECT(reader.size() == 3);
+        EXPECT(reader.conflated() == 997);
+
+        std::uint64_t key = 0;
+        std::string message;
+        EXPECT(reader.dequeue(key, message));
+        EXPECT(key == 100);
+        EXPECT(message == "v999");
+        EXPECT(writer.enqueue(100, "again")); // no longer pending, so it queues behind the others
+        EXPECT(reader.dequeue(key, message));
+        EXPECT(key == 101);
+        EXPECT(message == "v997");
+        EXPECT(reader.dequeue(key, message));
+        EXPECT(key == 102);
+        EXPECT(reader.dequeue(key, message));
+        EXPECT(key == 100);
+        EXPECT(message == "again");
+        EXPECT(!reader.dequeue(key, message));
+
+        for (std::uint64_t k = 0; k < 16; ++k)
+        {
+            EXPECT(writer.enqueue(k, "fill"));
+        }
+        EXPECT(!writer.enqueue(99, "full"));
+        EXPECT(writer.enqueue(5, "conflates even when full"));
+
+        // against a model: pending keys in first-enqueue order with their latest payload
+        std::vector<std::pair<std::uint64_t, std::string>> model;
+        while (reader.dequeue(key, message))
+        {
+        }
+        std::uint64_t seed = 7;
+        int mismatches = 0;
+        for (int step = 0; step < 20000; ++step)
+        {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            if ((seed >> 60) < 9)
+            {
+                const std::uint64_t k = (seed >> 20) % 40;
+                const std::string payload = std::to_string(step);
+                const auto pending = std::find_if(model.begin(), model.end(), [k](const auto& e) { return e.first == k; });
+                const bool accepted = writer.enqueue(k, payload);
+                if (pending != model.end())
+                {
+                    pending->second = payload;
+                    mismatches += accepted ? 0 : 1;
+                }
+                else if (model.size() < 16)
+                {
+                    model.emplace_back(k, payload);
+                    mismatches += accepted ? 0 : 1;
+                }
+                else
+                {
+                    mismatches += accepted ? 1 : 0;
+                }
+            }
+            else if (reader.dequeue(key, message))
+            {
+                mismatches += model.empty() || model.front() != std::make_pair(key, message) ? 1 : 0;
+                if (!model.empty())
+                {
+                    model.erase(model.begin());
+                }
+            }
+            else
+            {
+                mismatches += model.empty() ? 0 : 1;
+            }
+        }
+        EXPECT(mismatches == 0);
+        EXPECT(reader.size() == model.size());
+
+        log_test_message("SharedMemoryConflatingQueue: SUCCESS");
+
+        reader.close();
+        writer.close();
+        writer.destroy();
+    },
+
     // Boundary test: a queue with capacity=1 is the smallest valid queue.
     // Verifies it can hold exactly one message, rejects a second, and can be
     // reused after draining - exercising the circular index wrap at offset 0→0.
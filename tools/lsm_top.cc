@@ -0,0 +1,416 @@
+// lsm_top: live inspection of shared memory streams and queues.
+//
+// Maps the named segments read-only and periodically prints what they are
+// doing: stream revision, unacknowledged writes, payload size and lock
+// holder; queue depth, fill ratio, messages/s and lock holders; and the
+// in-segment statistics counters when the segment was created with them.
+// It never takes a segment lock, so it cannot stall a pipeline it watches.
+//
+// Usage: lsm_top [--interval MS] [--once] [--format text|openmetrics] [--output FILE] NAME...
+//
+// Whether NAME is a stream or a queue, and its size, come from the segment
+// header.
+//
+// --once --format openmetrics --output FILE writes a single OpenMetrics text
+// exposition (atomically, via rename) for a file-based scraper.
+
+#include <libsharedmemory/libsharedmemory.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#endif
+
+using namespace lsm;
+
+namespace {
+
+enum class Format { Text, OpenMetrics };
+
+struct Options {
+    std::vector<std::string> targets;
+    std::chrono::milliseconds interval{1000};
+    bool once = false;
+    Format format = Format::Text;
+    std::string output;
+};
+
+[[noreturn]] void usage(const char *argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--interval MS] [--once] [--format text|openmetrics] [--output FILE]"
+                 " NAME..."
+              << std::endl;
+    std::exit(2);
+}
+
+Options parseOptions(const int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--once") {
+            options.once = true;
+        } else if (arg == "--interval" && hasValue) {
+            options.interval = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--format" && hasValue) {
+            const std::string format = argv[++i];
+            if (format == "text") {
+                options.format = Format::Text;
+            } else if (format == "openmetrics") {
+                options.format = Format::OpenMetrics;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.targets.push_back(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (options.targets.empty()) {
+        usage(argv[0]);
+    }
+    return options;
+}
+
+struct Sample {
+    std::chrono::steady_clock::time_point time;
+    std::optional<StreamSnapshot> stream;
+    std::optional<QueueSnapshot> queue;
+};
+
+// maps the segment for the duration of one sample, so a recreated segment is
+// picked up on the next poll
+Sample takeSample(const std::string &name) {
+    Sample sample;
+    sample.time = std::chrono::steady_clock::now();
+
+    Memory memory{name, 0, true};
+    if (memory.openReadOnly() != Error::OK) {
+        return sample;
+    }
+    const std::optional<SegmentDescriptor> descriptor = readSegmentHeader(memory);
+    if (!descriptor) {
+        return sample;
+    }
+    if (descriptor->type == SegmentType::Stream) {
+        sample.stream = inspectStream(memory);
+    } else if (descriptor->type == SegmentType::Queue) {
+        sample.queue = inspectQueue(memory);
+    }
+    return sample;
+}
+
+std::string describeHolder(const std::uint32_t pid) {
+    if (pid == 0) {
+        return "free";
+    }
+    std::string text = "pid " + std::to_string(pid);
+#if !defined(_WIN32)
+    if (kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH) {
+        text += " (dead)";
+    }
+#endif
+    return text;
+}
+
+const char *dataTypeName(const std::uint8_t type) {
+    switch (type) {
+        case kMemoryTypeString: return "string";
+        case kMemoryTypeFloat: return "float[]";
+        case kMemoryTypeDouble: return "double[]";
+        default: return "none";
+    }
+}
+
+double perSecond(const double delta, const Sample &now, const Sample *previous) {
+    if (!previous) {
+        return -1.0;
+    }
+    const double seconds = std::chrono::duration<double>(now.time - previous->time).count();
+    return seconds > 0.0 ? delta / seconds : -1.0;
+}
+
+std::string formatRate(const double rate) {
+    if (rate < 0.0) {
+        return "-";
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << rate;
+    return out.str();
+}
+
+void printText(std::ostream &out, const std::string &name, const Sample &now, const Sample *previous) {
+    if (!now.stream && !now.queue) {
+        out << "?      " << std::left << std::setw(24) << name << " not found" << std::endl;
+        return;
+    }
+    if (now.stream) {
+        out << "stream " << std::left << std::setw(24) << name;
+        const StreamSnapshot &s = *now.stream;
+        const double writes = previous && previous->stream
+            ? perSecond(static_cast<double>(s.revision - previous->stream->revision), now, previous) : -1.0;
+        out << " revision=" << s.revision << " writes/s=" << formatRate(writes)
+            << " ack_lag=" << s.ackLag()
+            << " payload=" << s.payloadSize << "/" << s.dataCapacity << "B"
+            << " type=" << dataTypeName(s.dataType)
+            << " lock=" << describeHolder(s.lockHolder) << std::endl;
+        if (s.statistics) {
+            const StreamStatistics &st = *s.statistics;
+            out << "    writes=" << st.writes << " bytes_written=" << st.bytesWritten
+                << " reads=" << st.reads << " bytes_read=" << st.bytesRead
+                << " writer_lock=" << st.writerLockAcquisitions << "/" << st.writerLockSpins << " spins"
+                << " reader_lock=" << st.readerLockAcquisitions << "/" << st.readerLockSpins << " spins"
+                << std::endl;
+        }
+        return;
+    }
+
+    out << "queue  " << std::left << std::setw(24) << name;
+    const QueueSnapshot &q = *now.queue;
+    std::string in = "-";
+    std::string outRate = "-";
+    if (previous && previous->queue) {
+        const QueueSnapshot &p = *previous->queue;
+        if (q.statistics && p.statistics) {
+            in = formatRate(perSecond(static_cast<double>(q.statistics->enqueues - p.statistics->enqueues), now, previous));
+            outRate = formatRate(perSecond(static_cast<double>(q.statistics->dequeues - p.statistics->dequeues), now, previous));
+        } else if (q.capacity == p.capacity && q.capacity > 0) {
+            // without counters the indices only give a lower bound: they wrap at capacity
+            in = "~" + formatRate(perSecond((q.writeIndex + q.capacity - p.writeIndex) % q.capacity, now, previous));
+            outRate = "~" + formatRate(perSecond((q.readIndex + q.capacity - p.readIndex) % q.capacity, now, previous));
+        }
+    }
+    out << " depth=" << q.count << "/" << q.capacity
+        << " fill=" << std::fixed << std::setprecision(1) << q.fillRatio() * 100.0 << "%"
+        << " in/s=" << in << " out/s=" << outRate
+        << " max_message=" << q.maxMessageSize << "B"
+        << " producer_lock=" << describeHolder(q.producerLockHolder)
+        << " consumer_lock=" << describeHolder(q.consumerLockHolder);
+    if (q.dropped) {
+        out << " dropped=" << *q.dropped;
+    }
+    out << std::endl;
+    if (q.statistics) {
+        const QueueStatistics &st = *q.statistics;
+        out << "    enqueues=" << st.enqueues << " dequeues=" << st.dequeues
+            << " bytes_in=" << st.bytesEnqueued << " bytes_out=" << st.bytesDequeued
+            << " full=" << st.fullRejections << " empty=" << st.emptyRejections
+            << " high_water=" << st.highWaterMark
+            << " producer_lock=" << st.producerLockAcquisitions << "/" << st.producerLockSpins << " spins"
+            << " consumer_lock=" << st.consumerLockAcquisitions << "/" << st.consumerLockSpins << " spins"
+            << std::endl;
+    }
+    if (q.latency) {
+        const LatencyDistribution &l = *q.latency;
+        out << "    residence: messages=" << l.count << " mean=" << formatRate(l.meanNs() / 1000.0) << "us"
+            << " p50<=" << l.percentileNs(0.5) / 1000 << "us p99<=" << l.percentileNs(0.99) / 1000 << "us"
+            << " max=" << l.maxNs / 1000 << "us" << std::endl;
+    }
+}
+
+// OpenMetrics wants every sample of a family under a single TYPE line, so
+// samples are collected per family first and written in first-seen order
+class MetricsWriter {
+public:
+    void gauge(const std::string &family, const std::string &help, const std::string &labels, const double value) {
+        add(family, "gauge", help, family, labels, value);
+    }
+
+    void counter(const std::string &family, const std::string &help, const std::string &labels, const double value) {
+        add(family, "counter", help, family + "_total", labels, value);
+    }
+
+    void write(std::ostream &out) const {
+        for (const std::string &name : _order) {
+            const Family &family = _families.at(name);
+            out << "# TYPE " << name << " " << family.type << "\n"
+                << "# HELP " << name << " " << family.help << "\n";
+            for (const std::string &sample : family.samples) {
+                out << sample << "\n";
+            }
+        }
+        out << "# EOF\n";
+    }
+
+private:
+    struct Family {
+        std::string type;
+        std::string help;
+        std::vector<std::string> samples;
+    };
+
+    void add(const std::string &family, const char *type, const std::string &help, const std::string &sample,
+             const std::string &labels, const double value) {
+        auto found = _families.find(family);
+        if (found == _families.end()) {
+            _order.push_back(family);
+            found = _families.emplace(family, Family{type, help, {}}).first;
+        }
+        std::ostringstream line;
+        line << sample << "{" << labels << "} " << std::setprecision(12) << value;
+        found->second.samples.push_back(line.str());
+    }
+
+    std::map<std::string, Family> _families;
+    std::vector<std::string> _order;
+};
+
+std::string labelsFor(const std::string &name) {
+    std::string escaped;
+    for (const char c : name) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return "segment=\"" + escaped + "\"";
+}
+
+void collectMetrics(MetricsWriter &m, const std::string &name, const Sample &now) {
+    const std::string labels = labelsFor(name);
+    m.gauge("lsm_segment_up", "1 if the segment could be mapped and carries a known header", labels,
+            now.stream || now.queue ? 1 : 0);
+    if (now.stream) {
+        const StreamSnapshot &s = *now.stream;
+        m.gauge("lsm_stream_revision", "Write revision of the stream", labels, s.revision);
+        m.gauge("lsm_stream_ack_lag", "Writes not yet acknowledged by a reader", labels, s.ackLag());
+        m.gauge("lsm_stream_payload_bytes", "Size of the current payload", labels, s.payloadSize);
+        m.gauge("lsm_stream_capacity_bytes", "Largest payload the segment can hold", labels, static_cast<double>(s.dataCapacity));
+        m.gauge("lsm_stream_lock_holder_pid", "Process holding the stream lock, 0 when free", labels, s.lockHolder);
+        if (s.statistics) {
+            const StreamStatistics &st = *s.statistics;
+            m.counter("lsm_stream_writes", "Stream writes", labels, st.writes);
+            m.counter("lsm_stream_written_bytes", "Bytes written to the stream", labels, st.bytesWritten);
+            m.counter("lsm_stream_reads", "Stream reads", labels, st.reads);
+            m.counter("lsm_stream_read_bytes", "Bytes read from the stream", labels, st.bytesRead);
+            m.counter("lsm_stream_writer_lock_acquisitions", "Stream lock acquisitions by writers", labels, st.writerLockAcquisitions);
+            m.counter("lsm_stream_writer_lock_spins", "Failed stream lock attempts by writers", labels, st.writerLockSpins);
+            m.counter("lsm_stream_reader_lock_acquisitions", "Stream lock acquisitions by readers", labels, st.readerLockAcquisitions);
+            m.counter("lsm_stream_reader_lock_spins", "Failed stream lock attempts by readers", labels, st.readerLockSpins);
+        }
+        return;
+    }
+    if (!now.queue) {
+        return;
+    }
+    const QueueSnapshot &q = *now.queue;
+    m.gauge("lsm_queue_depth", "Messages currently in the queue", labels, q.count);
+    m.gauge("lsm_queue_capacity", "Message slots in the queue", labels, q.capacity);
+    m.gauge("lsm_queue_fill_ratio", "depth / capacity", labels, q.fillRatio());
+    m.gauge("lsm_queue_max_message_bytes", "Largest message a slot holds", labels, q.maxMessageSize);
+    m.gauge("lsm_queue_producer_lock_holder_pid", "Process holding the producer lock, 0 when free", labels, q.producerLockHolder);
+    m.gauge("lsm_queue_consumer_lock_holder_pid", "Process holding the consumer lock, 0 when free", labels, q.consumerLockHolder);
+    if (q.dropped) {
+        m.counter("lsm_queue_dropped", "Messages evicted unread by overwrite-mode enqueues", labels, static_cast<double>(*q.dropped));
+    }
+    if (q.statistics) {
+        const QueueStatistics &st = *q.statistics;
+        m.counter("lsm_queue_enqueues", "Messages enqueued", labels, st.enqueues);
+        m.counter("lsm_queue_dequeues", "Messages dequeued", labels, st.dequeues);
+        m.counter("lsm_queue_enqueued_bytes", "Bytes enqueued", labels, st.bytesEnqueued);
+        m.counter("lsm_queue_dequeued_bytes", "Bytes dequeued", labels, st.bytesDequeued);
+        m.counter("lsm_queue_full_rejections", "Enqueues rejected because the queue was full", labels, st.fullRejections);
+        m.counter("lsm_queue_empty_rejections", "Dequeues on an empty queue", labels, st.emptyRejections);
+        m.gauge("lsm_queue_high_water_mark", "Largest depth the queue has reached", labels, static_cast<double>(st.highWaterMark));
+        m.counter("lsm_queue_producer_lock_acquisitions", "Producer lock acquisitions", labels, st.producerLockAcquisitions);
+        m.counter("lsm_queue_producer_lock_spins", "Failed producer lock attempts", labels, st.producerLockSpins);
+        m.counter("lsm_queue_consumer_lock_acquisitions", "Consumer lock acquisitions", labels, st.consumerLockAcquisitions);
+        m.counter("lsm_queue_consumer_lock_spins", "Failed consumer lock attempts", labels, st.consumerLockSpins);
+    }
+    if (q.latency) {
+        const LatencyDistribution &l = *q.latency;
+        m.counter("lsm_queue_residence_messages", "Dequeued messages with a residence time", labels, l.count);
+        m.counter("lsm_queue_residence_seconds", "Summed queue residence time", labels, l.totalNs / 1e9);
+        m.gauge("lsm_queue_residence_p50_seconds", "Upper bound of the median residence time bucket", labels, l.percentileNs(0.5) / 1e9);
+        m.gauge("lsm_queue_residence_p99_seconds", "Upper bound of the 99th percentile residence time bucket", labels, l.percentileNs(0.99) / 1e9);
+        m.gauge("lsm_queue_residence_max_seconds", "Longest residence time since the last reset", labels, l.maxNs / 1e9);
+    }
+}
+
+// write next to the destination and rename, so a scraper never sees a partial file
+bool writeFileAtomically(const std::string &path, const std::string &content) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out || !(out << content)) {
+            return false;
+        }
+    }
+#if defined(_WIN32)
+    // rename does not replace existing files on Windows
+    return MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    // rename replaces path in one step, so it never goes missing either
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    const Options options = parseOptions(argc, argv);
+#if !defined(_WIN32)
+    const bool clearScreen = !options.once && options.output.empty() && isatty(STDOUT_FILENO);
+#else
+    const bool clearScreen = false;
+#endif
+
+    std::vector<std::optional<Sample>> previous(options.targets.size());
+    for (;;) {
+        std::ostringstream report;
+        MetricsWriter metrics;
+
+        for (std::size_t i = 0; i < options.targets.size(); ++i) {
+            const std::string &name = options.targets[i];
+            Sample now;
+            try {
+                now = takeSample(name);
+            } catch (const std::exception &e) {
+                std::cerr << name << ": " << e.what() << std::endl;
+            }
+
+            if (options.format == Format::Text) {
+                printText(report, name, now, previous[i] ? &*previous[i] : nullptr);
+            } else {
+                collectMetrics(metrics, name, now);
+            }
+            previous[i] = now;
+        }
+        if (options.format == Format::OpenMetrics) {
+            metrics.write(report);
+        }
+
+        if (!options.output.empty()) {
+            if (!writeFileAtomically(options.output, report.str())) {
+                std::cerr << "could not write " << options.output << std::endl;
+                return 1;
+            }
+        } else {
+            if (clearScreen) {
+                std::cout << "\033[H\033[2J";
+            }
+            std::cout << report.str() << std::flush;
+        }
+
+        if (options.once) {
+            return 0;
+        }
+        std::this_thread::sleep_for(options.interval);
+    }
+}